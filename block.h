@@ -1,10 +1,42 @@
 #ifndef BLOCK_H
 #define BLOCK_H
 
-#define BLOCK_SIZE 1024
+#include <stdint.h>
 
-typedef struct _block_t {
-    char data [BLOCK_SIZE];
+/* Storage of the state of the file system, kept apart for each thread so that each
+   thread can mount its own disk */
+#define THREAD_LOCAL __thread
+
+/* Largest block size that can be used by a disk */
+#define BLOCK_MAX_SIZE 4096
+
+/* Block size of the disk in use */
+#define BLOCK_SIZE (disk_geometry.block_size)
+
+/* Index of a block on the disk */
+typedef int64_t block_addr_t;
+
+/**
+ * _geometry_t -- Layout of the disk in use, which is chosen when the disk is created
+ *                and stored in its superblock. Each length is a number of blocks.
+*/
+typedef struct _geometry_t {
+    int block_size;
+    int64_t num_blocks;
+    int inode_length;
+    int64_t data_length;
+    int dir_length;
+    int fbm_length;
+} geometry_t;
+
+extern THREAD_LOCAL geometry_t disk_geometry;
+
+/**
+ * _block_t -- Content of a block, which can also be read as the pointers of an indirect block.
+*/
+typedef union _block_t {
+    char data [BLOCK_MAX_SIZE];
+    block_addr_t pointers [BLOCK_MAX_SIZE / sizeof(block_addr_t)];
 } block_t;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,441 @@
+#include "block_device.h"
+#include "stripe.h"
+#include "writeback.h"
+#include "block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Block device used by read_blocks and write_blocks */
+THREAD_LOCAL block_device_t *disk_device = NULL;
+
+/* Helper Functions */
+block_device_t* new_block_device(int type, int block_size, int64_t num_blocks);
+int zero_blocks(block_device_t *device, int64_t start_address, int nblocks);
+int file_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int file_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int file_flush(block_device_t *device);
+void file_close(block_device_t *device);
+int memory_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int memory_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int memory_discard(block_device_t *device, int64_t start_address, int nblocks);
+int mmap_flush(block_device_t *device);
+void mmap_close(block_device_t *device);
+int ram_flush(block_device_t *device);
+void ram_close(block_device_t *device);
+int stripe_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int stripe_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int stripe_flush(block_device_t *device);
+void stripe_close(block_device_t *device);
+int writeback_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int writeback_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+int writeback_flush(block_device_t *device);
+int writeback_discard(block_device_t *device, int64_t start_address, int nblocks);
+void writeback_close(block_device_t *device);
+
+/**
+ * open_file_device -- Opens a block device stored in an image file with stdio.
+ * 
+ * filename: name of the image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image file filled with 0's (true) or open an existing one (false)
+ * 
+ * returns the block device or NULL if the image file cannot be opened
+*/
+block_device_t* open_file_device(char *filename, int block_size, int64_t num_blocks, bool fresh) {
+    FILE *fp = fopen(filename, fresh ? "w+b" : "r+b");
+    if (fp == NULL) {
+        printf("Could not open %s\n\n", filename);
+        return NULL;
+    }
+
+    /* Fills the file with 0's to its given size */
+    if (fresh && ftruncate(fileno(fp), (off_t) block_size * num_blocks) < 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    block_device_t *device = new_block_device(BLOCK_DEVICE_FILE, block_size, num_blocks);
+    device -> data = fp;
+    device -> read = file_read;
+    device -> write = file_write;
+    device -> flush = file_flush;
+    device -> discard = zero_blocks;
+    device -> close = file_close;
+    return device;
+}
+
+/**
+ * open_mmap_device -- Opens a block device stored in an image file mapped in memory.
+ * 
+ * filename: name of the image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image file filled with 0's (true) or open an existing one (false)
+ * 
+ * returns the block device, with fewer blocks if the image file is shorter, or NULL if the
+ * image file cannot be mapped
+*/
+block_device_t* open_mmap_device(char *filename, int block_size, int64_t num_blocks, bool fresh) {
+    int fd = open(filename, fresh ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0 || (fresh && ftruncate(fd, (off_t) block_size * num_blocks) < 0)) {
+        printf("Could not open %s\n\n", filename);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    /* Only the whole blocks of a shorter image file are mapped, since the pages past its end cannot be accessed */
+    struct stat image;
+    if (fstat(fd, &image) < 0 || image.st_size < block_size) {
+        printf("Could not open %s\n\n", filename);
+        close(fd);
+        return NULL;
+    }
+    if (image.st_size / block_size < num_blocks) num_blocks = image.st_size / block_size;
+
+    size_t length = (size_t) block_size * num_blocks;
+    void *map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    block_device_t *device = new_block_device(BLOCK_DEVICE_MMAP, block_size, num_blocks);
+    device -> data = map;
+    device -> read = memory_read;
+    device -> write = memory_write;
+    device -> flush = mmap_flush;
+    device -> discard = memory_discard;
+    device -> close = mmap_close;
+    return device;
+}
+
+/**
+ * open_ram_device -- Opens a block device filled with 0's that only lives in memory.
+ * 
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * 
+ * returns the block device or NULL if the memory cannot be allocated
+*/
+block_device_t* open_ram_device(int block_size, int64_t num_blocks) {
+    void *memory = calloc((size_t) num_blocks, block_size);
+    if (memory == NULL) return NULL;
+
+    block_device_t *device = new_block_device(BLOCK_DEVICE_RAM, block_size, num_blocks);
+    device -> data = memory;
+    device -> read = memory_read;
+    device -> write = memory_write;
+    device -> flush = ram_flush;
+    device -> discard = memory_discard;
+    device -> close = ram_close;
+    return device;
+}
+
+/**
+ * open_stripe_device -- Opens a block device striped across multiple image files (stripe.h).
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image files filled with 0's (true) or open existing ones (false)
+ * 
+ * returns the block device or NULL if the image files cannot be opened
+*/
+block_device_t* open_stripe_device(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks, bool fresh) {
+    /* The striped disk is a single instance, so the device that uses it is closed first */
+    if (disk_device != NULL && disk_device -> type == BLOCK_DEVICE_STRIPE) close_block_device();
+
+    int result = fresh ? init_fresh_stripe(filename, members, stripe_unit, block_size, num_blocks)
+                       : init_stripe(filename, members, stripe_unit, block_size, num_blocks);
+    if (result < 0) return NULL;
+
+    block_device_t *device = new_block_device(BLOCK_DEVICE_STRIPE, block_size, num_blocks);
+    device -> read = stripe_read;
+    device -> write = stripe_write;
+    device -> flush = stripe_flush;
+    device -> discard = zero_blocks;
+    device -> close = stripe_close;
+    return device;
+}
+
+/**
+ * open_writeback_device -- Opens a block device that holds the written blocks in a write-back
+ *                          cache (writeback.h) in front of another block device, whose type
+ *                          it keeps. A flusher thread writes the dirty blocks back in the
+ *                          background, and the writers only wait once dirty_limit blocks are dirty.
+ * 
+ * lower: block device where the blocks are written back, which is closed with this device
+ * dirty_limit: number of dirty blocks at which the writers wait for the flusher
+ * background_percent: percentage of dirty_limit at which the flusher writes back the dirty
+ *                     blocks regardless of their age
+ * expire_ms: age in milliseconds at which a dirty block is written back
+ * 
+ * returns the block device or NULL if lower is NULL or the flusher cannot be started
+*/
+block_device_t* open_writeback_device(block_device_t *lower, int dirty_limit, int background_percent, int expire_ms) {
+    if (lower == NULL) return NULL;
+
+    writeback_t *cache = open_writeback(lower, dirty_limit, (int) ((int64_t) dirty_limit * background_percent / 100), expire_ms);
+    if (cache == NULL) {
+        lower -> close(lower);
+        free(lower);
+        return NULL;
+    }
+
+    block_device_t *device = new_block_device(lower -> type, lower -> block_size, lower -> num_blocks);
+    device -> data = cache;
+    device -> read = writeback_read;
+    device -> write = writeback_write;
+    device -> flush = writeback_flush;
+    device -> discard = writeback_discard;
+    device -> close = writeback_close;
+    return device;
+}
+
+/**
+ * set_block_device -- Sets the block device used by read_blocks and write_blocks.
+ *                     The previous block device is closed.
+ * 
+ * device: block device to be used
+ * 
+ * returns 0 or -1 if the device is NULL
+*/
+int set_block_device(block_device_t *device) {
+    if (device == NULL) return -1;
+    if (device != disk_device) close_block_device();
+
+    disk_device = device;
+    return 0;
+}
+
+/**
+ * share_block_device -- Sets the block device used by read_blocks and write_blocks in the
+ *                       calling thread to a device opened by another thread, which stays
+ *                       in charge of closing it. NULL leaves the thread without a device.
+ * 
+ * device: block device of the other thread or NULL
+*/
+void share_block_device(block_device_t *device) {
+    disk_device = device;
+}
+
+/**
+ * get_block_device -- Gets the block device used by read_blocks and write_blocks.
+ * 
+ * returns the block device or NULL if none has been set
+*/
+block_device_t* get_block_device() {
+    return disk_device;
+}
+
+/**
+ * close_block_device -- Closes the block device used by read_blocks and write_blocks.
+*/
+void close_block_device() {
+    if (disk_device == NULL) return;
+
+    disk_device -> close(disk_device);
+    free(disk_device);
+    disk_device = NULL;
+}
+
+/**
+ * new_block_device -- Allocates a block device with the given geometry.
+ * 
+ * type: type of the block device
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * 
+ * returns the block device
+*/
+block_device_t* new_block_device(int type, int block_size, int64_t num_blocks) {
+    block_device_t *device = (block_device_t *) calloc(1, sizeof(block_device_t));
+    device -> type = type;
+    device -> block_size = block_size;
+    device -> num_blocks = num_blocks;
+    return device;
+}
+
+/**
+ * zero_blocks -- Discards a series of blocks by writing zeros to them, for the backends
+ *                where the storage cannot release a range of blocks.
+ * 
+ * device: block device
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * 
+ * returns the number of blocks discarded or -1 if the action failed
+*/
+int zero_blocks(block_device_t *device, int64_t start_address, int nblocks) {
+    char *zeros = (char *) calloc(nblocks, device -> block_size);
+    if (zeros == NULL) return -1;
+
+    int result = device -> write(device, start_address, nblocks, zeros);
+    free(zeros);
+    return result;
+}
+
+/**
+ * file_read -- Reads a series of blocks from the image file with a single request.
+*/
+int file_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    FILE *fp = (FILE *) device -> data;
+
+    fseeko(fp, (off_t) start_address * device -> block_size, SEEK_SET);
+    if (fread(buffer, device -> block_size, nblocks, fp) != (size_t) nblocks) return -1;
+    return nblocks;
+}
+
+/**
+ * file_write -- Writes a series of blocks to the image file with a single request. The
+ *               blocks go through the buffer of the image file and the operating system
+ *               decides when they reach the storage, unless the device is flushed.
+*/
+int file_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    FILE *fp = (FILE *) device -> data;
+
+    fseeko(fp, (off_t) start_address * device -> block_size, SEEK_SET);
+    if (fwrite(buffer, device -> block_size, nblocks, fp) != (size_t) nblocks) return -1;
+    return nblocks;
+}
+
+/**
+ * file_flush -- Flushes the image file to the storage.
+*/
+int file_flush(block_device_t *device) {
+    FILE *fp = (FILE *) device -> data;
+
+    if (fflush(fp) != 0) return -1;
+    return fdatasync(fileno(fp));
+}
+
+/**
+ * file_close -- Closes the image file.
+*/
+void file_close(block_device_t *device) {
+    fclose((FILE *) device -> data);
+}
+
+/**
+ * memory_read -- Reads a series of blocks from a device held in memory.
+*/
+int memory_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    memcpy(buffer, (char *) device -> data + (size_t) start_address * device -> block_size,
+        (size_t) nblocks * device -> block_size);
+    return nblocks;
+}
+
+/**
+ * memory_write -- Writes a series of blocks to a device held in memory.
+*/
+int memory_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    memcpy((char *) device -> data + (size_t) start_address * device -> block_size, buffer,
+        (size_t) nblocks * device -> block_size);
+    return nblocks;
+}
+
+/**
+ * memory_discard -- Clears a series of blocks of a device held in memory.
+*/
+int memory_discard(block_device_t *device, int64_t start_address, int nblocks) {
+    memset((char *) device -> data + (size_t) start_address * device -> block_size, 0,
+        (size_t) nblocks * device -> block_size);
+    return nblocks;
+}
+
+/**
+ * mmap_flush -- Flushes the mapped image file to the storage.
+*/
+int mmap_flush(block_device_t *device) {
+    return msync(device -> data, (size_t) device -> block_size * device -> num_blocks, MS_SYNC);
+}
+
+/**
+ * mmap_close -- Unmaps the image file.
+*/
+void mmap_close(block_device_t *device) {
+    munmap(device -> data, (size_t) device -> block_size * device -> num_blocks);
+}
+
+/**
+ * ram_flush -- Nothing has to be flushed since the device only lives in memory.
+*/
+int ram_flush(block_device_t *device) {
+    return 0;
+}
+
+/**
+ * ram_close -- Releases the memory of the device, so its blocks are lost.
+*/
+void ram_close(block_device_t *device) {
+    free(device -> data);
+}
+
+/**
+ * stripe_read -- Reads a series of blocks from the striped disk.
+*/
+int stripe_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    return read_stripe(start_address, nblocks, buffer);
+}
+
+/**
+ * stripe_write -- Writes a series of blocks to the striped disk.
+*/
+int stripe_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    return write_stripe(start_address, nblocks, buffer);
+}
+
+/**
+ * stripe_flush -- Flushes the image files of the striped disk to the storage.
+*/
+int stripe_flush(block_device_t *device) {
+    return flush_stripe();
+}
+
+/**
+ * stripe_close -- Stops the workers and closes the image files of the striped disk.
+*/
+void stripe_close(block_device_t *device) {
+    close_stripe();
+}
+
+/**
+ * writeback_read -- Reads a series of blocks through the write-back cache.
+*/
+int writeback_read(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    return read_writeback((writeback_t *) device -> data, start_address, nblocks, buffer);
+}
+
+/**
+ * writeback_write -- Writes a series of blocks to the write-back cache.
+*/
+int writeback_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    return write_writeback((writeback_t *) device -> data, start_address, nblocks, buffer);
+}
+
+/**
+ * writeback_flush -- Writes back the dirty blocks and flushes the device behind the cache.
+*/
+int writeback_flush(block_device_t *device) {
+    return flush_writeback((writeback_t *) device -> data);
+}
+
+/**
+ * writeback_discard -- Drops the dirty blocks of a range and discards it on the device behind the cache.
+*/
+int writeback_discard(block_device_t *device, int64_t start_address, int nblocks) {
+    return discard_writeback((writeback_t *) device -> data, start_address, nblocks);
+}
+
+/**
+ * writeback_close -- Stops the flusher, writes back the dirty blocks and closes the device behind the cache.
+*/
+void writeback_close(block_device_t *device) {
+    close_writeback((writeback_t *) device -> data);
+}
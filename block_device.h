@@ -0,0 +1,126 @@
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Types of block devices */
+#define BLOCK_DEVICE_FILE 0
+#define BLOCK_DEVICE_MMAP 1
+#define BLOCK_DEVICE_RAM 2
+#define BLOCK_DEVICE_STRIPE 3
+
+/**
+ * Block device where each operation is a function of the backend. The operations
+ * are called with the range already checked against the geometry of the device.
+*/
+typedef struct _block_device_t {
+    int type;
+    int block_size;     /* Geometry of the device */
+    int64_t num_blocks;
+    void *data;         /* State of the backend */
+
+    int (*read)(struct _block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+    int (*write)(struct _block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+    int (*flush)(struct _block_device_t *device);
+    int (*discard)(struct _block_device_t *device, int64_t start_address, int nblocks);
+    void (*close)(struct _block_device_t *device);
+} block_device_t;
+
+/**
+ * open_file_device -- Opens a block device stored in an image file with stdio.
+ * 
+ * filename: name of the image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image file filled with 0's (true) or open an existing one (false)
+ * 
+ * returns the block device or NULL if the image file cannot be opened
+*/
+block_device_t* open_file_device(char *filename, int block_size, int64_t num_blocks, bool fresh);
+
+/**
+ * open_mmap_device -- Opens a block device stored in an image file mapped in memory.
+ * 
+ * filename: name of the image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image file filled with 0's (true) or open an existing one (false)
+ * 
+ * returns the block device, with fewer blocks if the image file is shorter, or NULL if the
+ * image file cannot be mapped
+*/
+block_device_t* open_mmap_device(char *filename, int block_size, int64_t num_blocks, bool fresh);
+
+/**
+ * open_ram_device -- Opens a block device filled with 0's that only lives in memory.
+ * 
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * 
+ * returns the block device or NULL if the memory cannot be allocated
+*/
+block_device_t* open_ram_device(int block_size, int64_t num_blocks);
+
+/**
+ * open_stripe_device -- Opens a block device striped across multiple image files (stripe.h).
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the device
+ * fresh: create the image files filled with 0's (true) or open existing ones (false)
+ * 
+ * returns the block device or NULL if the image files cannot be opened
+*/
+block_device_t* open_stripe_device(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks, bool fresh);
+
+/**
+ * open_writeback_device -- Opens a block device that holds the written blocks in a write-back
+ *                          cache (writeback.h) in front of another block device, whose type
+ *                          it keeps. A flusher thread writes the dirty blocks back in the
+ *                          background, and the writers only wait once dirty_limit blocks are dirty.
+ * 
+ * lower: block device where the blocks are written back, which is closed with this device
+ * dirty_limit: number of dirty blocks at which the writers wait for the flusher
+ * background_percent: percentage of dirty_limit at which the flusher writes back the dirty
+ *                     blocks regardless of their age
+ * expire_ms: age in milliseconds at which a dirty block is written back
+ * 
+ * returns the block device or NULL if lower is NULL or the flusher cannot be started
+*/
+block_device_t* open_writeback_device(block_device_t *lower, int dirty_limit, int background_percent, int expire_ms);
+
+/**
+ * set_block_device -- Sets the block device used by read_blocks and write_blocks.
+ *                     The previous block device is closed.
+ * 
+ * device: block device to be used
+ * 
+ * returns 0 or -1 if the device is NULL
+*/
+int set_block_device(block_device_t *device);
+
+/**
+ * share_block_device -- Sets the block device used by read_blocks and write_blocks in the
+ *                       calling thread to a device opened by another thread, which stays
+ *                       in charge of closing it. NULL leaves the thread without a device.
+ * 
+ * device: block device of the other thread or NULL
+*/
+void share_block_device(block_device_t *device);
+
+/**
+ * get_block_device -- Gets the block device used by read_blocks and write_blocks.
+ * 
+ * returns the block device or NULL if none has been set
+*/
+block_device_t* get_block_device();
+
+/**
+ * close_block_device -- Closes the block device used by read_blocks and write_blocks.
+*/
+void close_block_device();
+
+#endif
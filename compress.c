@@ -0,0 +1,358 @@
+#include "compress.h"
+#include "free_bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+
+/* Size of the header that keeps the compressed length in the first block of a cluster */
+#define CLUSTER_HEADER_SIZE sizeof(int)
+
+/* Helper Functions */
+int lz_emit(uint8_t* dst, int op, int capacity, const uint8_t* literals, int literal_length, int offset, int match_length);
+int lz_emit_length(uint8_t* dst, int op, int length);
+void read_cluster_runs(block_addr_t* blocks, int count, char* buffer);
+void write_cluster_runs(block_addr_t* blocks, int count, char* buffer);
+
+/**
+ * lz_compress -- Compresses a buffer with an LZ77 codec where each sequence is a token,
+ *                a run of literals and a back reference of at least 4 bytes.
+ * 
+ * src: buffer to be compressed
+ * length: size of the buffer
+ * dst: buffer where the compressed data is written
+ * capacity: size of the destination buffer
+ * 
+ * returns the size of the compressed data or -1 if it does not fit in the destination buffer
+*/
+int lz_compress(const uint8_t* src, int length, uint8_t* dst, int capacity) {
+    int table[1 << LZ_HASH_BITS];
+    int ip = 0, anchor = 0, op = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+        table[i] = -1;
+
+    while (ip + LZ_MIN_MATCH <= length) {
+        uint32_t sequence;
+        memcpy(&sequence, src + ip, sizeof(sequence));
+
+        /* Finds the last position that had the same 4 bytes */
+        int hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[hash];
+        table[hash] = ip;
+
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || memcmp(src + ref, src + ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
+
+        int match_length = LZ_MIN_MATCH;
+        while (ip + match_length < length && src[ref + match_length] == src[ip + match_length])
+            match_length++;
+
+        op = lz_emit(dst, op, capacity, src + anchor, ip - anchor, ip - ref, match_length);
+        if (op < 0) return -1;
+
+        ip += match_length;
+        anchor = ip;
+    }
+
+    /* The last sequence only has literals */
+    return lz_emit(dst, op, capacity, src + anchor, length - anchor, 0, 0);
+}
+
+/**
+ * lz_decompress -- Decompresses a buffer compressed by lz_compress.
+ * 
+ * src: compressed data
+ * length: size of the compressed data
+ * dst: buffer where the data is decompressed
+ * capacity: size of the destination buffer
+ * 
+ * returns the size of the decompressed data or -1 if the compressed data is invalid
+*/
+int lz_decompress(const uint8_t* src, int length, uint8_t* dst, int capacity) {
+    int ip = 0, op = 0;
+
+    while (ip < length) {
+        int token = src[ip++];
+
+        /* Copies the literals */
+        int literal_length = token >> 4;
+        if (literal_length == 15) {
+            int extra;
+            do {
+                if (ip >= length) return -1;
+                extra = src[ip++];
+                literal_length += extra;
+            } while (extra == 255);
+        }
+        if (ip + literal_length > length || op + literal_length > capacity) return -1;
+        memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        /* The last sequence ends after its literals */
+        if (ip == length) break;
+
+        /* Copies the back reference byte by byte since it may overlap itself */
+        if (ip + 2 > length) return -1;
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        int match_length = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            int extra;
+            do {
+                if (ip >= length) return -1;
+                extra = src[ip++];
+                match_length += extra;
+            } while (extra == 255);
+        }
+        if (offset == 0 || offset > op || op + match_length > capacity) return -1;
+        for (int i = 0; i < match_length; i++, op++)
+            dst[op] = dst[op - offset];
+    }
+    return op;
+}
+
+/**
+ * is_compressed_cluster -- Checks if the pointers of a cluster hold compressed data.
+ *                          A compressed cluster keeps its data in the first slots
+ *                          and marks the saved slots with COMPRESSED_POINTER.
+ * 
+ * blocks: the COMPRESS_CLUSTER_BLOCKS pointers of the cluster
+ * 
+ * returns true if the cluster is compressed
+*/
+bool is_compressed_cluster(block_addr_t* blocks) {
+    return blocks[COMPRESS_CLUSTER_BLOCKS - 1] == COMPRESSED_POINTER;
+}
+
+/**
+ * read_compressed_cluster -- Reads and decompresses a compressed cluster.
+ * 
+ * blocks: the COMPRESS_CLUSTER_BLOCKS pointers of the cluster
+ * buffer: buffer of COMPRESS_CLUSTER_SIZE bytes where the cluster is decompressed
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int read_compressed_cluster(block_addr_t* blocks, char* buffer) {
+    block_t compressed[COMPRESS_CLUSTER_BLOCKS];
+    int count = 0;
+    while (count < COMPRESS_CLUSTER_BLOCKS && blocks[count] >= 0) count++;
+
+    read_cluster_runs(blocks, count, (char *) compressed);
+
+    int length;
+    memcpy(&length, compressed, CLUSTER_HEADER_SIZE);
+    if (length < 0 || length > count * BLOCK_SIZE - CLUSTER_HEADER_SIZE) return -1;
+
+    int decompressed = lz_decompress(((uint8_t *) compressed) + CLUSTER_HEADER_SIZE, length,
+        (uint8_t *) buffer, COMPRESS_CLUSTER_SIZE);
+    if (decompressed < 0) return -1;
+
+    /* The end of the cluster that has not been written is read as zeros */
+    memset(buffer + decompressed, 0, COMPRESS_CLUSTER_SIZE - decompressed);
+    return 0;
+}
+
+/**
+ * compress_cluster -- Compresses a cluster of the file if it saves at least one data block.
+ *                     The compressed data is written to the first data blocks of the cluster
+ *                     and the other data blocks are freed. Clusters with data blocks shared
+ *                     with other pointers are left as is.
+ * 
+ * inode: INode of the file
+ * cluster: index of the cluster within the file
+ * 
+ * returns the number of data blocks that have been freed
+*/
+int compress_cluster(inode_t* inode, int64_t cluster) {
+    block_addr_t blocks[COMPRESS_CLUSTER_BLOCKS];
+    block_addr_t used[COMPRESS_CLUSTER_BLOCKS];
+    int count = 0;
+
+    get_inode_blocks(inode, cluster * COMPRESS_CLUSTER_BLOCKS, COMPRESS_CLUSTER_BLOCKS, blocks);
+    if (is_compressed_cluster(blocks)) return 0;
+
+    for (int i = 0; i < COMPRESS_CLUSTER_BLOCKS; i++) {
+        if (blocks[i] < 0) continue;
+
+        /* A data block shared with other pointers cannot be written in place */
+        if (get_block_refs(blocks[i]) > 1) return 0;
+        used[count++] = blocks[i];
+    }
+    if (count < 2) return 0;
+
+    /* Reads the cluster where the pointers without a data block are zeros */
+    char *buffer = (char *) malloc(COMPRESS_CLUSTER_SIZE);
+    block_t compressed[COMPRESS_CLUSTER_BLOCKS];
+    for (int i = 0; i < COMPRESS_CLUSTER_BLOCKS; i++) {
+        if (blocks[i] < 0) memset(buffer + i * BLOCK_SIZE, 0, BLOCK_SIZE);
+        else read_blocks(blocks[i], 1, buffer + i * BLOCK_SIZE);
+    }
+
+    /* Trailing zeros are not stored since a compressed cluster is padded with zeros */
+    int length = COMPRESS_CLUSTER_SIZE;
+    while (length > 0 && buffer[length - 1] == 0) length--;
+
+    /* The compressed data has to fit in fewer data blocks than the cluster is using */
+    int capacity = (count - 1) * BLOCK_SIZE - CLUSTER_HEADER_SIZE;
+    int compressed_length = lz_compress((uint8_t *) buffer, length,
+        ((uint8_t *) compressed) + CLUSTER_HEADER_SIZE, capacity);
+    free(buffer);
+    if (compressed_length < 0) return 0;
+
+    memcpy(compressed, &compressed_length, CLUSTER_HEADER_SIZE);
+    int compressed_count = (CLUSTER_HEADER_SIZE + compressed_length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (compressed_count == 0) compressed_count = 1;
+
+    /* Reuses the first data blocks of the cluster and frees the others */
+    for (int i = 0; i < COMPRESS_CLUSTER_BLOCKS; i++)
+        blocks[i] = i < compressed_count ? used[i] : COMPRESSED_POINTER;
+    write_cluster_runs(blocks, compressed_count, (char *) compressed);
+    set_inode_blocks(inode, cluster * COMPRESS_CLUSTER_BLOCKS, COMPRESS_CLUSTER_BLOCKS, blocks);
+
+    reset_free_blocks(used + compressed_count, count - compressed_count);
+
+    return count - compressed_count;
+}
+
+/**
+ * expand_cluster -- Decompresses a cluster of the file back to one data block per pointer
+ *                   so that it can be written in place. The data blocks of the cluster
+ *                   that are shared with other pointers are copied.
+ * 
+ * inode: INode of the file
+ * cluster: index of the cluster within the file
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int expand_cluster(inode_t* inode, int64_t cluster) {
+    block_addr_t blocks[COMPRESS_CLUSTER_BLOCKS];
+
+    get_inode_blocks(inode, cluster * COMPRESS_CLUSTER_BLOCKS, COMPRESS_CLUSTER_BLOCKS, blocks);
+    if (!is_compressed_cluster(blocks)) return 0;
+
+    char *buffer = (char *) malloc(COMPRESS_CLUSTER_SIZE);
+    if (read_compressed_cluster(blocks, buffer) < 0) {
+        free(buffer);
+        return -1;
+    }
+
+    /* Assigns a data block to each slot saved by the compression, and copies
+       the data blocks shared with other pointers on write */
+    block_addr_t original[COMPRESS_CLUSTER_BLOCKS];
+    for (int i = 0; i < COMPRESS_CLUSTER_BLOCKS; i++) {
+        original[i] = blocks[i];
+        if (blocks[i] != COMPRESSED_POINTER && get_block_refs(blocks[i]) == 1) continue;
+
+        blocks[i] = find_free_block();
+        if (blocks[i] < 0) {
+            /* If the disk is full, the data blocks assigned so far are released */
+            for (int j = 0; j < i; j++)
+                if (blocks[j] != original[j]) reset_free_block(blocks[j]);
+            free(buffer);
+            return -1;
+        }
+    }
+    for (int i = 0; i < COMPRESS_CLUSTER_BLOCKS; i++)
+        if (original[i] >= 0 && blocks[i] != original[i]) reset_free_block(original[i]);
+
+    write_cluster_runs(blocks, COMPRESS_CLUSTER_BLOCKS, buffer);
+    set_inode_blocks(inode, cluster * COMPRESS_CLUSTER_BLOCKS, COMPRESS_CLUSTER_BLOCKS, blocks);
+    free(buffer);
+    return 0;
+}
+
+/**
+ * lz_emit -- Writes one sequence of the compressed data.
+ * 
+ * dst: buffer where the compressed data is written
+ * op: position in the compressed data
+ * capacity: size of the destination buffer
+ * literals: bytes that are copied as is
+ * literal_length: number of literals
+ * offset: distance of the back reference (0 for the last sequence)
+ * match_length: size of the back reference (0 for the last sequence)
+ * 
+ * returns the new position in the compressed data or -1 if it does not fit
+*/
+int lz_emit(uint8_t* dst, int op, int capacity, const uint8_t* literals, int literal_length, int offset, int match_length) {
+    int needed = 1 + literal_length + (literal_length >= 15 ? (literal_length - 15) / 255 + 1 : 0);
+    if (offset > 0) {
+        int extra = match_length - LZ_MIN_MATCH;
+        needed += 2 + (extra >= 15 ? (extra - 15) / 255 + 1 : 0);
+    }
+    if (op + needed > capacity) return -1;
+
+    int match_token = offset > 0 ? match_length - LZ_MIN_MATCH : 0;
+    dst[op++] = (uint8_t) (((literal_length < 15 ? literal_length : 15) << 4) | (match_token < 15 ? match_token : 15));
+
+    if (literal_length >= 15) op = lz_emit_length(dst, op, literal_length - 15);
+    memcpy(dst + op, literals, literal_length);
+    op += literal_length;
+
+    if (offset > 0) {
+        dst[op++] = (uint8_t) (offset & 0xFF);
+        dst[op++] = (uint8_t) (offset >> 8);
+        if (match_token >= 15) op = lz_emit_length(dst, op, match_token - 15);
+    }
+    return op;
+}
+
+/**
+ * lz_emit_length -- Writes the part of a length that does not fit in the token
+ *                   as bytes of 255 followed by the remainder.
+ * 
+ * dst: buffer where the compressed data is written
+ * op: position in the compressed data
+ * length: remaining length
+ * 
+ * returns the new position in the compressed data
+*/
+int lz_emit_length(uint8_t* dst, int op, int length) {
+    while (length >= 255) {
+        dst[op++] = 255;
+        length -= 255;
+    }
+    dst[op++] = (uint8_t) length;
+    return op;
+}
+
+/**
+ * read_cluster_runs -- Reads data blocks where each run of contiguous data blocks
+ *                      is read with a single block request.
+ * 
+ * blocks: indices of the data blocks
+ * count: number of data blocks
+ * buffer: buffer where the data blocks are copied to
+*/
+void read_cluster_runs(block_addr_t* blocks, int count, char* buffer) {
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && blocks[i + run] == blocks[i] + run) run++;
+        read_blocks(blocks[i], run, buffer + i * BLOCK_SIZE);
+        i += run;
+    }
+}
+
+/**
+ * write_cluster_runs -- Writes data blocks where each run of contiguous data blocks
+ *                       is written with a single block request.
+ * 
+ * blocks: indices of the data blocks
+ * count: number of data blocks
+ * buffer: buffer that is written to the data blocks
+*/
+void write_cluster_runs(block_addr_t* blocks, int count, char* buffer) {
+    for (int i = 0; i < count;) {
+        int run = 1;
+        while (i + run < count && blocks[i + run] == blocks[i] + run) run++;
+        write_blocks(blocks[i], run, buffer + i * BLOCK_SIZE);
+        i += run;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "disk_emu.h"
+#include "constant.h"
+#include "block.h"
+#include "inode.h"
+
+/* Number of pointers compressed together */
+#define COMPRESS_CLUSTER_BLOCKS 4
+#define COMPRESS_CLUSTER_SIZE (COMPRESS_CLUSTER_BLOCKS * BLOCK_SIZE)
+
+/* Pointer value of the slots that are saved by a compressed cluster */
+#define COMPRESSED_POINTER -2
+
+/**
+ * lz_compress -- Compresses a buffer with an LZ77 codec where each sequence is a token,
+ *                a run of literals and a back reference of at least 4 bytes.
+ * 
+ * src: buffer to be compressed
+ * length: size of the buffer
+ * dst: buffer where the compressed data is written
+ * capacity: size of the destination buffer
+ * 
+ * returns the size of the compressed data or -1 if it does not fit in the destination buffer
+*/
+int lz_compress(const uint8_t* src, int length, uint8_t* dst, int capacity);
+
+/**
+ * lz_decompress -- Decompresses a buffer compressed by lz_compress.
+ * 
+ * src: compressed data
+ * length: size of the compressed data
+ * dst: buffer where the data is decompressed
+ * capacity: size of the destination buffer
+ * 
+ * returns the size of the decompressed data or -1 if the compressed data is invalid
+*/
+int lz_decompress(const uint8_t* src, int length, uint8_t* dst, int capacity);
+
+/**
+ * is_compressed_cluster -- Checks if the pointers of a cluster hold compressed data.
+ *                          A compressed cluster keeps its data in the first slots
+ *                          and marks the saved slots with COMPRESSED_POINTER.
+ * 
+ * blocks: the COMPRESS_CLUSTER_BLOCKS pointers of the cluster
+ * 
+ * returns true if the cluster is compressed
+*/
+bool is_compressed_cluster(block_addr_t* blocks);
+
+/**
+ * read_compressed_cluster -- Reads and decompresses a compressed cluster.
+ * 
+ * blocks: the COMPRESS_CLUSTER_BLOCKS pointers of the cluster
+ * buffer: buffer of COMPRESS_CLUSTER_SIZE bytes where the cluster is decompressed
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int read_compressed_cluster(block_addr_t* blocks, char* buffer);
+
+/**
+ * compress_cluster -- Compresses a cluster of the file if it saves at least one data block.
+ *                     The compressed data is written to the first data blocks of the cluster
+ *                     and the other data blocks are freed. Clusters with data blocks shared
+ *                     with other pointers are left as is.
+ * 
+ * inode: INode of the file
+ * cluster: index of the cluster within the file
+ * 
+ * returns the number of data blocks that have been freed
+*/
+int compress_cluster(inode_t* inode, int64_t cluster);
+
+/**
+ * expand_cluster -- Decompresses a cluster of the file back to one data block per pointer
+ *                   so that it can be written in place. The data blocks of the cluster
+ *                   that are shared with other pointers are copied.
+ * 
+ * inode: INode of the file
+ * cluster: index of the cluster within the file
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int expand_cluster(inode_t* inode, int64_t cluster);
+
+#endif
@@ -1,11 +1,25 @@
+#ifndef CONSTANT_H
+#define CONSTANT_H
+
+#include "block.h"
+
 #define DISK_NAME "file_sys"
 
+/* Geometry of a new disk unless sfs_set_geometry is called */
+#define DEFAULT_BLOCK_SIZE 1024
+#define DEFAULT_NUM_BLOCKS 1528
+#define DEFAULT_INODE_COUNT 160
+
+/* Age in milliseconds at which a buffer of SFS_BUFFER_TIMED is written unless sfs_set_flush_interval is called */
+#define DEFAULT_FLUSH_INTERVAL 1000
+
 #define SUPERBLOCK_SIZE 1
-#define INODE_TABLE_SIZE 10
-#define FREE_BITMAP_SIZE 2
-#define FILE_SIZE 10
-
-#define DATA_BLOCK_SIZE 1500
-#define DIR_BLOCK_SIZE 5
-#define DIR_ENTRY_SIZE 160
-#define DIR_PER_BLOCK 32
+#define INODE_TABLE_SIZE (disk_geometry.inode_length)
+#define FREE_BITMAP_SIZE (disk_geometry.fbm_length)
+
+#define DATA_BLOCK_SIZE (disk_geometry.data_length)
+#define DIR_BLOCK_SIZE (disk_geometry.dir_length)
+#define DIR_PER_BLOCK (BLOCK_SIZE / 32)
+#define DIR_ENTRY_SIZE (DIR_BLOCK_SIZE * DIR_PER_BLOCK)
+
+#endif
\ No newline at end of file
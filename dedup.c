@@ -0,0 +1,150 @@
+#include "dedup.h"
+#include "free_bitmap.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define DEDUP_BLOCKS (SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE)
+
+/* In-Memory Fingerprint Index */
+THREAD_LOCAL block_addr_t dedup_buckets[DEDUP_BUCKETS];     /* First data block of each bucket */
+THREAD_LOCAL block_addr_t *dedup_next = NULL;               /* Next data block of the same bucket */
+THREAD_LOCAL uint64_t *dedup_hashes = NULL;         /* Fingerprint of each data block */
+THREAD_LOCAL bool *dedup_indexed = NULL;            /* If the data block is in the index */
+
+/**
+ * init_dedup_index -- Initializes the fingerprint index without any data block
+ *                     for the geometry of the disk.
+*/
+void init_dedup_index() {
+    for (int i = 0; i < DEDUP_BUCKETS; i++)
+        dedup_buckets[i] = -1;
+
+    free(dedup_next);
+    free(dedup_hashes);
+    free(dedup_indexed);
+    dedup_next = (block_addr_t *) malloc(DEDUP_BLOCKS * sizeof(block_addr_t));
+    dedup_hashes = (uint64_t *) malloc(DEDUP_BLOCKS * sizeof(uint64_t));
+    dedup_indexed = (bool *) calloc(DEDUP_BLOCKS, sizeof(bool));
+}
+
+/**
+ * free_dedup_index -- Frees the fingerprint index.
+*/
+void free_dedup_index() {
+    free(dedup_next);
+    free(dedup_hashes);
+    free(dedup_indexed);
+    dedup_next = NULL;
+    dedup_hashes = NULL;
+    dedup_indexed = NULL;
+}
+
+/**
+ * build_dedup_index -- Adds every data block referred by the files of the INode table
+ *                      to the fingerprint index.
+ * 
+ * inode_table: INode table in memory
+*/
+void build_dedup_index(inode_t* inode_table) {
+    block_addr_t *blocks;
+    block_t block;
+
+    init_dedup_index();
+    for (int index = 1; index < INODE_LENGTH; index++) {
+        inode_t *inode = &inode_table[index];
+
+        /* The blocks of compressed files are not shared since they are written in place */
+        if (inode -> link_cnt == 0 || (inode -> flags & (INODE_FLAG_INLINE | INODE_FLAG_COMPRESS))) continue;
+
+        int64_t count = collect_inode_blocks(inode, false, &blocks);
+        for (int64_t i = 0; i < count; i++) {
+            if (blocks[i] < 0 || dedup_indexed[blocks[i]]) continue;
+
+            read_blocks(blocks[i], 1, &block);
+            insert_dedup_block(blocks[i], hash_block((char *) &block));
+        }
+        free(blocks);
+    }
+}
+
+/**
+ * hash_block -- Computes the fingerprint of the content of a block.
+ * 
+ * data: content of the block
+ * 
+ * returns the fingerprint
+*/
+uint64_t hash_block(const char* data) {
+    /* FNV-1a hash */
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        hash ^= (uint8_t) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * find_dedup_block -- Finds a data block that has the same content.
+ * 
+ * data: content of the block
+ * hash: fingerprint of the content
+ * 
+ * returns the index of the data block or -1 if none has the same content
+*/
+block_addr_t find_dedup_block(const char* data, uint64_t hash) {
+    block_t block;
+    block_addr_t index = dedup_buckets[hash % DEDUP_BUCKETS];
+
+    while (index >= 0) {
+        block_addr_t next = dedup_next[index];
+
+        if (dedup_hashes[index] == hash) {
+            int refs = get_block_refs(index);
+            if (refs == 0) {
+                /* The data block has been freed */
+                remove_dedup_block(index);
+            } else if (refs < BLOCK_MAX_REFS) {
+                read_blocks(index, 1, &block);
+                if (memcmp(&block, data, BLOCK_SIZE) == 0) return index;
+
+                /* The data block has been written again */
+                remove_dedup_block(index);
+            }
+        }
+        index = next;
+    }
+    return -1;
+}
+
+/**
+ * insert_dedup_block -- Adds a data block to the fingerprint index. The previous
+ *                       entry of the data block is replaced.
+ * 
+ * index: index of the data block
+ * hash: fingerprint of the content of the data block
+*/
+void insert_dedup_block(block_addr_t index, uint64_t hash) {
+    if (index < 0 || index >= DEDUP_BLOCKS) return;
+    remove_dedup_block(index);
+
+    int bucket = hash % DEDUP_BUCKETS;
+    dedup_hashes[index] = hash;
+    dedup_next[index] = dedup_buckets[bucket];
+    dedup_buckets[bucket] = index;
+    dedup_indexed[index] = true;
+}
+
+/**
+ * remove_dedup_block -- Removes a data block from the fingerprint index.
+ * 
+ * index: index of the data block
+*/
+void remove_dedup_block(block_addr_t index) {
+    if (index < 0 || index >= DEDUP_BLOCKS || !dedup_indexed[index]) return;
+
+    block_addr_t *link = &dedup_buckets[dedup_hashes[index] % DEDUP_BUCKETS];
+    while (*link != index) link = &dedup_next[*link];
+    *link = dedup_next[index];
+    dedup_indexed[index] = false;
+}
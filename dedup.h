@@ -0,0 +1,74 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "disk_emu.h"
+#include "constant.h"
+#include "block.h"
+#include "inode.h"
+
+#define DEDUP_BUCKETS 1024
+
+/**
+ * The fingerprint index maps the hash of the content of a data block to the data blocks
+ * that have been written with that content. The index is only a hint: a data block found
+ * in the index is read and compared before it is shared, so entries of data blocks that
+ * have been freed or written again are dropped when they are found.
+*/
+
+/**
+ * init_dedup_index -- Initializes the fingerprint index without any data block
+ *                     for the geometry of the disk.
+*/
+void init_dedup_index();
+
+/**
+ * free_dedup_index -- Frees the fingerprint index.
+*/
+void free_dedup_index();
+
+/**
+ * build_dedup_index -- Adds every data block referred by the files of the INode table
+ *                      to the fingerprint index.
+ * 
+ * inode_table: INode table in memory
+*/
+void build_dedup_index(inode_t* inode_table);
+
+/**
+ * hash_block -- Computes the fingerprint of the content of a block.
+ * 
+ * data: content of the block
+ * 
+ * returns the fingerprint
+*/
+uint64_t hash_block(const char* data);
+
+/**
+ * find_dedup_block -- Finds a data block that has the same content.
+ * 
+ * data: content of the block
+ * hash: fingerprint of the content
+ * 
+ * returns the index of the data block or -1 if none has the same content
+*/
+block_addr_t find_dedup_block(const char* data, uint64_t hash);
+
+/**
+ * insert_dedup_block -- Adds a data block to the fingerprint index. The previous
+ *                       entry of the data block is replaced.
+ * 
+ * index: index of the data block
+ * hash: fingerprint of the content of the data block
+*/
+void insert_dedup_block(block_addr_t index, uint64_t hash);
+
+/**
+ * remove_dedup_block -- Removes a data block from the fingerprint index.
+ * 
+ * index: index of the data block
+*/
+void remove_dedup_block(block_addr_t index);
+
+#endif
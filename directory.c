@@ -1,5 +1,15 @@
 #include "directory.h"
+#include "scan.h"
 #include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+/* Blocks of the directory table changed during a batch */
+THREAD_LOCAL bool dir_batch = false;
+THREAD_LOCAL int *dir_dirty = NULL;
+
+/* Helper Functions */
+int find_dir_index(const char *name, dirent_t* dir_table);
 
 /**
  * init_dir_entry_table -- Initializes the directory table where all inode properties
@@ -8,8 +18,10 @@
  * dir_table: directory table in memory
 */
 void init_dir_entry_table(dirent_t* dir_table) {
-    for (int i = 1; i < DIR_ENTRY_SIZE; i++)
+    for (int i = 1; i < DIR_ENTRY_SIZE; i++) {
+        memset(dir_table[i].filename, 0, sizeof(dir_table[i].filename));
         dir_table[i].inode = -1;
+    }
 
     write_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE, DIR_BLOCK_SIZE, dir_table);
 }
@@ -23,10 +35,8 @@ void init_dir_entry_table(dirent_t* dir_table) {
  * returns the inode index
 */
 int find_inode_with_filename(char *name, dirent_t* dir_table) {
-    for (int i = 0; i < DIR_ENTRY_SIZE; i++)
-        if (strcmp(dir_table[i].filename, name) == 0)
-            return dir_table[i].inode;
-    return -1;
+    int i = find_dir_index(name, dir_table);
+    return i < 0 ? -1 : dir_table[i].inode;
 }
 
 /**
@@ -38,10 +48,8 @@ int find_inode_with_filename(char *name, dirent_t* dir_table) {
  * returns the inode index
 */
 int find_inode_with_path(const char *name, dirent_t* dir_table) {
-    for (int i = 0; i < DIR_ENTRY_SIZE; i++)
-        if (strcmp(dir_table[i].filename, name) == 0)
-            return dir_table[i].inode;
-    return -1;
+    int i = find_dir_index(name, dir_table);
+    return i < 0 ? -1 : dir_table[i].inode;
 }
 
 /**
@@ -52,9 +60,7 @@ int find_inode_with_path(const char *name, dirent_t* dir_table) {
  * returns the directory entry index
 */
 int find_free_entry(dirent_t* dir_table) {
-    for (int i = 0; i < DIR_ENTRY_SIZE; i++)
-        if (dir_table[i].inode == -1) return i;
-    return -1;
+    return scan_int32(dir_table, DIR_ENTRY_SIZE, sizeof(dirent_t), offsetof(dirent_t, inode), -1);
 }
 
 /**
@@ -68,7 +74,7 @@ int find_free_entry(dirent_t* dir_table) {
 void insert_dir_entry(dirent_t* dir_table, int index, char *name, int inode) {
     if (index < 0) return;
 
-    strcpy(dir_table[index].filename, name);
+    strncpy(dir_table[index].filename, name, sizeof(dir_table[index].filename));
     dir_table[index].inode = inode;
 }
 
@@ -81,29 +87,76 @@ void insert_dir_entry(dirent_t* dir_table, int index, char *name, int inode) {
  * returns directory entry index
 */
 int remove_dir_entry_mem(dirent_t* dir_table, char *name) {
-    for (int i = 0; i < DIR_ENTRY_SIZE; i++) {
-        if (strcmp(dir_table[i].filename, name) == 0) {
-            strcpy(dir_table[i].filename, "");
-            dir_table[i].inode = -1;
-            return i;
-        }
-    }
-    return -1;
+    int i = find_dir_index(name, dir_table);
+    if (i < 0) return -1;
+
+    memset(dir_table[i].filename, 0, sizeof(dir_table[i].filename));
+    dir_table[i].inode = -1;
+    return i;
 }
 
 /**
- * remove_dir_entry_disk -- Removes the directory entry on the disk.
+ * write_dir_entry -- Writes the block of the directory table that holds the requested
+ *                    directory entry to the disk. In a batch, the block is only written
+ *                    once when the batch is committed.
  * 
+ * dir_table: directory table in memory
  * dir_block_index: block index of the directory entry
  * dir_index: index of the directory entry
 */
-void remove_dir_entry_disk(int dir_block_index, int dir_index) {
-    block_t block;
-    read_blocks(dir_block_index, 1, &block);
-
-    dirent_t *dir = (dirent_t *) &block;
-    memset(dir[dir_index % DIR_PER_BLOCK].filename, 0, DIR_PER_BLOCK - sizeof(int));
-    dir[dir_index % DIR_PER_BLOCK].inode = -1;
-    
-    write_blocks(dir_block_index, 1, &block);
-}
\ No newline at end of file
+void write_dir_entry(dirent_t* dir_table, int dir_block_index, int dir_index) {
+    int block_index = dir_index / DIR_PER_BLOCK;
+
+    if (dir_batch) {
+        dir_dirty[block_index] = dir_block_index;
+        return;
+    }
+    write_blocks(dir_block_index, 1, &dir_table[block_index * DIR_PER_BLOCK]);
+}
+
+/**
+ * begin_dir_batch -- Starts a batch where the blocks of the directory table are
+ *                    written when the batch is committed.
+*/
+void begin_dir_batch() {
+    dir_batch = true;
+    free(dir_dirty);
+    dir_dirty = (int *) malloc(DIR_BLOCK_SIZE * sizeof(int));
+    for (int i = 0; i < DIR_BLOCK_SIZE; i++)
+        dir_dirty[i] = -1;
+}
+
+/**
+ * commit_dir_batch -- Writes each block of the directory table changed during the batch.
+ * 
+ * dir_table: directory table in memory
+*/
+void commit_dir_batch(dirent_t* dir_table) {
+    dir_batch = false;
+    for (int i = 0; i < DIR_BLOCK_SIZE; i++) {
+        if (dir_dirty[i] < 0) continue;
+        write_blocks(dir_dirty[i], 1, &dir_table[i * DIR_PER_BLOCK]);
+    }
+    free(dir_dirty);
+    dir_dirty = NULL;
+}
+
+/**
+ * find_dir_index -- Finds the directory entry of a filename. The filename and its terminating
+ *                   0 are compared to each entry at once by scan_entries, unless it is too long
+ *                   to be held by an entry.
+ * 
+ * name: filename
+ * dir_table: directory table in memory
+ * 
+ * returns the directory entry index or -1 if it cannot be found
+*/
+int find_dir_index(const char *name, dirent_t* dir_table) {
+    size_t length = strlen(name) + 1;
+    if (length <= sizeof(dir_table[0].filename))
+        return scan_entries(dir_table, DIR_ENTRY_SIZE, sizeof(dirent_t), name, length);
+
+    for (int i = 0; i < DIR_ENTRY_SIZE; i++)
+        if (strcmp(dir_table[i].filename, name) == 0) return i;
+    return -1;
+}
@@ -1,6 +1,10 @@
+#ifndef DIRECTORY_H
+#define DIRECTORY_H
+
 #include "disk_emu.h"
 #include "constant.h"
 #include "block.h"
+#include <stdbool.h>
 
 #define ENTRY_SIZE 32
 
@@ -67,9 +71,27 @@ void insert_dir_entry(dirent_t* dir_table, int index, char *name, int inode);
 int remove_dir_entry_mem(dirent_t* dir_table, char *name);
 
 /**
- * remove_dir_entry_disk -- Removes the directory entry on the disk.
+ * write_dir_entry -- Writes the block of the directory table that holds the requested
+ *                    directory entry to the disk. In a batch, the block is only written
+ *                    once when the batch is committed.
  * 
+ * dir_table: directory table in memory
  * dir_block_index: block index of the directory entry
  * dir_index: index of the directory entry
 */
-void remove_dir_entry_disk(int dir_block_index, int dir_index);
\ No newline at end of file
+void write_dir_entry(dirent_t* dir_table, int dir_block_index, int dir_index);
+
+/**
+ * begin_dir_batch -- Starts a batch where the blocks of the directory table are
+ *                    written when the batch is committed.
+*/
+void begin_dir_batch();
+
+/**
+ * commit_dir_batch -- Writes each block of the directory table changed during the batch.
+ * 
+ * dir_table: directory table in memory
+*/
+void commit_dir_batch(dirent_t* dir_table);
+
+#endif
\ No newline at end of file
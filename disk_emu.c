@@ -1,143 +1,120 @@
 #include <stdio.h>
 #include <stdlib.h> 
 #include <string.h>
+#include <inttypes.h>
 #include <unistd.h>
-#include <time.h>
 #include "disk_emu.h"
+#include "block_device.h"
 
 
-FILE* fp = NULL;
-double L, p;
-double r;
-int BLOCK_SIZE, MAX_BLOCK, MAX_RETRY;
+/*Latency of a block write in microseconds*/
+double L;
 
 /*----------------------------------------------------------*/
 /*Close the disk file filled when you don't need it anymore. */
 /*----------------------------------------------------------*/
 int close_disk()
 {
-    if(NULL != fp)
-    {
-        fclose(fp);
-    }
+    close_block_device();
     return 0;
 }
 
 /*---------------------------------------*/
 /*Initializes a disk file filled with 0's*/
 /*---------------------------------------*/
-int init_fresh_disk(char *filename, int block_size, int num_blocks)
+int init_fresh_disk(char *filename, int block_size, int64_t num_blocks)
 {
-    int i, j;
-
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
-    
-    /*Initializes the random number generator*/
-    srand((unsigned int)(time( 0 )) );
     /*Creates a new file*/
-    fp = fopen (filename, "w+b");
-
-    if (fp == NULL)
+    if (set_block_device(open_file_device(filename, block_size, num_blocks, true)) < 0)
     {
         printf("Could not create new disk file %s\n\n", filename);
         return -1;
     }
-    
-    /*Fills the file with 0's to its given size*/
-    for (i = 0; i < MAX_BLOCK; i++)
-    {
-        for (j = 0; j < BLOCK_SIZE; j++)
-        {
-            fputc(0, fp);
-        }
-    }
     return 0;
 }
 /*----------------------------*/
 /*Initializes an existing disk*/
 /*----------------------------*/
-int init_disk(char *filename, int block_size, int num_blocks)
+int init_disk(char *filename, int block_size, int64_t num_blocks)
 {
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
-    
     /*Opens a file*/
-    fp = fopen (filename, "r+b");
+    return set_block_device(open_file_device(filename, block_size, num_blocks, false));
+}
+
+/*-------------------------------------------------------------------*/
+/*Checks that the data requested is within the range of addresses of */
+/*the disk and returns the device that holds it                      */
+/*-------------------------------------------------------------------*/
+block_device_t* check_blocks(int64_t start_address, int nblocks)
+{
+    block_device_t *device = get_block_device();
 
-    if (fp == NULL)
+    if (device == NULL || start_address < 0 || nblocks < 0 || start_address + nblocks > device -> num_blocks)
     {
-        printf("Could not open %s\n\n", filename);
-        return -1;
+        printf("out of bound error %" PRId64 "\n", start_address);
+        return NULL;
     }
-    return 0;
+    return device;
 }
 
 /*-------------------------------------------------------------------*/
 /*Reads a series of blocks from the disk into the buffer             */
 /*-------------------------------------------------------------------*/
-int read_blocks(int start_address, int nblocks, void *buffer)
+int read_blocks(int64_t start_address, int nblocks, void *buffer)
 {
-    int i, s;
-    s = 0;
-
-    /*Sets up a temporary buffer*/
-    void* blockRead = (void*) malloc(BLOCK_SIZE);
+    block_device_t *device = check_blocks(start_address, nblocks);
 
-    /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (device == NULL)
     {
-        printf("out of bound error %d\n", start_address);
         return -1;
     }
+    return device -> read(device, start_address, nblocks, buffer);
+}
 
-    /*Goto the data requested from the disk*/
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+/*------------------------------------------------------------------*/
+/*Writes a series of blocks to the disk from the buffer             */
+/*------------------------------------------------------------------*/
+int write_blocks(int64_t start_address, int nblocks, void *buffer)
+{
+    block_device_t *device = check_blocks(start_address, nblocks);
 
-    /*For every block requested*/
-    for (i = 0; i < nblocks; ++i)
+    if (device == NULL)
     {
-        s++;
-        fread(blockRead, BLOCK_SIZE, 1, fp);
-        memcpy((char *)buffer+(i*BLOCK_SIZE), blockRead, BLOCK_SIZE);  
+        return -1;
     }
 
-    free(blockRead);
-    return s;
+    /*Pause until the latency duration of every block requested is elapsed*/
+    if (L > 0)
+    {
+        usleep(L * nblocks);
+    }
+    return device -> write(device, start_address, nblocks, buffer);
 }
 
 /*------------------------------------------------------------------*/
-/*Writes a series of blocks to the disk from the buffer             */
+/*Flushes the blocks written to the disk to the storage             */
 /*------------------------------------------------------------------*/
-int write_blocks(int start_address, int nblocks, void *buffer)
+int flush_blocks()
 {
-    int i, s;
-    s = 0;
-
-    void* blockWrite = (void*) malloc(BLOCK_SIZE);
+    block_device_t *device = get_block_device();
 
-    /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (device == NULL)
     {
-        printf("out of bound error\n");
         return -1;
     }
+    return device -> flush(device);
+}
 
-    /*Goto where the data is to be written on the disk*/        
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
+/*------------------------------------------------------------------*/
+/*Discards a series of blocks, which are then read as 0's           */
+/*------------------------------------------------------------------*/
+int discard_blocks(int64_t start_address, int nblocks)
+{
+    block_device_t *device = check_blocks(start_address, nblocks);
 
-    /*For every block requested*/        
-    for (i = 0; i < nblocks; ++i)
+    if (device == NULL)
     {
-        /*Pause until the latency duration is elapsed*/
-        usleep(L);
-
-        memcpy(blockWrite, (char *)buffer+(i*BLOCK_SIZE), BLOCK_SIZE);
-
-        fwrite(blockWrite, BLOCK_SIZE, 1, fp);
-        fflush(fp);
-        s++;
+        return -1;
     }
-    free(blockWrite);
-    return s;
+    return device -> discard(device, start_address, nblocks);
 }
@@ -1,5 +1,9 @@
-int init_fresh_disk(char *filename, int block_size, int num_blocks);
-int init_disk(char *filename, int block_size, int num_blocks);
-int read_blocks(int start_address, int nblocks, void *buffer);
-int write_blocks(int start_address, int nblocks, void *buffer);
+#include <stdint.h>
+
+int init_fresh_disk(char *filename, int block_size, int64_t num_blocks);
+int init_disk(char *filename, int block_size, int64_t num_blocks);
+int read_blocks(int64_t start_address, int nblocks, void *buffer);
+int write_blocks(int64_t start_address, int nblocks, void *buffer);
+int flush_blocks();
+int discard_blocks(int64_t start_address, int nblocks);
 int close_disk();
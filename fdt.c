@@ -1,4 +1,9 @@
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "sfs_api.h"
 #include "fdt.h"
+#include "scan.h"
 
 /**
  * init_fdt -- Initializes the file descriptor table, and
@@ -9,8 +14,14 @@
  * fdt: file descriptor table in memory
 */
 void init_fdt(fdt_t* fdt) {
-    for (int i = 0; i < FDT_SIZE; i++)
+    for (int i = 0; i < FDT_SIZE; i++) {
         fdt[i].inum = -1;
+        fdt[i].tail_pointer = -1;
+        fdt[i].tail = NULL;
+        fdt[i].buffer = NULL;
+        fdt[i].prealloc.id = i + 1;
+        fdt[i].prealloc.next = fdt[i].prealloc.end = -1;
+    }
 }
 
 /**
@@ -19,9 +30,7 @@ void init_fdt(fdt_t* fdt) {
  * fdt: file descriptor table in memory.
 */
 int find_free_fdt_entry(fdt_t* fdt) {
-    for (int i = 0; i < FDT_SIZE; i++)
-        if (fdt[i].inum == -1) return i;
-    return -1;
+    return scan_int32(fdt, FDT_SIZE, sizeof(fdt_t), offsetof(fdt_t, inum), -1);
 }
 
 /**
@@ -33,11 +42,21 @@ int find_free_fdt_entry(fdt_t* fdt) {
  * inode: INode of the entry
  * offset: read/write pointer of the entry
 */
-void insert_fdt_entry(fdt_t* fdt, int index, int inode, int offset) {
+void insert_fdt_entry(fdt_t* fdt, int index, int inode, int64_t offset) {
     if (index < 0) return;
 
     fdt[index].inum = inode;
     fdt[index].foffset = offset;
+    fdt[index].compress_start = -1;
+    fdt[index].compress_end = -1;
+    fdt[index].map_pointer = -1;
+    fdt[index].tail_pointer = -1;
+    fdt[index].tail_dirty = false;
+    fdt[index].buffer_mode = SFS_BUFFER_NONE;
+    fdt[index].buffer_size = 0;
+    fdt[index].buffer = NULL;
+    fdt[index].prealloc.id = index + 1;
+    fdt[index].prealloc.next = fdt[index].prealloc.end = -1;
 }
 
 /**
@@ -50,7 +69,7 @@ void insert_fdt_entry(fdt_t* fdt, int index, int inode, int offset) {
  * 
  * returns 0 or -1 to show if the action was successful
 */
-int seek_fdt_entry(fdt_t* fdt, int index, int loc) {
+int seek_fdt_entry(fdt_t* fdt, int index, int64_t loc) {
     if (index < 0) return -1;
     fdt[index].foffset = loc;
     return 0;
@@ -1,8 +1,41 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include "block.h"
+#include "free_bitmap.h"
+
 #define FDT_SIZE 320
 
+/**
+ * _fdt_t -- compress_start and compress_end are the first and last compression
+ *           clusters written through the entry (-1 if none has been written).
+ *           map_pointer is the last pointer resolved through the entry (-1 if none),
+ *           valid while the pointer changes counted by the INode table are map_changes.
+ *           tail holds the block of tail_pointer (-1 if none), where the small writes
+ *           through the entry are gathered until the block is written.
+ *           buffer holds the buffer_length bytes written at buffer_offset through an entry
+ *           set up by sfs_setvbuf (NULL if none), which have been buffered at buffer_time.
+ *           prealloc is the preallocation window of the blocks written through the entry,
+ *           which is released when the entry is closed.
+*/
 typedef struct _fdt_t {
     int inum;
-    int foffset;
+    int64_t foffset;
+    int64_t compress_start;
+    int64_t compress_end;
+    int64_t map_pointer;
+    block_addr_t map_block;
+    int64_t map_changes;
+    int64_t tail_pointer;
+    block_addr_t tail_block;
+    bool tail_dirty;
+    char *tail;
+    int buffer_mode;
+    int buffer_size;
+    char *buffer;
+    int64_t buffer_offset;
+    int buffer_length;
+    int64_t buffer_time;
+    prealloc_t prealloc;
 } fdt_t;
 
 /**
@@ -31,7 +64,7 @@ int find_free_fdt_entry(fdt_t* fdt);
  * inode: INode of the entry
  * offset: read/write pointer of the entry
 */
-void insert_fdt_entry(fdt_t* fdt, int index, int inode, int offset);
+void insert_fdt_entry(fdt_t* fdt, int index, int inode, int64_t offset);
 
 /**
  * seek_fdt_entry -- Changes the location of the read/write pointer of the
@@ -43,7 +76,7 @@ void insert_fdt_entry(fdt_t* fdt, int index, int inode, int offset);
  * 
  * returns 0 or -1 to show if the action was successful
 */
-int seek_fdt_entry(fdt_t* fdt, int index, int loc);
+int seek_fdt_entry(fdt_t* fdt, int index, int64_t loc);
 
 /**
  * close_fdt_entry -- Closes the file descriptor entry.
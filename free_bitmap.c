@@ -1,50 +1,706 @@
 #include "free_bitmap.h"
+#include "super_block.h"
+#include "scan.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FBM_START (SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE)
+#define DATA_START (SUPERBLOCK_SIZE + INODE_TABLE_SIZE)
+#define DATA_END (SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE)
+
+/* In-Memory Free Bitmap, sized by the geometry of the disk */
+THREAD_LOCAL uint8_t *fbm_cache = NULL;
+
+/* No data block before it is available, so the search does not start over from the first block */
+THREAD_LOCAL block_addr_t fbm_next_free = 0;
+
+/* Blocks that have become free in discard mode */
+THREAD_LOCAL bool discard_mode = false;
+THREAD_LOCAL bool *discard_pending = NULL;
+
+/* Blocks of the free bitmap changed during a batch */
+THREAD_LOCAL bool fbm_batch = false;
+THREAD_LOCAL int fbm_dirty_first = 0, fbm_dirty_last = -1;
+
+/* Blocks freed during a batch, which are not used again until the batch is committed */
+THREAD_LOCAL bool *fbm_released = NULL;
+THREAD_LOCAL block_addr_t fbm_released_first = 0, fbm_released_last = -1;
+THREAD_LOCAL int64_t fbm_released_count = 0;
+
+/* Log mode, where the new blocks are taken in order from the head of the log */
+THREAD_LOCAL bool fbm_log_mode = false;
+THREAD_LOCAL block_addr_t log_head = 0, log_end = 0;
+THREAD_LOCAL int log_segments = 0, clean_segment_count = 0;
+THREAD_LOCAL int *segment_live = NULL;               /* Used blocks of each segment */
+THREAD_LOCAL int64_t *segment_stamp = NULL;          /* Log clock when a block of each segment was last used */
+THREAD_LOCAL int64_t log_clock = 0;                  /* Number of segments opened by the head of the log */
+
+/* Allocation groups and preallocation windows */
+THREAD_LOCAL int64_t *group_free = NULL;             /* Free blocks of each allocation group */
+THREAD_LOCAL uint16_t *fbm_reserved = NULL;          /* Window that has reserved each block, 0 if none */
+THREAD_LOCAL prealloc_t *fbm_window = NULL;          /* Window used by find_free_block */
+
+/* Helper Functions */
+void write_fbm_entry(block_addr_t index);
+void write_fbm_blocks(int first, int last);
+void alloc_fbm();
+void use_free_run(block_addr_t start, int64_t count);
+void count_block_change(block_addr_t index, bool freed);
+void count_segment_change(block_addr_t index, bool freed);
+void count_segments();
+bool open_log_segment();
+bool is_available(block_addr_t index, int owner);
+block_addr_t next_available(block_addr_t from, block_addr_t to, int owner);
+block_addr_t take_window_block(prealloc_t* window);
+void use_free_block(block_addr_t index);
 
 /**
- * init_fbm -- Initializes all 1500 bit to 1 to represent all 1500 data blocks are available.
- *             The first 11 blocks are taken by the (1) super block and (10) INode table.
+ * init_fbm -- Initializes all data blocks to 0 references to represent that they are available.
+ *             The blocks of the super block, the INode table, the directory and the free bitmap
+ *             are always taken.
 */
 void init_fbm() {
-    block_t block[FREE_BITMAP_SIZE];
-    uint8_t *free_bitmap = (uint8_t *) block; 
+    alloc_fbm();
+    uint8_t *free_bitmap = fbm_cache;
+
+    /* The blocks outside of the data blocks are never available */
+    for (int64_t i = 0; i < (int64_t) FREE_BITMAP_SIZE * BLOCK_SIZE; i++)
+        if (i < DATA_START || i >= DATA_END)
+            free_bitmap[i] = 1;
+
+    write_blocks(FBM_START, FREE_BITMAP_SIZE, fbm_cache);
+    count_segments();
+}
+
+/**
+ * set_fbm -- Initializes the free bitmap in memory with the free bitmap on the disk.
+*/
+void set_fbm() {
+    alloc_fbm();
+    read_blocks(FBM_START, FREE_BITMAP_SIZE, fbm_cache);
+    count_segments();
+}
 
-    for (int i = SUPERBLOCK_SIZE + INODE_TABLE_SIZE; i < SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE; i++)
-        free_bitmap[i] = 1;
-    
-    write_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE, FREE_BITMAP_SIZE, &free_bitmap);
+/**
+ * free_fbm -- Frees the free bitmap in memory and the records kept for its blocks.
+*/
+void free_fbm() {
+    free(fbm_cache);
+    free(discard_pending);
+    free(fbm_released);
+    free(segment_live);
+    free(segment_stamp);
+    free(group_free);
+    free(fbm_reserved);
+    fbm_cache = NULL;
+    discard_pending = fbm_released = NULL;
+    segment_live = NULL;
+    segment_stamp = NULL;
+    group_free = NULL;
+    fbm_reserved = NULL;
+    fbm_window = NULL;
 }
 
 /**
- * find_free_block -- Finds the first available block that can be used, and sets it to used.
+ * find_free_block -- Finds the first available block that can be used, and sets it to used
+ *                    with a single reference. In log mode, the block is taken from the head
+ *                    of the log, unless no segment is clean. Otherwise the block is taken
+ *                    from the preallocation window set by set_prealloc_window, if any.
  * 
  * returns the index of the data block
 */
-int find_free_block() {
-    int index = -1;
-    block_t block[FREE_BITMAP_SIZE];
-    read_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE, FREE_BITMAP_SIZE, &block);
-
-    for (int i = SUPERBLOCK_SIZE + INODE_TABLE_SIZE; i < SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE; i++) {
-        if (((uint8_t *) &block)[i] == 1) {
-            /* Set the bit to 0 since the block at i will be used */
-            ((uint8_t *) &block)[i] = 0;
-            index = i;
-            break;
+block_addr_t find_free_block() {
+    if (fbm_log_mode) {
+        block_addr_t block_index = find_log_block();
+        if (block_index >= 0) return block_index;
+    } else if (fbm_window != NULL) {
+        block_addr_t block_index = take_window_block(fbm_window);
+        if (block_index >= 0) return block_index;
+    }
+
+    block_addr_t i = next_available(fbm_next_free, DATA_END, 0);
+    if (i >= 0) {
+        fbm_next_free = i + 1;
+    } else {
+        /* The blocks reserved by the windows are only taken once no other block is available */
+        fbm_next_free = DATA_END;
+        i = next_available(DATA_START, DATA_END, -1);
+        if (i < 0) return -1;
+    }
+
+    use_free_block(i);
+    return i;
+}
+
+/**
+ * set_prealloc_window -- Sets the preallocation window that find_free_block takes the blocks
+ *                        from. Once the window has no block left, it reserves the next run of
+ *                        available blocks after its last block.
+ * 
+ * window: preallocation window of the file being written, or NULL for the first available block
+*/
+void set_prealloc_window(prealloc_t* window) {
+    fbm_window = window;
+}
+
+/**
+ * release_prealloc_window -- Releases the blocks reserved by a preallocation window that
+ *                            have not been used, and empties the window.
+ * 
+ * window: preallocation window
+*/
+void release_prealloc_window(prealloc_t* window) {
+    for (block_addr_t i = window -> next; i < window -> end; i++) {
+        if (fbm_reserved[i] != window -> id) continue;
+        fbm_reserved[i] = 0;
+        if (i < fbm_next_free) fbm_next_free = i;
+    }
+    window -> next = window -> end = -1;
+    if (fbm_window == window) fbm_window = NULL;
+}
+
+/**
+ * find_log_block -- Takes the next available block at the head of the log, and sets it to used
+ *                   with a single reference. Once its segment is full, the head moves to the
+ *                   next clean segment.
+ * 
+ * returns the index of the data block or -1 if no segment is clean
+*/
+block_addr_t find_log_block() {
+    do {
+        for (; log_head < log_end; log_head++) {
+            if (!is_available(log_head, 0)) continue;
+
+            use_free_block(log_head);
+            return log_head++;
         }
+    } while (open_log_segment());
+
+    return -1;
+}
+
+/**
+ * find_free_run -- Finds the first run of contiguous available blocks of the requested length,
+ *                  and sets each of them to used with a single reference.
+ * 
+ * count: number of blocks of the run
+ * 
+ * returns the index of the first data block or -1 if no run is long enough
+*/
+block_addr_t find_free_run(int64_t count) {
+    if (count <= 0) return -1;
+
+    for (block_addr_t i = fbm_next_free; i + count <= DATA_END;) {
+        /* A run can only start at a block without references */
+        if ((i = scan_zero_byte(fbm_cache, i, DATA_END - count + 1)) < 0) break;
+        int64_t run = 0;
+        while (run < count && is_available(i + run, 0)) run++;
+        if (run == count) {
+            use_free_run(i, count);
+            return i;
+        }
+        /* The next run cannot start before the block that is in use */
+        i += run + 1;
     }
-    write_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE, FREE_BITMAP_SIZE, &block);
-    return index;
+    return -1;
+}
+
+/**
+ * take_free_run -- Sets a run of contiguous blocks to used with a single reference if each
+ *                  of them is available.
+ * 
+ * start: index of the first data block
+ * count: number of blocks of the run
+ * 
+ * returns 0 or -1 if a block of the run is not available
+*/
+int take_free_run(block_addr_t start, int64_t count) {
+    if (count <= 0 || start < DATA_START || start + count > DATA_END) return -1;
+
+    for (int64_t i = 0; i < count; i++)
+        if (!is_available(start + i, 0)) return -1;
+
+    use_free_run(start, count);
+    return 0;
 }
 
 /**
- * reset_free_block -- Resets the requested block to a free available block.
+ * reset_free_block -- Releases one reference of the requested block. The block becomes a free
+ *                     available block once it has no reference left.
  * 
  * index: index of the data block
 */
-void reset_free_block(int index) {
-    block_t block[FREE_BITMAP_SIZE];
-    read_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE, FREE_BITMAP_SIZE, &block);
-    ((uint8_t *) &block)[index] = 1;
+void reset_free_block(block_addr_t index) {
+    reset_free_blocks(&index, 1);
+}
+
+/**
+ * reset_free_blocks -- Releases one reference of each requested block with a single
+ *                      write of the blocks of the free bitmap that have been changed.
+ * 
+ * indices: indices of the data blocks
+ * count: number of data blocks
+*/
+void reset_free_blocks(block_addr_t* indices, int64_t count) {
+    uint8_t *free_bitmap = fbm_cache;
+    int first = FREE_BITMAP_SIZE, last = -1;
+
+    for (int64_t i = 0; i < count; i++) {
+        block_addr_t index = indices[i];
+        if (free_bitmap[index] == 0) continue;
+
+        free_bitmap[index]--;
+        if (free_bitmap[index] == 0) {
+            count_block_change(index, true);
+            if (discard_mode) discard_pending[index] = true;
+            if (fbm_batch) {
+                /* The old metadata on the disk may still refer to it until the batch is committed */
+                fbm_released[index] = true;
+                fbm_released_count++;
+                if (index < fbm_released_first) fbm_released_first = index;
+                if (index > fbm_released_last) fbm_released_last = index;
+            } else {
+                count_segment_change(index, true);
+            }
+            if (index < fbm_next_free) fbm_next_free = index;
+        }
+
+        if (index / BLOCK_SIZE < first) first = index / BLOCK_SIZE;
+        if (index / BLOCK_SIZE > last) last = index / BLOCK_SIZE;
+    }
+
+    if (last >= 0) write_fbm_blocks(first, last);
+}
+
+/**
+ * count_free_blocks -- Counts the free data blocks and the runs of free data blocks
+ *                      of the free bitmap in memory.
+ * 
+ * counters: counters where the free blocks and the runs are set
+*/
+void count_free_blocks(counters_t* counters) {
+    counters -> free_blocks = 0;
+    counters -> free_extents = 0;
+
+    for (block_addr_t i = DATA_START; i < DATA_END; i++) {
+        if (fbm_cache[i] != 0) continue;
+        counters -> free_blocks++;
+        if (fbm_cache[i - 1] != 0) counters -> free_extents++;
+    }
+}
+
+/**
+ * set_discard_mode -- Sets if the blocks that become free are recorded so that
+ *                     they are cleared by discard_free_blocks.
+ * 
+ * enable: record the freed blocks (true) or not (false)
+*/
+void set_discard_mode(bool enable) {
+    discard_mode = enable;
+}
+
+/**
+ * discard_free_blocks -- Discards the recorded blocks that are still free, where each
+ *                        run of contiguous blocks is discarded with a single request.
+ * 
+ * returns the number of blocks that have been cleared
+*/
+int discard_free_blocks() {
+    uint8_t *free_bitmap = fbm_cache;
+    int discarded = 0;
+
+    for (block_addr_t i = DATA_START; i < DATA_END;) {
+        /* A recorded block that has been used again is not cleared */
+        if (!discard_pending[i] || free_bitmap[i] != 0) {
+            discard_pending[i] = false;
+            i++;
+            continue;
+        }
+
+        int run = 1;
+        while (i + run < DATA_END && run < INT32_MAX &&
+            discard_pending[i + run] && free_bitmap[i + run] == 0) run++;
+
+        discard_blocks(i, run);
+
+        for (block_addr_t j = i; j < i + run; j++)
+            discard_pending[j] = false;
+        discarded += run;
+        i += run;
+    }
+
+    return discarded;
+}
+
+/**
+ * ref_block -- Adds a reference to the requested block so that it is shared.
+ * 
+ * index: index of the data block
+ * 
+ * returns 0 or -1 if the block cannot have more references
+*/
+int ref_block(block_addr_t index) {
+    uint8_t *free_bitmap = fbm_cache;
+    if (free_bitmap[index] == 0 || free_bitmap[index] == BLOCK_MAX_REFS) return -1;
+
+    free_bitmap[index]++;
+    write_fbm_entry(index);
+    return 0;
+}
+
+/**
+ * get_block_refs -- Gets the number of references of the requested block.
+ * 
+ * index: index of the data block
+ * 
+ * returns the number of references
+*/
+int get_block_refs(block_addr_t index) {
+    return fbm_cache[index];
+}
+
+/**
+ * set_log_mode -- Sets if the new blocks are taken in order from the head of the log, which
+ *                 only moves to segments that are entirely free.
+ * 
+ * enable: use the log (true) or the first available block (false)
+*/
+void set_log_mode(bool enable) {
+    fbm_log_mode = enable;
+}
+
+/**
+ * get_clean_segments -- Gets the number of segments where no block is used.
+ * 
+ * returns the number of clean segments
+*/
+int get_clean_segments() {
+    return clean_segment_count;
+}
 
-    write_blocks(SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE, FREE_BITMAP_SIZE, &block);
-}
\ No newline at end of file
+/**
+ * get_log_clock -- Gets the number of segments the head of the log has moved to, which
+ *                  measures the age of the segments.
+ * 
+ * returns the log clock
+*/
+int64_t get_log_clock() {
+    return log_clock;
+}
+
+/**
+ * get_released_blocks -- Gets the number of blocks freed during the batch, which can only
+ *                        be used again once the batch is committed.
+ * 
+ * returns the number of blocks
+*/
+int64_t get_released_blocks() {
+    return fbm_released_count;
+}
+
+/**
+ * choose_segments -- Chooses the segments that are worth cleaning with the cost-benefit policy,
+ *                    where a segment is ranked by (1 - u) * age / (1 + u) with u the part of
+ *                    its blocks that are used. Cleaning a segment reads it and writes its used
+ *                    blocks, and an old segment is less likely to lose more blocks soon. The
+ *                    segments that are clean, full or at the head of the log are not chosen.
+ * 
+ * max_segments: maximum number of segments chosen
+ * starts: where the index of the first block of each chosen segment is copied to
+ * 
+ * returns the number of segments chosen, from the best to the worst
+*/
+int choose_segments(int max_segments, block_addr_t* starts) {
+    int head = log_end > log_head ? (log_end - 1 - DATA_START) / LOG_SEGMENT_BLOCKS : -1;
+    int chosen = 0;
+
+    while (chosen < max_segments) {
+        int best = -1;
+        double best_score = 0;
+
+        for (int segment = 0; segment < log_segments; segment++) {
+            int live = segment_live[segment];
+            if (segment == head || live == 0 || live == LOG_SEGMENT_BLOCKS) continue;
+
+            block_addr_t start = DATA_START + (block_addr_t) segment * LOG_SEGMENT_BLOCKS;
+            bool taken = false;
+            for (int i = 0; i < chosen && !taken; i++) taken = starts[i] == start;
+            if (taken) continue;
+
+            double used = (double) live / LOG_SEGMENT_BLOCKS;
+            double score = (1 - used) * (log_clock - segment_stamp[segment] + 1) / (1 + used);
+            if (score > best_score) {
+                best = segment;
+                best_score = score;
+            }
+        }
+        if (best < 0) break;
+        starts[chosen++] = DATA_START + (block_addr_t) best * LOG_SEGMENT_BLOCKS;
+    }
+
+    return chosen;
+}
+
+/**
+ * begin_fbm_batch -- Starts a batch where the blocks of the free bitmap are
+ *                    written when the batch is committed.
+*/
+void begin_fbm_batch() {
+    fbm_batch = true;
+    fbm_dirty_first = FREE_BITMAP_SIZE;
+    fbm_dirty_last = -1;
+    fbm_released_first = DATA_END;
+    fbm_released_last = -1;
+}
+
+/**
+ * commit_fbm_batch -- Writes the blocks of the free bitmap changed during the batch.
+*/
+void commit_fbm_batch() {
+    fbm_batch = false;
+    if (fbm_dirty_last >= 0) write_fbm_blocks(fbm_dirty_first, fbm_dirty_last);
+
+    /* The blocks freed during the batch can be used again */
+    for (block_addr_t i = fbm_released_first; i <= fbm_released_last; i++) {
+        if (!fbm_released[i]) continue;
+        fbm_released[i] = false;
+        count_segment_change(i, true);
+    }
+    fbm_released_count = 0;
+}
+
+/**
+ * write_fbm_entry -- Writes the block of the free bitmap that holds the requested entry.
+ * 
+ * index: index of the data block
+*/
+void write_fbm_entry(block_addr_t index) {
+    write_fbm_blocks(index / BLOCK_SIZE, index / BLOCK_SIZE);
+}
+
+/**
+ * write_fbm_blocks -- Writes a range of blocks of the free bitmap with a single request.
+ *                     In a batch, the range is only written when the batch is committed.
+ * 
+ * first: index of the first block of the free bitmap
+ * last: index of the last block of the free bitmap
+*/
+void write_fbm_blocks(int first, int last) {
+    if (fbm_batch) {
+        if (first < fbm_dirty_first) fbm_dirty_first = first;
+        if (last > fbm_dirty_last) fbm_dirty_last = last;
+        return;
+    }
+    write_blocks(FBM_START + first, last - first + 1, &fbm_cache[(size_t) first * BLOCK_SIZE]);
+}
+
+/**
+ * alloc_fbm -- Allocates the free bitmap in memory and the discard records for the
+ *              geometry of the disk, where every block is recorded as used and not freed.
+*/
+void alloc_fbm() {
+    free(fbm_cache);
+    free(discard_pending);
+    free(fbm_released);
+    free(segment_live);
+    free(segment_stamp);
+    free(group_free);
+    free(fbm_reserved);
+    fbm_cache = (uint8_t *) calloc(FREE_BITMAP_SIZE, BLOCK_SIZE);
+    discard_pending = (bool *) calloc((size_t) FREE_BITMAP_SIZE * BLOCK_SIZE, sizeof(bool));
+    fbm_released = (bool *) calloc((size_t) FREE_BITMAP_SIZE * BLOCK_SIZE, sizeof(bool));
+    fbm_next_free = DATA_START;
+    fbm_released_count = 0;
+
+    /* The blocks after the last full segment are not part of the log */
+    log_segments = DATA_BLOCK_SIZE / LOG_SEGMENT_BLOCKS;
+    segment_live = (int *) calloc(log_segments + 1, sizeof(int));
+    segment_stamp = (int64_t *) calloc(log_segments + 1, sizeof(int64_t));
+    log_head = log_end = 0;
+    log_clock = 0;
+
+    group_free = (int64_t *) calloc(DATA_BLOCK_SIZE / FBM_GROUP_BLOCKS + 1, sizeof(int64_t));
+    fbm_reserved = (uint16_t *) calloc((size_t) FREE_BITMAP_SIZE * BLOCK_SIZE, sizeof(uint16_t));
+    fbm_window = NULL;
+}
+
+/**
+ * use_free_run -- Sets a run of available blocks to used with a single reference with a
+ *                 single write of the blocks of the free bitmap that hold them.
+ * 
+ * start: index of the first data block
+ * count: number of blocks of the run
+*/
+void use_free_run(block_addr_t start, int64_t count) {
+    for (int64_t i = 0; i < count; i++) {
+        fbm_cache[start + i] = 1;
+        count_block_change(start + i, false);
+    }
+    if (start == fbm_next_free) fbm_next_free = start + count;
+    write_fbm_blocks(start / BLOCK_SIZE, (start + count - 1) / BLOCK_SIZE);
+}
+
+/**
+ * count_block_change -- Updates the counters of the superblock and of the allocation group
+ *                       of a block once it has become free or used. A free block joins the
+ *                       runs of free blocks next to it. A used block is also counted in its segment.
+ * 
+ * index: index of the data block
+ * freed: the block has become free (true) or used (false)
+*/
+void count_block_change(block_addr_t index, bool freed) {
+    int neighbours = (fbm_cache[index - 1] == 0) + (fbm_cache[index + 1] == 0);
+    if (freed) update_counters(1, 1 - neighbours, 0);
+    else update_counters(-1, neighbours - 1, 0);
+    group_free[(index - DATA_START) / FBM_GROUP_BLOCKS] += freed ? 1 : -1;
+
+    if (!freed) count_segment_change(index, false);
+}
+
+/**
+ * count_segment_change -- Updates the used blocks of the segment of a block once the block
+ *                         has become used, or once it can be used again after it is freed.
+ * 
+ * index: index of the data block
+ * freed: the block can be used again (true) or has become used (false)
+*/
+void count_segment_change(block_addr_t index, bool freed) {
+    int64_t segment = (index - DATA_START) / LOG_SEGMENT_BLOCKS;
+    if (segment >= log_segments) return;
+    if (freed) {
+        if (--segment_live[segment] == 0) clean_segment_count++;
+    } else {
+        if (segment_live[segment]++ == 0) clean_segment_count--;
+        segment_stamp[segment] = log_clock;
+    }
+}
+
+/**
+ * count_segments -- Counts the used blocks of each segment, the clean segments and the
+ *                   free blocks of each allocation group from the free bitmap in memory.
+*/
+void count_segments() {
+    for (block_addr_t i = DATA_START; i < DATA_END; i++)
+        if (fbm_cache[i] == 0) group_free[(i - DATA_START) / FBM_GROUP_BLOCKS]++;
+
+    clean_segment_count = 0;
+    for (int segment = 0; segment < log_segments; segment++) {
+        block_addr_t start = DATA_START + (block_addr_t) segment * LOG_SEGMENT_BLOCKS;
+        segment_live[segment] = 0;
+        for (int i = 0; i < LOG_SEGMENT_BLOCKS; i++)
+            if (fbm_cache[start + i] != 0) segment_live[segment]++;
+        if (segment_live[segment] == 0) clean_segment_count++;
+    }
+}
+
+/**
+ * open_log_segment -- Moves the head of the log to the next clean segment after it, where no
+ *                     block is used. A block freed during a batch is counted as used until
+ *                     the batch is committed.
+ * 
+ * returns true or false if no segment is clean
+*/
+bool open_log_segment() {
+    int current = log_end > 0 ? (log_end - 1 - DATA_START) / LOG_SEGMENT_BLOCKS : log_segments - 1;
+
+    for (int i = 1; i <= log_segments; i++) {
+        int segment = (current + i) % log_segments;
+        if (segment_live[segment] != 0) continue;
+
+        block_addr_t start = DATA_START + (block_addr_t) segment * LOG_SEGMENT_BLOCKS;
+        log_head = start;
+        log_end = start + LOG_SEGMENT_BLOCKS;
+        log_clock++;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * is_available -- Checks if a block can be taken, where it has no reference and has not
+ *                 been freed during the batch.
+ * 
+ * index: index of the data block
+ * owner: id of the window whose reserved blocks can be taken, 0 for the blocks reserved by
+ *        no window or -1 for any block
+ * 
+ * returns true if the block can be taken
+*/
+bool is_available(block_addr_t index, int owner) {
+    return fbm_cache[index] == 0 && !fbm_released[index] && (owner < 0 || fbm_reserved[index] == owner);
+}
+
+/**
+ * next_available -- Finds the first block that can be taken within a range of data blocks,
+ *                   skipping the allocation groups without free blocks. Within a group, the
+ *                   blocks with references are skipped by scan_zero_byte.
+ * 
+ * from: index of the first data block of the range
+ * to: index after the last data block of the range
+ * owner: id of the window whose reserved blocks can be taken, 0 for the blocks reserved by
+ *        no window or -1 for any block
+ * 
+ * returns the index of the data block or -1 if none can be taken
+*/
+block_addr_t next_available(block_addr_t from, block_addr_t to, int owner) {
+    for (block_addr_t i = from; i < to;) {
+        int64_t group = (i - DATA_START) / FBM_GROUP_BLOCKS;
+        block_addr_t group_end = DATA_START + (group + 1) * FBM_GROUP_BLOCKS;
+        if (group_end > to) group_end = to;
+        if (group_free[group] == 0 || (i = scan_zero_byte(fbm_cache, i, group_end)) < 0) {
+            i = group_end;
+            continue;
+        }
+        if (is_available(i, owner)) return i;
+        i++;
+    }
+    return -1;
+}
+
+/**
+ * take_window_block -- Takes the next block reserved by a preallocation window. Once the
+ *                      window is empty, the run of available blocks that follows its last
+ *                      block, or else the first one after it, is reserved for the window.
+ * 
+ * window: preallocation window
+ * 
+ * returns the index of the data block or -1 if no block is available
+*/
+block_addr_t take_window_block(prealloc_t* window) {
+    /* A reserved block may have been taken since by another file once the disk was full */
+    while (window -> next >= 0 && window -> next < window -> end) {
+        block_addr_t index = window -> next++;
+        if (!is_available(index, window -> id)) continue;
+
+        use_free_block(index);
+        return index;
+    }
+
+    block_addr_t goal = window -> end >= DATA_START && window -> end < DATA_END ? window -> end : fbm_next_free;
+    block_addr_t start = next_available(goal, DATA_END, 0);
+    if (start < 0) start = next_available(DATA_START, goal, 0);
+    if (start < 0) return -1;
+
+    block_addr_t end = start + 1;
+    while (end < DATA_END && end - start < FBM_WINDOW_BLOCKS && is_available(end, 0))
+        fbm_reserved[end++] = window -> id;
+    window -> next = start + 1;
+    window -> end = end;
+
+    if (start == fbm_next_free) fbm_next_free = end;
+    use_free_block(start);
+    return start;
+}
+
+/**
+ * use_free_block -- Sets an available block to used with a single reference. A block reserved
+ *                   by a window is no longer reserved.
+ * 
+ * index: index of the data block
+*/
+void use_free_block(block_addr_t index) {
+    fbm_reserved[index] = 0;
+    fbm_cache[index] = 1;
+    count_block_change(index, false);
+    write_fbm_entry(index);
+}
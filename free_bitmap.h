@@ -1,25 +1,243 @@
+#ifndef FREE_BITMAP_H
+#define FREE_BITMAP_H
+
 #include <stdint.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include "disk_emu.h"
 #include "constant.h"
 #include "block.h"
+#include "super_block.h"
+
+/* Maximum number of references a block can have */
+#define BLOCK_MAX_REFS UINT8_MAX
+
+/* Number of contiguous data blocks of a segment of the log */
+#define LOG_SEGMENT_BLOCKS 32
+
+/* Number of contiguous data blocks of an allocation group */
+#define FBM_GROUP_BLOCKS 1024
+
+/* Number of contiguous data blocks reserved by a preallocation window */
+#define FBM_WINDOW_BLOCKS 32
+
+/**
+ * _prealloc_t -- Preallocation window of an open file, where the blocks from next to end
+ *                are reserved for the file. id tells the reserved blocks of the window apart
+ *                from the blocks of the other windows.
+*/
+typedef struct _prealloc_t {
+    int id;
+    block_addr_t next;
+    block_addr_t end;
+} prealloc_t;
+
+/**
+ * The free bitmap keeps one byte per block that counts the number of pointers referring
+ * to the block, where 0 means the block is available. A copy of it is kept in memory and
+ * only the block of the bitmap that has been changed is written to the disk. The blocks
+ * are not cleared when they become free since every block is entirely written when it is
+ * used again. The discard mode records them so that they are cleared later when needed.
+ * 
+ * The data blocks are also split into segments of LOG_SEGMENT_BLOCKS blocks. In log mode,
+ * the new blocks are taken in order from the head of the log, which only moves to a segment
+ * where no block is used, so the blocks are written one after the other. The used blocks of
+ * each segment are counted so that the segments worth cleaning can be chosen.
+ * 
+ * The data blocks are split into allocation groups of FBM_GROUP_BLOCKS blocks whose free
+ * blocks are counted, so that a search skips the groups where no block is available. An open
+ * file that writes through a preallocation window reserves FBM_WINDOW_BLOCKS blocks in memory
+ * right after the block it used last, so the files written at the same time each take runs of
+ * contiguous blocks instead of taking every other block. The reserved blocks stay free on the
+ * disk and are only taken by another file once no other block is available.
+*/
 
 /**
- * init_fbm -- Initializes all 1500 bit to 1 to represent all 1500 data blocks are available.
- *             The first 11 blocks are taken by the (1) super block and (10) INode table.
+ * init_fbm -- Initializes all data blocks to 0 references to represent that they are available.
+ *             The blocks of the super block, the INode table, the directory and the free bitmap
+ *             are always taken.
 */
 void init_fbm();
 
 /**
- * find_free_block -- Finds the first available block that can be used, and sets it to used.
+ * set_fbm -- Initializes the free bitmap in memory with the free bitmap on the disk.
+*/
+void set_fbm();
+
+/**
+ * free_fbm -- Frees the free bitmap in memory and the records kept for its blocks.
+*/
+void free_fbm();
+
+/**
+ * find_free_block -- Finds the first available block that can be used, and sets it to used
+ *                    with a single reference. In log mode, the block is taken from the head
+ *                    of the log, unless no segment is clean.
  * 
  * returns the index of the data block
 */
-int find_free_block();
+block_addr_t find_free_block();
 
 /**
- * reset_free_block -- Resets the requested block to a free available block.
+ * set_prealloc_window -- Sets the preallocation window that find_free_block takes the blocks
+ *                        from. Once the window has no block left, it reserves the next run of
+ *                        available blocks after its last block.
+ * 
+ * window: preallocation window of the file being written, or NULL for the first available block
+*/
+void set_prealloc_window(prealloc_t* window);
+
+/**
+ * release_prealloc_window -- Releases the blocks reserved by a preallocation window that
+ *                            have not been used, and empties the window.
+ * 
+ * window: preallocation window
+*/
+void release_prealloc_window(prealloc_t* window);
+
+/**
+ * find_log_block -- Takes the next available block at the head of the log, and sets it to used
+ *                   with a single reference. Once its segment is full, the head moves to the
+ *                   next clean segment.
+ * 
+ * returns the index of the data block or -1 if no segment is clean
+*/
+block_addr_t find_log_block();
+
+/**
+ * find_free_run -- Finds the first run of contiguous available blocks of the requested length,
+ *                  and sets each of them to used with a single reference.
+ * 
+ * count: number of blocks of the run
+ * 
+ * returns the index of the first data block or -1 if no run is long enough
+*/
+block_addr_t find_free_run(int64_t count);
+
+/**
+ * take_free_run -- Sets a run of contiguous blocks to used with a single reference if each
+ *                  of them is available.
+ * 
+ * start: index of the first data block
+ * count: number of blocks of the run
+ * 
+ * returns 0 or -1 if a block of the run is not available
+*/
+int take_free_run(block_addr_t start, int64_t count);
+
+/**
+ * reset_free_block -- Releases one reference of the requested block. The block becomes a free
+ *                     available block once it has no reference left.
  * 
  * index: index of the data block
 */
-void reset_free_block(int index);
\ No newline at end of file
+void reset_free_block(block_addr_t index);
+
+/**
+ * reset_free_blocks -- Releases one reference of each requested block with a single
+ *                      write of the blocks of the free bitmap that have been changed.
+ * 
+ * indices: indices of the data blocks
+ * count: number of data blocks
+*/
+void reset_free_blocks(block_addr_t* indices, int64_t count);
+
+/**
+ * count_free_blocks -- Counts the free data blocks and the runs of free data blocks
+ *                      of the free bitmap in memory.
+ * 
+ * counters: counters where the free blocks and the runs are set
+*/
+void count_free_blocks(counters_t* counters);
+
+/**
+ * set_discard_mode -- Sets if the blocks that become free are recorded so that
+ *                     they are cleared by discard_free_blocks.
+ * 
+ * enable: record the freed blocks (true) or not (false)
+*/
+void set_discard_mode(bool enable);
+
+/**
+ * discard_free_blocks -- Discards the recorded blocks that are still free, where each
+ *                        run of contiguous blocks is discarded with a single request.
+ * 
+ * returns the number of blocks that have been cleared
+*/
+int discard_free_blocks();
+
+/**
+ * set_log_mode -- Sets if the new blocks are taken in order from the head of the log, which
+ *                 only moves to segments that are entirely free.
+ * 
+ * enable: use the log (true) or the first available block (false)
+*/
+void set_log_mode(bool enable);
+
+/**
+ * get_clean_segments -- Gets the number of segments where no block is used.
+ * 
+ * returns the number of clean segments
+*/
+int get_clean_segments();
+
+/**
+ * get_log_clock -- Gets the number of segments the head of the log has moved to, which
+ *                  measures the age of the segments.
+ * 
+ * returns the log clock
+*/
+int64_t get_log_clock();
+
+/**
+ * get_released_blocks -- Gets the number of blocks freed during the batch, which can only
+ *                        be used again once the batch is committed.
+ * 
+ * returns the number of blocks
+*/
+int64_t get_released_blocks();
+
+/**
+ * choose_segments -- Chooses the segments that are worth cleaning with the cost-benefit policy,
+ *                    where a segment is ranked by (1 - u) * age / (1 + u) with u the part of
+ *                    its blocks that are used. Cleaning a segment reads it and writes its used
+ *                    blocks, and an old segment is less likely to lose more blocks soon. The
+ *                    segments that are clean, full or at the head of the log are not chosen.
+ * 
+ * max_segments: maximum number of segments chosen
+ * starts: where the index of the first block of each chosen segment is copied to
+ * 
+ * returns the number of segments chosen, from the best to the worst
+*/
+int choose_segments(int max_segments, block_addr_t* starts);
+
+/**
+ * begin_fbm_batch -- Starts a batch where the blocks of the free bitmap are
+ *                    written when the batch is committed.
+*/
+void begin_fbm_batch();
+
+/**
+ * commit_fbm_batch -- Writes the blocks of the free bitmap changed during the batch.
+*/
+void commit_fbm_batch();
+
+/**
+ * ref_block -- Adds a reference to the requested block so that it is shared.
+ * 
+ * index: index of the data block
+ * 
+ * returns 0 or -1 if the block cannot have more references
+*/
+int ref_block(block_addr_t index);
+
+/**
+ * get_block_refs -- Gets the number of references of the requested block.
+ * 
+ * index: index of the data block
+ * 
+ * returns the number of references
+*/
+int get_block_refs(block_addr_t index);
+
+#endif
@@ -1,4 +1,68 @@
 #include "inode.h"
+#include "free_bitmap.h"
+#include "super_block.h"
+#include "scan.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+/* Blocks of the INode table changed during a batch */
+THREAD_LOCAL bool inode_batch = false;
+THREAD_LOCAL bool *inode_dirty = NULL;
+
+/**
+ * _held_block_t -- Indirect block changed during a batch, which is held in memory and
+ *                  written when the batch is committed like the blocks of the INode table.
+*/
+typedef struct _held_block_t {
+    block_addr_t address;
+    block_t block;
+    struct _held_block_t *next;
+} held_block_t;
+
+/* Indirect blocks held during a batch, hashed by address */
+THREAD_LOCAL held_block_t **held_blocks = NULL;
+THREAD_LOCAL int held_count = 0;
+
+/* Number of changes made to the pointers of the INodes */
+THREAD_LOCAL int64_t pointer_changes = 0;
+
+/* Deepest level of indirect blocks, reached through the triple indirect pointer */
+#define INODE_MAX_DEPTH 3
+
+/**
+ * _ind_cache_t -- Indirect blocks on the path to the last pointer that has been looked up,
+ *                 one per level below the INode. A contiguous range of pointers shares the
+ *                 same path, so each indirect block is read and written once for the range.
+*/
+typedef struct _ind_cache_t {
+    block_addr_t address[INODE_MAX_DEPTH];
+    bool dirty[INODE_MAX_DEPTH];
+    block_t blocks[INODE_MAX_DEPTH];
+} ind_cache_t;
+
+/**
+ * _block_list_t -- List of block indices that grows as the blocks are collected.
+*/
+typedef struct _block_list_t {
+    block_addr_t *items;
+    int64_t count;
+    int64_t capacity;
+} block_list_t;
+
+/* Helper Functions */
+void init_ind_cache(ind_cache_t* cache);
+void flush_ind_level(ind_cache_t* cache, int level);
+void flush_ind_cache(ind_cache_t* cache);
+block_addr_t* find_inode_pointer(inode_t* inode, int64_t pointer_index, ind_cache_t* cache, bool allocate, bool change);
+int add_block(block_list_t* list, block_addr_t block_index);
+int collect_tree(block_addr_t root, int depth, bool indirect, block_list_t* list);
+int copy_tree(block_addr_t* root, int depth);
+void release_tree(block_addr_t root, int depth);
+bool prune_tree(block_addr_t* root, int depth);
+void read_ind_block(block_addr_t address, block_t* block);
+void write_ind_block(block_addr_t address, block_t* block);
+held_block_t* find_held_block(block_addr_t address);
 
 /**
  * init_inode_table -- Initializes the INode table In-Memory and 
@@ -18,6 +82,10 @@ void init_inode_table(inode_t* inode_table) {
     inode_table[0].link_cnt = 1;
     inode_table[0].size = 0;
     inode_table[0].ind_pointer = -1;
+    inode_table[0].dind_pointer = -1;
+    inode_table[0].tind_pointer = -1;
+    inode_table[0].flags = 0;
+    memset(inode_table[0].inline_data, 0, INODE_INLINE_SIZE);
     for (int pt = 0; pt < INODE_POINTER_SIZE; pt++)
             inode_table[0].pointers[pt] = -1;
 
@@ -27,6 +95,10 @@ void init_inode_table(inode_t* inode_table) {
         inode_table[index].link_cnt = 0;
         inode_table[index].size = -1;
         inode_table[index].ind_pointer = -1;
+        inode_table[index].dind_pointer = -1;
+        inode_table[index].tind_pointer = -1;
+        inode_table[index].flags = 0;
+        memset(inode_table[index].inline_data, 0, INODE_INLINE_SIZE);
         for (int pt = 0; pt < INODE_POINTER_SIZE; pt++)
             inode_table[index].pointers[pt] = -1;
     }
@@ -42,24 +114,8 @@ void init_inode_table(inode_t* inode_table) {
  * inode_table: INode Table in memory
 */
 void set_inode_table(inode_t* inode_table) {
-    block_t blocks[INODE_TABLE_SIZE];
-
-    /* Read the INode on the disk to a temporary set of blocks */
-    read_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, blocks);
-
-    inode_t *inodes = (inode_t *) &blocks;
-
-    /* Initializes all INodes In-Memory */
-    for (int index = 0; index < INODE_LENGTH; index++) {
-        inode_table[index] = (inode_t) {
-            .mode = inodes[index].mode,
-            .link_cnt = inodes[index].link_cnt,
-            .size = inodes[index].size,
-            .ind_pointer = inodes[index].ind_pointer
-        };
-        for (int pt = 0; pt < INODE_POINTER_SIZE; pt++)
-            inode_table[index].pointers[pt] = inodes[index].pointers[pt];
-    }
+    /* Read the INodes on the disk to the INode table In-Memory */
+    read_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, inode_table);
 }
 
 /**
@@ -70,13 +126,27 @@ void set_inode_table(inode_t* inode_table) {
  * returns: index of the available INode
 */
 int find_free_inode(inode_t* inode_table) {
+    return scan_int32(inode_table, INODE_LENGTH, sizeof(inode_t), offsetof(inode_t, link_cnt), 0);
+}
+
+/**
+ * count_free_inodes -- Counts the INodes that are not used by a file.
+ * 
+ * inode_table: INode table in memory
+ * 
+ * returns the number of free INodes
+*/
+int count_free_inodes(inode_t* inode_table) {
+    int count = 0;
     for (int index = 0; index < INODE_LENGTH; index++)
-        if (inode_table[index].link_cnt == 0) return index;
-    return -1;
+        if (inode_table[index].link_cnt == 0) count++;
+    return count;
 }
 
 /**
  * init_inode -- Sets the requested INode to used by changing the link counter.
+ *               A new file starts with its data inlined in the INode, and keeps
+ *               the other flags that have been set before.
  * 
  * inode_table: INode table in memory
  * index: Index of the INode to be set to under used
@@ -85,8 +155,74 @@ void init_inode(inode_t* inode_table, int index) {
     inode_table[index].mode = 1;
     inode_table[index].link_cnt = 1;
     inode_table[index].size = 0;
+    inode_table[index].flags |= INODE_FLAG_INLINE;
+    memset(inode_table[index].inline_data, 0, INODE_INLINE_SIZE);
+    update_counters(0, 0, -1);
 
-    write_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, inode_table);
+    write_inode(inode_table, index);
+}
+
+/**
+ * write_inode -- Writes the block of the INode table that holds the requested INode to the disk.
+ *                In a batch, the block is only written once when the batch is committed.
+ * 
+ * inode_table: INode table in memory
+ * index: Index of the INode to be written
+*/
+void write_inode(inode_t* inode_table, int index) {
+    int block_index = index / INODE_PER_BLOCK;
+
+    if (inode_batch) {
+        inode_dirty[block_index] = true;
+        return;
+    }
+    write_blocks(SUPERBLOCK_SIZE + block_index, 1, &inode_table[block_index * INODE_PER_BLOCK]);
+}
+
+/**
+ * begin_inode_batch -- Starts a batch where the blocks of the INode table are
+ *                      written when the batch is committed.
+*/
+void begin_inode_batch() {
+    inode_batch = true;
+    free(inode_dirty);
+    inode_dirty = (bool *) calloc(INODE_TABLE_SIZE, sizeof(bool));
+    if (held_blocks == NULL) held_blocks = (held_block_t **) calloc(INODE_HELD_CHAINS, sizeof(held_block_t *));
+}
+
+/**
+ * commit_inode_batch -- Writes the indirect blocks changed during the batch, then each block
+ *                       of the INode table changed during the batch, where each run of
+ *                       contiguous blocks is written with a single request.
+ * 
+ * inode_table: INode table in memory
+*/
+void commit_inode_batch(inode_t* inode_table) {
+    inode_batch = false;
+
+    /* The indirect blocks are written before the INodes that refer to them */
+    for (int i = 0; held_blocks != NULL && i < INODE_HELD_CHAINS; i++) {
+        while (held_blocks[i] != NULL) {
+            held_block_t *held = held_blocks[i];
+            write_blocks(held -> address, 1, &held -> block);
+            held_blocks[i] = held -> next;
+            free(held);
+        }
+    }
+    free(held_blocks);
+    held_blocks = NULL;
+    held_count = 0;
+
+    for (int i = 0; i < INODE_TABLE_SIZE;) {
+        int run = 1;
+        if (inode_dirty[i]) {
+            while (i + run < INODE_TABLE_SIZE && inode_dirty[i + run]) run++;
+            write_blocks(SUPERBLOCK_SIZE + i, run, &inode_table[i * INODE_PER_BLOCK]);
+        }
+        i += run;
+    }
+    free(inode_dirty);
+    inode_dirty = NULL;
 }
 
 /**
@@ -98,5 +234,494 @@ void init_inode(inode_t* inode_table, int index) {
 void remove_entry_inode(inode_t* inode_table) {
     inode_table[0].size -= DIR_PER_BLOCK;
 
-    write_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, inode_table);
-}
\ No newline at end of file
+    write_inode(inode_table, 0);
+}
+
+/**
+ * get_inode_blocks -- Gets the data blocks assigned to a range of pointers of the INode.
+ *                     Each indirect block on the way is read once for a contiguous range.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * blocks: buffer where the data block indices are copied to (-1 if no block is assigned)
+*/
+void get_inode_blocks(inode_t* inode, int64_t pointer_index, int count, block_addr_t* blocks) {
+    ind_cache_t cache;
+    init_ind_cache(&cache);
+
+    for (int i = 0; i < count; i++) {
+        block_addr_t *pointer = find_inode_pointer(inode, pointer_index + i, &cache, false, false);
+        blocks[i] = pointer == NULL ? -1 : *pointer;
+    }
+}
+
+/**
+ * set_inode_blocks -- Assigns data blocks to a range of pointers of the INode.
+ *                     The indirect blocks are allocated the first time a pointer
+ *                     below them is assigned, and each is written once for a contiguous range.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * blocks: indices of the data blocks
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int set_inode_blocks(inode_t* inode, int64_t pointer_index, int count, block_addr_t* blocks) {
+    if (pointer_index < 0 || pointer_index + count > INODE_MAX_POINTERS) return -1;
+    pointer_changes++;
+
+    ind_cache_t cache;
+    init_ind_cache(&cache);
+
+    for (int i = 0; i < count; i++) {
+        /* Clearing a pointer never allocates the indirect blocks above it */
+        block_addr_t *pointer = find_inode_pointer(inode, pointer_index + i, &cache, blocks[i] >= 0, true);
+        if (pointer == NULL && blocks[i] < 0) continue;
+        if (pointer == NULL) {
+            flush_ind_cache(&cache);
+            return -1;
+        }
+        *pointer = blocks[i];
+    }
+
+    flush_ind_cache(&cache);
+    return 0;
+}
+
+/**
+ * reserve_inode_blocks -- Allocates the missing indirect blocks of a range of pointers of the
+ *                         INode without assigning any pointer, so that assigning the range
+ *                         afterwards does not fail when the disk is full.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int reserve_inode_blocks(inode_t* inode, int64_t pointer_index, int count) {
+    if (pointer_index < 0 || pointer_index + count > INODE_MAX_POINTERS) return -1;
+
+    ind_cache_t cache;
+    int result = 0;
+    init_ind_cache(&cache);
+
+    for (int i = 0; i < count && result == 0; i++)
+        if (find_inode_pointer(inode, pointer_index + i, &cache, true, false) == NULL) result = -1;
+
+    flush_ind_cache(&cache);
+    return result;
+}
+
+/**
+ * get_inode_block -- Gets the data block assigned to the requested pointer of the INode.
+ *                    Pointers past the direct pointers are looked up in the indirect block.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the pointer within the file
+ * 
+ * returns the index of the data block or -1 if no block is assigned
+*/
+block_addr_t get_inode_block(inode_t* inode, int64_t pointer_index) {
+    block_addr_t block_index;
+    get_inode_blocks(inode, pointer_index, 1, &block_index);
+    return block_index;
+}
+
+/**
+ * set_inode_block -- Assigns a data block to the requested pointer of the INode.
+ *                    The indirect block is allocated the first time a pointer
+ *                    past the direct pointers is assigned.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the pointer within the file
+ * block_index: index of the data block
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int set_inode_block(inode_t* inode, int64_t pointer_index, block_addr_t block_index) {
+    return set_inode_blocks(inode, pointer_index, 1, &block_index);
+}
+
+/**
+ * collect_inode_blocks -- Gets every data block assigned to the INode, and its indirect
+ *                         blocks when requested, without a bound on the size of the file.
+ * 
+ * inode: INode of the file
+ * indirect: also collect the indirect blocks (true) or only the data blocks (false)
+ * blocks: set to an allocated list of the block indices, to be freed by the caller
+ * 
+ * returns the number of blocks in the list or -1 if it cannot be allocated
+*/
+int64_t collect_inode_blocks(inode_t* inode, bool indirect, block_addr_t** blocks) {
+    block_list_t list = { NULL, 0, 0 };
+    block_addr_t roots[INODE_MAX_DEPTH] = { inode -> ind_pointer, inode -> dind_pointer, inode -> tind_pointer };
+    int result = 0;
+
+    for (int i = 0; i < INODE_POINTER_SIZE && result == 0; i++)
+        if (inode -> pointers[i] >= 0) result = add_block(&list, inode -> pointers[i]);
+    for (int depth = 1; depth <= INODE_MAX_DEPTH && result == 0; depth++)
+        result = collect_tree(roots[depth - 1], depth, indirect, &list);
+
+    if (result < 0) {
+        free(list.items);
+        *blocks = NULL;
+        return -1;
+    }
+    *blocks = list.items;
+    return list.count;
+}
+
+/**
+ * copy_inode_blocks -- Copies the indirect blocks of the source INode to new blocks of the
+ *                      copy, so that the copy refers to the same data blocks through its own
+ *                      indirect blocks. The new blocks are released if the disk is full.
+ * 
+ * source: INode of the file to be copied
+ * copy: INode of the copy, whose pointers are set to the ones of the source
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int copy_inode_blocks(inode_t* source, inode_t* copy) {
+    block_addr_t roots[INODE_MAX_DEPTH] = { source -> ind_pointer, source -> dind_pointer, source -> tind_pointer };
+
+    for (int depth = 1; depth <= INODE_MAX_DEPTH; depth++) {
+        if (copy_tree(&roots[depth - 1], depth) < 0) {
+            for (int i = 0; i < depth - 1; i++)
+                release_tree(roots[i], i + 1);
+            return -1;
+        }
+    }
+
+    pointer_changes++;
+    memcpy(copy -> pointers, source -> pointers, sizeof(source -> pointers));
+    copy -> ind_pointer = roots[0];
+    copy -> dind_pointer = roots[1];
+    copy -> tind_pointer = roots[2];
+    return 0;
+}
+
+/**
+ * prune_inode_blocks -- Releases the indirect blocks of the INode that no longer
+ *                       refer to any data block.
+ * 
+ * inode: INode of the file
+*/
+void prune_inode_blocks(inode_t* inode) {
+    pointer_changes++;
+    prune_tree(&inode -> ind_pointer, 1);
+    prune_tree(&inode -> dind_pointer, 2);
+    prune_tree(&inode -> tind_pointer, 3);
+}
+
+/**
+ * get_pointer_changes -- Gets the number of changes made to the pointers of the INodes,
+ *                        which tells if a pointer resolved before may be out of date.
+ * 
+ * returns the number of changes
+*/
+int64_t get_pointer_changes() {
+    return pointer_changes;
+}
+
+/**
+ * count_pointer_change -- Counts a change of the pointers of an INode made outside
+ *                         of the functions of the INode table.
+*/
+void count_pointer_change() {
+    pointer_changes++;
+}
+
+/**
+ * init_ind_cache -- Initializes the cache of indirect blocks with no block held.
+ * 
+ * cache: cache of indirect blocks
+*/
+void init_ind_cache(ind_cache_t* cache) {
+    for (int level = 0; level < INODE_MAX_DEPTH; level++) {
+        cache -> address[level] = -1;
+        cache -> dirty[level] = false;
+    }
+}
+
+/**
+ * flush_ind_level -- Writes the indirect block held at a level of the cache if it has changed.
+ * 
+ * cache: cache of indirect blocks
+ * level: level below the INode
+*/
+void flush_ind_level(ind_cache_t* cache, int level) {
+    if (cache -> dirty[level]) write_ind_block(cache -> address[level], &cache -> blocks[level]);
+    cache -> dirty[level] = false;
+}
+
+/**
+ * flush_ind_cache -- Writes every indirect block of the cache that has changed.
+ * 
+ * cache: cache of indirect blocks
+*/
+void flush_ind_cache(ind_cache_t* cache) {
+    for (int level = 0; level < INODE_MAX_DEPTH; level++)
+        flush_ind_level(cache, level);
+}
+
+/**
+ * find_inode_pointer -- Finds where the requested pointer of the INode is stored, either in the
+ *                       INode or in an indirect block held by the cache. When allocating, the
+ *                       missing indirect blocks are allocated with every pointer unused.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the pointer within the file
+ * cache: cache of indirect blocks
+ * allocate: allocate the missing indirect blocks (true) or not (false)
+ * change: mark the indirect block that holds the pointer as changed (true) or not (false)
+ * 
+ * returns the location of the pointer or NULL if it does not exist
+*/
+block_addr_t* find_inode_pointer(inode_t* inode, int64_t pointer_index, ind_cache_t* cache, bool allocate, bool change) {
+    if (pointer_index < 0 || pointer_index >= INODE_MAX_POINTERS) return NULL;
+    if (pointer_index < INODE_POINTER_SIZE) return &inode -> pointers[pointer_index];
+
+    /* Find the tree of indirect blocks that holds the pointer */
+    block_addr_t *roots[INODE_MAX_DEPTH] = { &inode -> ind_pointer, &inode -> dind_pointer, &inode -> tind_pointer };
+    int64_t index = pointer_index - INODE_POINTER_SIZE;
+    int64_t span = INODE_IND_POINTER_SIZE;
+    int depth = 1;
+    while (index >= span) {
+        index -= span;
+        span *= INODE_IND_POINTER_SIZE;
+        depth++;
+    }
+
+    block_addr_t *pointer = roots[depth - 1];
+    for (int level = 0; level < depth; level++) {
+        if (*pointer < 0) {
+            if (!allocate) return NULL;
+
+            block_addr_t address = find_free_block();
+            if (address < 0) return NULL;
+            *pointer = address;
+            if (level > 0) cache -> dirty[level - 1] = true;
+
+            flush_ind_level(cache, level);
+            cache -> address[level] = address;
+            cache -> dirty[level] = true;
+            memset(&cache -> blocks[level], -1, BLOCK_SIZE);
+        } else if (cache -> address[level] != *pointer) {
+            flush_ind_level(cache, level);
+            cache -> address[level] = *pointer;
+            read_ind_block(*pointer, &cache -> blocks[level]);
+        }
+
+        span /= INODE_IND_POINTER_SIZE;
+        pointer = &cache -> blocks[level].pointers[index / span];
+        index %= span;
+    }
+
+    if (change) cache -> dirty[depth - 1] = true;
+    return pointer;
+}
+
+/**
+ * add_block -- Appends a block index to the list, growing it when it is full.
+ * 
+ * list: list of block indices
+ * block_index: index of the block
+ * 
+ * returns 0 or -1 if the list cannot grow
+*/
+int add_block(block_list_t* list, block_addr_t block_index) {
+    if (list -> count == list -> capacity) {
+        int64_t capacity = list -> capacity == 0 ? 64 : list -> capacity * 2;
+        block_addr_t *items = (block_addr_t *) realloc(list -> items, capacity * sizeof(block_addr_t));
+        if (items == NULL) return -1;
+        list -> items = items;
+        list -> capacity = capacity;
+    }
+    list -> items[list -> count++] = block_index;
+    return 0;
+}
+
+/**
+ * collect_tree -- Collects the data blocks below an indirect block, and the indirect blocks
+ *                 themselves when requested.
+ * 
+ * root: index of the indirect block (-1 if the tree is empty)
+ * depth: number of levels of indirect blocks of the tree
+ * indirect: also collect the indirect blocks (true) or only the data blocks (false)
+ * list: list where the block indices are appended
+ * 
+ * returns 0 or -1 if the list cannot grow
+*/
+int collect_tree(block_addr_t root, int depth, bool indirect, block_list_t* list) {
+    if (root < 0) return 0;
+    if (indirect && add_block(list, root) < 0) return -1;
+
+    block_t block;
+    block_addr_t *entries = block.pointers;
+    read_ind_block(root, &block);
+
+    for (int64_t i = 0; i < INODE_IND_POINTER_SIZE; i++) {
+        if (entries[i] < 0) continue;
+        int result = depth > 1 ? collect_tree(entries[i], depth - 1, indirect, list) : add_block(list, entries[i]);
+        if (result < 0) return -1;
+    }
+    return 0;
+}
+
+/**
+ * copy_tree -- Copies an indirect block and the indirect blocks below it to new blocks.
+ * 
+ * root: index of the indirect block, set to the index of its copy
+ * depth: number of levels of indirect blocks of the tree
+ * 
+ * returns 0 or -1 if the disk is full, in which case no new block is kept
+*/
+int copy_tree(block_addr_t* root, int depth) {
+    if (*root < 0) return 0;
+
+    block_t block;
+    block_addr_t *entries = block.pointers;
+    read_ind_block(*root, &block);
+
+    block_addr_t copy = find_free_block();
+    if (copy < 0) return -1;
+
+    if (depth > 1) {
+        for (int64_t i = 0; i < INODE_IND_POINTER_SIZE; i++) {
+            if (copy_tree(&entries[i], depth - 1) == 0) continue;
+
+            /* Release the copies made so far, the entry that failed is left as it was */
+            for (int64_t j = 0; j < i; j++)
+                release_tree(entries[j], depth - 1);
+            reset_free_block(copy);
+            return -1;
+        }
+    }
+
+    write_ind_block(copy, &block);
+    *root = copy;
+    return 0;
+}
+
+/**
+ * release_tree -- Releases an indirect block and the indirect blocks below it,
+ *                 without the data blocks they refer to.
+ * 
+ * root: index of the indirect block (-1 if the tree is empty)
+ * depth: number of levels of indirect blocks of the tree
+*/
+void release_tree(block_addr_t root, int depth) {
+    if (root < 0) return;
+
+    if (depth > 1) {
+        block_t block;
+        block_addr_t *entries = block.pointers;
+        read_ind_block(root, &block);
+        for (int64_t i = 0; i < INODE_IND_POINTER_SIZE; i++)
+            release_tree(entries[i], depth - 1);
+    }
+    reset_free_block(root);
+}
+
+/**
+ * prune_tree -- Releases the indirect blocks of a tree that no longer refer to any data block.
+ * 
+ * root: index of the indirect block, set to -1 if it has been released
+ * depth: number of levels of indirect blocks of the tree
+ * 
+ * returns true if the whole tree has been released
+*/
+bool prune_tree(block_addr_t* root, int depth) {
+    if (*root < 0) return true;
+
+    block_t block;
+    block_addr_t *entries = block.pointers;
+    bool empty = true, changed = false;
+    read_ind_block(*root, &block);
+
+    for (int64_t i = 0; i < INODE_IND_POINTER_SIZE; i++) {
+        if (entries[i] >= 0 && depth > 1 && prune_tree(&entries[i], depth - 1)) changed = true;
+        if (entries[i] >= 0) empty = false;
+    }
+
+    if (empty) {
+        reset_free_block(*root);
+        *root = -1;
+        return true;
+    }
+    if (changed) write_ind_block(*root, &block);
+    return false;
+}
+
+/**
+ * read_ind_block -- Reads an indirect block, from memory if it has been changed during a batch.
+ * 
+ * address: index of the indirect block
+ * block: buffer where the indirect block is copied to
+*/
+void read_ind_block(block_addr_t address, block_t* block) {
+    held_block_t *held = find_held_block(address);
+    if (held != NULL) {
+        memcpy(block, &held -> block, BLOCK_SIZE);
+        return;
+    }
+    read_blocks(address, 1, block);
+}
+
+/**
+ * write_ind_block -- Writes an indirect block. In a batch, the block is held in memory and
+ *                    only written once when the batch is committed, so that the indirect
+ *                    blocks on the disk keep matching the INode table and the free bitmap.
+ * 
+ * address: index of the indirect block
+ * block: buffer of the indirect block
+*/
+void write_ind_block(block_addr_t address, block_t* block) {
+    if (!inode_batch || held_blocks == NULL) {
+        write_blocks(address, 1, block);
+        return;
+    }
+
+    held_block_t *held = find_held_block(address);
+    if (held == NULL) {
+        held = (held_block_t *) malloc(sizeof(held_block_t));
+        if (held == NULL) {
+            /* The block is written right away if it cannot be held */
+            write_blocks(address, 1, block);
+            return;
+        }
+        held -> address = address;
+        held -> next = held_blocks[address & (INODE_HELD_CHAINS - 1)];
+        held_blocks[address & (INODE_HELD_CHAINS - 1)] = held;
+        held_count++;
+    }
+    memcpy(&held -> block, block, BLOCK_SIZE);
+}
+
+/**
+ * find_held_block -- Finds an indirect block held in memory during a batch.
+ * 
+ * address: index of the indirect block
+ * 
+ * returns the held block or NULL if the block is not held
+*/
+held_block_t* find_held_block(block_addr_t address) {
+    if (held_blocks == NULL) return NULL;
+
+    held_block_t *held = held_blocks[address & (INODE_HELD_CHAINS - 1)];
+    while (held != NULL && held -> address != address) held = held -> next;
+    return held;
+}
+
+/**
+ * get_held_blocks -- Gets the number of indirect blocks changed during the batch, which are
+ *                    held in memory until the batch is committed.
+ * 
+ * returns the number of blocks
+*/
+int get_held_blocks() {
+    return held_count;
+}
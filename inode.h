@@ -1,22 +1,52 @@
+#ifndef INODE_H
+#define INODE_H
+
 #include "disk_emu.h"
 #include "constant.h"
 #include "block.h"
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 #define INODE_POINTER_SIZE 12
-#define INODE_LENGTH 160
+#define INODE_LENGTH (INODE_TABLE_SIZE * INODE_PER_BLOCK)
+#define INODE_IND_POINTER_SIZE ((int64_t) (BLOCK_SIZE / sizeof(block_addr_t)))
+#define INODE_MAX_POINTERS (INODE_POINTER_SIZE + INODE_IND_POINTER_SIZE * \
+    (1 + INODE_IND_POINTER_SIZE * (1 + INODE_IND_POINTER_SIZE)))
+#define INODE_MAX_FILE_SIZE (INODE_MAX_POINTERS * BLOCK_SIZE)
+#define INODE_INLINE_SIZE 116
+#define INODE_PER_BLOCK ((int) (BLOCK_SIZE / sizeof(inode_t)))
+
+/* INode flags */
+#define INODE_FLAG_INLINE 1
+#define INODE_FLAG_COMPRESS 2
+
+/* Number of indirect blocks a batch holds in memory before it is committed early */
+#define INODE_HELD_LIMIT 256
+
+/* Number of chains of the table of the indirect blocks held during a batch */
+#define INODE_HELD_CHAINS 256
 
 /**
  * _inode_t -- Note that the uid and gid have been removed since they are not used
- *             in the sfs_api and omitting them gives a size of 64 bytes in total
- *             which gives a total of 16 inodes per block of 1024 bytes.
+ *             in the sfs_api. The INode has a size of 256 bytes which gives a total
+ *             of 4 inodes per block of 1024 bytes and 16 per block of 4096 bytes. The size
+ *             and the block pointers are 64-bit. Past the direct pointers, the data blocks
+ *             are found through the single, double and triple indirect blocks. Files that have the INODE_FLAG_INLINE
+ *             flag keep their data in inline_data instead of data blocks until they
+ *             grow past INODE_INLINE_SIZE bytes. Files that have the INODE_FLAG_COMPRESS
+ *             flag have their clusters compressed when they are closed.
 */
 typedef struct _inode_t {
     int mode;
     int link_cnt;
-    int size;
-    int pointers[INODE_POINTER_SIZE];
-    int ind_pointer;
+    int64_t size;
+    block_addr_t pointers[INODE_POINTER_SIZE];
+    block_addr_t ind_pointer;
+    block_addr_t dind_pointer;
+    block_addr_t tind_pointer;
+    int flags;
+    char inline_data[INODE_INLINE_SIZE];
 } inode_t;
 
 /**
@@ -50,18 +80,170 @@ void set_inode_table(inode_t* inode_table);
 */
 int find_free_inode(inode_t* inode_table);
 
+/**
+ * count_free_inodes -- Counts the INodes that are not used by a file.
+ * 
+ * inode_table: INode table in memory
+ * 
+ * returns the number of free INodes
+*/
+int count_free_inodes(inode_t* inode_table);
+
 /**
  * init_inode -- Sets the requested INode to used by changing the link counter.
+ *               A new file starts with its data inlined in the INode, and keeps
+ *               the other flags that have been set before.
  * 
  * inode_table: INode table in memory
  * index: Index of the INode to be set to under used
 */
 void init_inode(inode_t* inode_table, int index);
 
+/**
+ * write_inode -- Writes the block of the INode table that holds the requested INode to the disk.
+ *                In a batch, the block is only written once when the batch is committed.
+ * 
+ * inode_table: INode table in memory
+ * index: Index of the INode to be written
+*/
+void write_inode(inode_t* inode_table, int index);
+
+/**
+ * begin_inode_batch -- Starts a batch where the blocks of the INode table are
+ *                      written when the batch is committed.
+*/
+void begin_inode_batch();
+
+/**
+ * commit_inode_batch -- Writes each block of the INode table changed during the batch,
+ *                       where each run of contiguous blocks is written with a single request.
+ * 
+ * inode_table: INode table in memory
+*/
+void commit_inode_batch(inode_t* inode_table);
+
+/**
+ * get_held_blocks -- Gets the number of indirect blocks changed during the batch, which are
+ *                    held in memory until the batch is committed.
+ * 
+ * returns the number of blocks
+*/
+int get_held_blocks();
+
 /**
  * remove_entry_inode -- Decrements the size property of the root directory INode
  *                       since a directory entry has been removed.
  * 
  * inode_table: INode table in memory
 */
-void remove_entry_inode(inode_t* inode_table);
\ No newline at end of file
+void remove_entry_inode(inode_t* inode_table);
+
+/**
+ * get_inode_blocks -- Gets the data blocks assigned to a range of pointers of the INode.
+ *                     Each indirect block on the way is read once for a contiguous range.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * blocks: buffer where the data block indices are copied to (-1 if no block is assigned)
+*/
+void get_inode_blocks(inode_t* inode, int64_t pointer_index, int count, block_addr_t* blocks);
+
+/**
+ * set_inode_blocks -- Assigns data blocks to a range of pointers of the INode.
+ *                     The indirect blocks are allocated the first time a pointer
+ *                     below them is assigned, and each is written once for a contiguous range.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * blocks: indices of the data blocks
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int set_inode_blocks(inode_t* inode, int64_t pointer_index, int count, block_addr_t* blocks);
+
+/**
+ * reserve_inode_blocks -- Allocates the missing indirect blocks of a range of pointers of the
+ *                         INode without assigning any pointer, so that assigning the range
+ *                         afterwards does not fail when the disk is full.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer within the file
+ * count: number of pointers
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int reserve_inode_blocks(inode_t* inode, int64_t pointer_index, int count);
+
+/**
+ * get_inode_block -- Gets the data block assigned to the requested pointer of the INode.
+ *                    Pointers past the direct pointers are looked up in the indirect block.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the pointer within the file
+ * 
+ * returns the index of the data block or -1 if no block is assigned
+*/
+block_addr_t get_inode_block(inode_t* inode, int64_t pointer_index);
+
+/**
+ * set_inode_block -- Assigns a data block to the requested pointer of the INode.
+ *                    The indirect block is allocated the first time a pointer
+ *                    past the direct pointers is assigned.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the pointer within the file
+ * block_index: index of the data block
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int set_inode_block(inode_t* inode, int64_t pointer_index, block_addr_t block_index);
+
+/**
+ * collect_inode_blocks -- Gets every data block assigned to the INode, and its indirect
+ *                         blocks when requested, without a bound on the size of the file.
+ * 
+ * inode: INode of the file
+ * indirect: also collect the indirect blocks (true) or only the data blocks (false)
+ * blocks: set to an allocated list of the block indices, to be freed by the caller
+ * 
+ * returns the number of blocks in the list or -1 if it cannot be allocated
+*/
+int64_t collect_inode_blocks(inode_t* inode, bool indirect, block_addr_t** blocks);
+
+/**
+ * copy_inode_blocks -- Copies the indirect blocks of the source INode to new blocks of the
+ *                      copy, so that the copy refers to the same data blocks through its own
+ *                      indirect blocks. The new blocks are released if the disk is full.
+ * 
+ * source: INode of the file to be copied
+ * copy: INode of the copy, whose pointers are set to the ones of the source
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int copy_inode_blocks(inode_t* source, inode_t* copy);
+
+/**
+ * prune_inode_blocks -- Releases the indirect blocks of the INode that no longer
+ *                       refer to any data block.
+ * 
+ * inode: INode of the file
+*/
+void prune_inode_blocks(inode_t* inode);
+
+/**
+ * get_pointer_changes -- Gets the number of changes made to the pointers of the INodes,
+ *                        which tells if a pointer resolved before may be out of date.
+ * 
+ * returns the number of changes
+*/
+int64_t get_pointer_changes();
+
+/**
+ * count_pointer_change -- Counts a change of the pointers of an INode made outside
+ *                         of the functions of the INode table.
+*/
+void count_pointer_change();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+
+/**
+ * init_pipeline -- Initializes an empty pipeline.
+ * 
+ * pipeline: pipeline to initialize
+ * max_bytes: bytes of content held before the producers wait
+ * producers: number of producers, each of which calls end_producer once it is done
+*/
+void init_pipeline(pipeline_t *pipeline, int64_t max_bytes, int producers) {
+    pthread_mutex_init(&pipeline -> lock, NULL);
+    pthread_cond_init(&pipeline -> changed, NULL);
+    pipeline -> head = NULL;
+    pipeline -> tail = NULL;
+    pipeline -> bytes = 0;
+    pipeline -> max_bytes = max_bytes;
+    pipeline -> producers = producers;
+}
+
+/**
+ * push_item -- Adds an item at the end of the pipeline. The producer waits while the
+ *              pipeline holds max_bytes, unless it is empty so that any item fits.
+ * 
+ * pipeline: pipeline of the producer
+ * item: item allocated by new_item
+*/
+void push_item(pipeline_t *pipeline, pipeline_item_t *item) {
+    pthread_mutex_lock(&pipeline -> lock);
+    while (pipeline -> head != NULL && pipeline -> bytes + item -> length > pipeline -> max_bytes)
+        pthread_cond_wait(&pipeline -> changed, &pipeline -> lock);
+
+    item -> next = NULL;
+    if (pipeline -> tail == NULL) pipeline -> head = item;
+    else pipeline -> tail -> next = item;
+    pipeline -> tail = item;
+    pipeline -> bytes += item -> length;
+
+    pthread_cond_broadcast(&pipeline -> changed);
+    pthread_mutex_unlock(&pipeline -> lock);
+}
+
+/**
+ * pop_item -- Takes the first item of the pipeline, and waits for one if it is empty.
+ * 
+ * pipeline: pipeline of the consumer
+ * 
+ * returns the item, to be freed with free_item, or NULL once the pipeline is empty and
+ * every producer is done
+*/
+pipeline_item_t* pop_item(pipeline_t *pipeline) {
+    pthread_mutex_lock(&pipeline -> lock);
+    while (pipeline -> head == NULL && pipeline -> producers > 0)
+        pthread_cond_wait(&pipeline -> changed, &pipeline -> lock);
+
+    pipeline_item_t *item = pipeline -> head;
+    if (item != NULL) {
+        pipeline -> head = item -> next;
+        if (pipeline -> head == NULL) pipeline -> tail = NULL;
+        pipeline -> bytes -= item -> length;
+        pthread_cond_broadcast(&pipeline -> changed);
+    }
+
+    pthread_mutex_unlock(&pipeline -> lock);
+    return item;
+}
+
+/**
+ * end_producer -- Tells the consumers that a producer will not add any more items.
+ * 
+ * pipeline: pipeline of the producer
+*/
+void end_producer(pipeline_t *pipeline) {
+    pthread_mutex_lock(&pipeline -> lock);
+    pipeline -> producers--;
+    pthread_cond_broadcast(&pipeline -> changed);
+    pthread_mutex_unlock(&pipeline -> lock);
+}
+
+/**
+ * free_pipeline -- Frees the items left in the pipeline and its lock.
+ * 
+ * pipeline: pipeline to free
+*/
+void free_pipeline(pipeline_t *pipeline) {
+    while (pipeline -> head != NULL) {
+        pipeline_item_t *item = pipeline -> head;
+        pipeline -> head = item -> next;
+        free_item(item);
+    }
+    pipeline -> tail = NULL;
+    pthread_mutex_destroy(&pipeline -> lock);
+    pthread_cond_destroy(&pipeline -> changed);
+}
+
+/**
+ * new_item -- Allocates an item without content.
+ * 
+ * name: filename within the image
+ * path: path of the file on the host
+ * 
+ * returns the item
+*/
+pipeline_item_t* new_item(const char *name, const char *path) {
+    pipeline_item_t *item = (pipeline_item_t *) calloc(1, sizeof(pipeline_item_t));
+    item -> name = strdup(name);
+    item -> path = strdup(path);
+    return item;
+}
+
+/**
+ * free_item -- Frees an item and its content.
+ * 
+ * item: item to free
+*/
+void free_item(pipeline_item_t *item) {
+    free(item -> name);
+    free(item -> path);
+    free(item -> data);
+    free(item);
+}
@@ -0,0 +1,100 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Bytes held by the items of a pipeline before a producer waits for a consumer */
+#define PIPELINE_MAX_BYTES (64 * 1024 * 1024)
+
+/**
+ * _pipeline_item_t -- File handed from a producer to a consumer with its content in memory.
+ * 
+ * name: filename within the image
+ * path: path of the file on the host
+ * data: content of the file, or NULL if it could not be read
+ * length: size of the content
+*/
+typedef struct _pipeline_item_t {
+    char *name;
+    char *path;
+    char *data;
+    int64_t length;
+    struct _pipeline_item_t *next;
+} pipeline_item_t;
+
+/**
+ * _pipeline_t -- Queue of items between the producer threads and the consumer threads,
+ *                bounded by the number of bytes of content it holds.
+*/
+typedef struct _pipeline_t {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pipeline_item_t *head;
+    pipeline_item_t *tail;
+    int64_t bytes;
+    int64_t max_bytes;
+    int producers;
+} pipeline_t;
+
+/**
+ * init_pipeline -- Initializes an empty pipeline.
+ * 
+ * pipeline: pipeline to initialize
+ * max_bytes: bytes of content held before the producers wait
+ * producers: number of producers, each of which calls end_producer once it is done
+*/
+void init_pipeline(pipeline_t *pipeline, int64_t max_bytes, int producers);
+
+/**
+ * push_item -- Adds an item at the end of the pipeline. The producer waits while the
+ *              pipeline holds max_bytes, unless it is empty so that any item fits.
+ * 
+ * pipeline: pipeline of the producer
+ * item: item allocated by new_item
+*/
+void push_item(pipeline_t *pipeline, pipeline_item_t *item);
+
+/**
+ * pop_item -- Takes the first item of the pipeline, and waits for one if it is empty.
+ * 
+ * pipeline: pipeline of the consumer
+ * 
+ * returns the item, to be freed with free_item, or NULL once the pipeline is empty and
+ * every producer is done
+*/
+pipeline_item_t* pop_item(pipeline_t *pipeline);
+
+/**
+ * end_producer -- Tells the consumers that a producer will not add any more items.
+ * 
+ * pipeline: pipeline of the producer
+*/
+void end_producer(pipeline_t *pipeline);
+
+/**
+ * free_pipeline -- Frees the items left in the pipeline and its lock.
+ * 
+ * pipeline: pipeline to free
+*/
+void free_pipeline(pipeline_t *pipeline);
+
+/**
+ * new_item -- Allocates an item without content.
+ * 
+ * name: filename within the image
+ * path: path of the file on the host
+ * 
+ * returns the item
+*/
+pipeline_item_t* new_item(const char *name, const char *path);
+
+/**
+ * free_item -- Frees an item and its content.
+ * 
+ * item: item to free
+*/
+void free_item(pipeline_item_t *item);
+
+#endif
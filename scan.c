@@ -0,0 +1,294 @@
+#include "scan.h"
+#include "block.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/* Versions of the kernels chosen for the instruction set in use */
+typedef struct _scan_kernels_t {
+    int level;
+    int64_t (*zero_byte)(const uint8_t *bytes, int64_t from, int64_t to);
+    int (*entries)(const char *table, int count, int stride, const char *key, int length);
+    int (*int32)(const char *table, int count, int stride, int32_t value);
+} scan_kernels_t;
+
+/* The processor is the same for every thread, so the best kernels are chosen once for all of them */
+scan_kernels_t scan_kernels;
+pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+/* Kernels used by the thread, copied from the shared ones on first use so that set_scan_level
+   only changes the kernels of the calling thread */
+THREAD_LOCAL scan_kernels_t thread_kernels = { SCAN_SCALAR, NULL, NULL, NULL };
+
+/* Helper Functions */
+void init_scan_kernels();
+scan_kernels_t* get_scan_kernels();
+int choose_scan_kernels(int level, scan_kernels_t *chosen);
+int64_t zero_byte_scalar(const uint8_t *bytes, int64_t from, int64_t to);
+int entries_scalar(const char *table, int count, int stride, const char *key, int length);
+int int32_scalar(const char *table, int count, int stride, int32_t value);
+#ifdef SCAN_X86
+int64_t zero_byte_sse2(const uint8_t *bytes, int64_t from, int64_t to);
+int entries_sse2(const char *table, int count, int stride, const char *key, int length);
+int64_t zero_byte_avx2(const uint8_t *bytes, int64_t from, int64_t to);
+int entries_avx2(const char *table, int count, int stride, const char *key, int length);
+int int32_avx2(const char *table, int count, int stride, int32_t value);
+#endif
+
+/**
+ * get_scan_level -- Gets the instruction set used by the scan kernels of the calling thread.
+ * 
+ * returns SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+*/
+int get_scan_level() {
+    return get_scan_kernels() -> level;
+}
+
+/**
+ * set_scan_level -- Sets the instruction set used by the scan kernels of the calling thread,
+ *                   e.g. to compare the versions of a kernel. The other threads keep theirs.
+ * 
+ * level: SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+ * 
+ * returns 0 or -1 if the processor does not support the instruction set
+*/
+int set_scan_level(int level) {
+    return choose_scan_kernels(level, get_scan_kernels());
+}
+
+/**
+ * scan_zero_byte -- Finds the first byte that is 0 within a range of an array of bytes.
+ * 
+ * bytes: array of bytes
+ * from: index of the first byte of the range
+ * to: index after the last byte of the range
+ * 
+ * returns the index of the byte or -1 if none is 0
+*/
+int64_t scan_zero_byte(const uint8_t* bytes, int64_t from, int64_t to) {
+    if (from >= to) return -1;
+    return get_scan_kernels() -> zero_byte(bytes, from, to);
+}
+
+/**
+ * scan_entries -- Finds the first entry of a table that starts with the bytes of a key.
+ * 
+ * table: first entry of the table
+ * count: number of entries
+ * stride: size of an entry, at least length
+ * key: bytes compared to the start of each entry
+ * length: number of bytes of the key, at most SCAN_MAX_KEY
+ * 
+ * returns the index of the entry or -1 if none starts with the key
+*/
+int scan_entries(const void* table, int count, int stride, const void* key, int length) {
+    if (length <= 0 || length > SCAN_MAX_KEY || length > stride) return -1;
+
+    /* The vector versions load SCAN_MAX_KEY bytes of each entry, which must be within the entry */
+    char padded[SCAN_MAX_KEY] = { 0 };
+    memcpy(padded, key, length);
+    if (stride < SCAN_MAX_KEY) return entries_scalar((const char *) table, count, stride, padded, length);
+    return get_scan_kernels() -> entries((const char *) table, count, stride, padded, length);
+}
+
+/**
+ * scan_int32 -- Finds the first entry of a table whose 32-bit field has the given value.
+ * 
+ * table: first entry of the table
+ * count: number of entries
+ * stride: size of an entry, a multiple of 4
+ * offset: location of the field within an entry, a multiple of 4
+ * value: value of the field
+ * 
+ * returns the index of the entry or -1 if no field has the value
+*/
+int scan_int32(const void* table, int count, int stride, int offset, int32_t value) {
+    return get_scan_kernels() -> int32((const char *) table + offset, count, stride, value);
+}
+
+/**
+ * init_scan_kernels -- Chooses the best version of the kernels supported by the processor.
+*/
+void init_scan_kernels() {
+    if (choose_scan_kernels(SCAN_AVX2, &scan_kernels) == 0) return;
+    if (choose_scan_kernels(SCAN_SSE2, &scan_kernels) == 0) return;
+    choose_scan_kernels(SCAN_SCALAR, &scan_kernels);
+}
+
+/**
+ * get_scan_kernels -- Gets the kernels of the calling thread, which start as the best ones
+ *                     supported by the processor.
+ * 
+ * returns the kernels of the thread
+*/
+scan_kernels_t* get_scan_kernels() {
+    if (thread_kernels.zero_byte == NULL) {
+        pthread_once(&scan_once, init_scan_kernels);
+        thread_kernels = scan_kernels;
+    }
+    return &thread_kernels;
+}
+
+/**
+ * choose_scan_kernels -- Sets the versions of the kernels for an instruction set.
+ * 
+ * level: SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+ * chosen: kernels that are set
+ * 
+ * returns 0 or -1 if the processor does not support the instruction set
+*/
+int choose_scan_kernels(int level, scan_kernels_t *chosen) {
+    scan_kernels_t kernels = { SCAN_SCALAR, zero_byte_scalar, entries_scalar, int32_scalar };
+    if (level == SCAN_SCALAR) {
+        *chosen = kernels;
+        return 0;
+    }
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (level == SCAN_SSE2 && __builtin_cpu_supports("sse2")) {
+        /* SSE2 has no gather, so the fields of a table are still read one by one */
+        kernels.level = SCAN_SSE2;
+        kernels.zero_byte = zero_byte_sse2;
+        kernels.entries = entries_sse2;
+        *chosen = kernels;
+        return 0;
+    }
+    if (level == SCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+        kernels.level = SCAN_AVX2;
+        kernels.zero_byte = zero_byte_avx2;
+        kernels.entries = entries_avx2;
+        kernels.int32 = int32_avx2;
+        *chosen = kernels;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * zero_byte_scalar -- Finds the first byte that is 0 by testing 8 bytes per 64-bit word,
+ *                     where a word holds a 0 byte once (x - 0x01..01) & ~x & 0x80..80 is set.
+*/
+int64_t zero_byte_scalar(const uint8_t *bytes, int64_t from, int64_t to) {
+    const uint64_t ones = 0x0101010101010101ULL, highs = 0x8080808080808080ULL;
+    int64_t i = from;
+
+    for (; i + 8 <= to; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (((word - ones) & ~word & highs) != 0) break;
+    }
+    for (; i < to; i++)
+        if (bytes[i] == 0) return i;
+    return -1;
+}
+
+/**
+ * entries_scalar -- Compares the key to each entry with memcmp.
+*/
+int entries_scalar(const char *table, int count, int stride, const char *key, int length) {
+    for (int i = 0; i < count; i++)
+        if (memcmp(table + (size_t) i * stride, key, length) == 0) return i;
+    return -1;
+}
+
+/**
+ * int32_scalar -- Reads the field of each entry in turn.
+*/
+int int32_scalar(const char *table, int count, int stride, int32_t value) {
+    for (int i = 0; i < count; i++) {
+        int32_t field;
+        memcpy(&field, table + (size_t) i * stride, sizeof(field));
+        if (field == value) return i;
+    }
+    return -1;
+}
+
+#ifdef SCAN_X86
+/**
+ * zero_byte_sse2 -- Finds the first byte that is 0 by testing 16 bytes per instruction.
+*/
+__attribute__((target("sse2")))
+int64_t zero_byte_sse2(const uint8_t *bytes, int64_t from, int64_t to) {
+    const __m128i zero = _mm_setzero_si128();
+    int64_t i = from;
+
+    for (; i + 16 <= to; i += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (bytes + i)), zero));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return zero_byte_scalar(bytes, i, to);
+}
+
+/**
+ * entries_sse2 -- Compares the key to each entry with one instruction per 16 bytes of the key.
+*/
+__attribute__((target("sse2")))
+int entries_sse2(const char *table, int count, int stride, const char *key, int length) {
+    const __m128i low = _mm_loadu_si128((const __m128i *) key);
+    const __m128i high = _mm_loadu_si128((const __m128i *) (key + 16));
+    uint32_t wanted = length == 32 ? UINT32_MAX : (1U << length) - 1;
+
+    for (int i = 0; i < count; i++) {
+        const char *entry = table + (size_t) i * stride;
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) entry), low));
+        if (length > 16)
+            mask |= (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (entry + 16)), high)) << 16;
+        if ((mask & wanted) == wanted) return i;
+    }
+    return -1;
+}
+
+/**
+ * zero_byte_avx2 -- Finds the first byte that is 0 by testing 32 bytes per instruction.
+*/
+__attribute__((target("avx2")))
+int64_t zero_byte_avx2(const uint8_t *bytes, int64_t from, int64_t to) {
+    const __m256i zero = _mm256_setzero_si256();
+    int64_t i = from;
+
+    for (; i + 32 <= to; i += 32) {
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (bytes + i)), zero));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    return zero_byte_scalar(bytes, i, to);
+}
+
+/**
+ * entries_avx2 -- Compares the key to each entry with a single 32-byte instruction.
+*/
+__attribute__((target("avx2")))
+int entries_avx2(const char *table, int count, int stride, const char *key, int length) {
+    const __m256i pattern = _mm256_loadu_si256((const __m256i *) key);
+    uint32_t wanted = length == 32 ? UINT32_MAX : (1U << length) - 1;
+
+    for (int i = 0; i < count; i++) {
+        const char *entry = table + (size_t) i * stride;
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) entry), pattern));
+        if ((mask & wanted) == wanted) return i;
+    }
+    return -1;
+}
+
+/**
+ * int32_avx2 -- Gathers the fields of 8 entries and compares them with a single instruction.
+*/
+__attribute__((target("avx2")))
+int int32_avx2(const char *table, int count, int stride, int32_t value) {
+    const __m256i pattern = _mm256_set1_epi32(value);
+    const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride / 4));
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i fields = _mm256_i32gather_epi32((const int *) (table + (size_t) i * stride), lanes, 4);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(fields, pattern)));
+        if (mask != 0) return i + __builtin_ctz(mask);
+    }
+    int found = int32_scalar(table + (size_t) i * stride, count - i, stride, value);
+    return found < 0 ? -1 : i + found;
+}
+#endif
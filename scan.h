@@ -0,0 +1,76 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+/* Instruction sets of the scan kernels */
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1
+#define SCAN_AVX2 2
+
+/* Longest key compared by scan_entries */
+#define SCAN_MAX_KEY 32
+
+/**
+ * The scans of the tables kept in memory (free bitmap, directory, INode table and file
+ * descriptor table) go through these kernels. Each kernel has a scalar version, which tests
+ * 8 bytes per 64-bit word where it can, and SSE2 and AVX2 versions on x86, which test 16 or
+ * 32 bytes per instruction. The best version supported by the processor is chosen the
+ * first time a kernel is called.
+*/
+
+/**
+ * get_scan_level -- Gets the instruction set used by the scan kernels of the calling thread.
+ * 
+ * returns SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+*/
+int get_scan_level();
+
+/**
+ * set_scan_level -- Sets the instruction set used by the scan kernels of the calling thread,
+ *                   e.g. to compare the versions of a kernel. The other threads keep theirs.
+ * 
+ * level: SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2
+ * 
+ * returns 0 or -1 if the processor does not support the instruction set
+*/
+int set_scan_level(int level);
+
+/**
+ * scan_zero_byte -- Finds the first byte that is 0 within a range of an array of bytes.
+ * 
+ * bytes: array of bytes
+ * from: index of the first byte of the range
+ * to: index after the last byte of the range
+ * 
+ * returns the index of the byte or -1 if none is 0
+*/
+int64_t scan_zero_byte(const uint8_t* bytes, int64_t from, int64_t to);
+
+/**
+ * scan_entries -- Finds the first entry of a table that starts with the bytes of a key.
+ * 
+ * table: first entry of the table
+ * count: number of entries
+ * stride: size of an entry, at least length
+ * key: bytes compared to the start of each entry
+ * length: number of bytes of the key, at most SCAN_MAX_KEY
+ * 
+ * returns the index of the entry or -1 if none starts with the key
+*/
+int scan_entries(const void* table, int count, int stride, const void* key, int length);
+
+/**
+ * scan_int32 -- Finds the first entry of a table whose 32-bit field has the given value.
+ * 
+ * table: first entry of the table
+ * count: number of entries
+ * stride: size of an entry, a multiple of 4
+ * offset: location of the field within an entry, a multiple of 4
+ * value: value of the field
+ * 
+ * returns the index of the entry or -1 if no field has the value
+*/
+int scan_int32(const void* table, int count, int stride, int offset, int32_t value);
+
+#endif
@@ -6,8 +6,10 @@
  * the limitations of the following API in the README.md file.
 */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "constant.h"
 #include "disk_emu.h"
@@ -18,18 +20,108 @@
 #include "free_bitmap.h"
 #include "directory.h"
 #include "fdt.h"
+#include "compress.h"
+#include "dedup.h"
+#include "stripe.h"
+#include "block_device.h"
 
-/* In-Memory Data */
-block_t inode_table[INODE_TABLE_SIZE]; /* Inode Table */
-block_t dir_table[DIR_BLOCK_SIZE];     /* Directory Table */
-block_t fd_table[DIR_BLOCK_SIZE];      /* File Descriptor Table */
+/**
+ * _sfs_t -- Disk mounted by a thread.
+ * 
+ * path: filename of the image
+*/
+struct _sfs_t {
+    char *path;
+};
 
-int current_dir = 1;
+/* In-Memory Data */
+THREAD_LOCAL char *inode_table = NULL;              /* Inode Table, sized by the geometry of the disk */
+THREAD_LOCAL char *dir_table = NULL;                /* Directory Table, sized by the geometry of the disk */
+THREAD_LOCAL fdt_t fd_table[FDT_SIZE];              /* File Descriptor Table */
+
+THREAD_LOCAL int current_dir = 1;
+THREAD_LOCAL bool compression_mode = false;
+THREAD_LOCAL bool dedup_mode = false;
+THREAD_LOCAL int batch_depth = 0;
+THREAD_LOCAL int disk_type = SFS_DEVICE_FILE;
+THREAD_LOCAL int format_block_size = DEFAULT_BLOCK_SIZE;
+THREAD_LOCAL int64_t format_num_blocks = DEFAULT_NUM_BLOCKS;
+THREAD_LOCAL int format_inode_count = DEFAULT_INODE_COUNT;
+THREAD_LOCAL int disk_members = 1;
+THREAD_LOCAL int disk_stripe_unit = 0;
+THREAD_LOCAL int writeback_limit = 0;                       /* Dirty blocks held by the write-back cache, 0 without cache */
+THREAD_LOCAL int writeback_percent = 0;
+THREAD_LOCAL int writeback_expire = 0;
+THREAD_LOCAL int durability_mode = SFS_DURABILITY_NONE;     /* Durability of the disk in use */
+THREAD_LOCAL int mount_durability = SFS_DURABILITY_NONE;    /* Durability of the disk opened by the next mksfs */
+THREAD_LOCAL bool log_mode = false;
+THREAD_LOCAL int64_t log_checkpoint = 0;                    /* Log clock of the last checkpoint of the log mode */
+THREAD_LOCAL int64_t log_clean_failed = -1;                 /* Log clock when the cleaner last found nothing to clean */
+THREAD_LOCAL int64_t ordered_commit_time = 0;               /* Time of the last commit of the ordered mode */
+THREAD_LOCAL sfs_t *mounted_fs = NULL;                      /* Disk mounted by the thread with sfs_mount */
+THREAD_LOCAL char *disk_path = DISK_NAME;                   /* Filename of the image of the disk */
+THREAD_LOCAL int tail_count = 0;                            /* Number of file descriptor entries with a tail block */
+THREAD_LOCAL int buffer_count = 0;                          /* Number of file descriptor entries with buffered bytes */
+THREAD_LOCAL int flush_interval = DEFAULT_FLUSH_INTERVAL;   /* Age in milliseconds at which a timed buffer is written */
+
+/* Number of blocks handled by one pass of the read/write helpers */
+#define IO_CHUNK_BLOCKS 32
+
+/* The cleaner runs between writes once fewer segments than this are clean in log mode */
+#define LOG_MIN_CLEAN_SEGMENTS 2
+/* Number of segments cleaned by each of these runs */
+#define LOG_CLEAN_STEP 1
+/* Number of segments filled by the log between two checkpoints in the ordered mode */
+#define LOG_CHECKPOINT_SEGMENTS 8
+/* Number of blocks freed since the last sync point at which the ordered mode commits its metadata */
+#define ORDERED_MAX_RELEASED 1024
+/* Age in milliseconds at which the ordered mode commits the metadata it holds */
+#define ORDERED_MAX_AGE 5000
 
 /* Helper Functions */
+int open_disk(bool fresh);
+void alloc_tables();
 void set_dir_entry_table(inode_t inode, dirent_t* dir_table);
-void create_file(char* name, inode_t* inode_table, int inode_index, dirent_t* dir_table, int dir_index);
+int create_file(char* name, inode_t* inode_table, int inode_index, dirent_t* dir_table, int dir_index);
 void remove_inode(inode_t* inode_table, int index);
+int get_fdt_inode(int fileID);
+int get_iov_length(const sfs_iovec_t* iov, int iovcnt);
+void copy_iov(const sfs_iovec_t* iov, int iovcnt, int skip, char* buffer, int length, bool to_iov);
+int write_file(int inode, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int read_file(int inode, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int64_t get_cluster_map(inode_t* inode, int64_t pointer_index, int count, block_addr_t* map);
+void mark_compress_range(int fileID, int64_t offset, int length);
+void compress_file(int inode, int64_t start, int64_t end);
+void load_block(block_addr_t block_index, char* buffer);
+int uninline_file(int inode);
+int allocate_file(int inode, int64_t offset, int64_t length);
+int punch_file(int inode, int64_t offset, int64_t length);
+void zero_range(int inode, int64_t offset, int length);
+int sync_disk();
+int commit_ordered_batch();
+bool reuse_released_blocks(int inode);
+int sync_operation(int result);
+void bound_batch();
+int64_t get_data_pointers(inode_t* inode, int64_t** pointers, bool movable);
+int defrag_file(int inode, int max_blocks);
+int clean_log_segments(int max_segments);
+void maintain_log();
+void release_disk();
+block_addr_t map_block(int fileID, int64_t pointer_index);
+int write_tail(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int read_tail(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int flush_tail(int fileID);
+void flush_tails(int inode);
+int drop_tail(int fileID, bool write);
+void drop_tails(int inode, bool write);
+int write_buffer(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int flush_buffer(int fileID);
+void flush_timed_buffers();
+int64_t get_file_size(int inode);
+int64_t get_time();
+int write_entry(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt);
+int64_t copy_file(int src_fd, int64_t src_off, int dst_fd, int64_t dst_off, int64_t length);
+int share_blocks(int src_inode, int64_t src_pointer, int dst_inode, int64_t dst_pointer, int count);
 
 /**
  * mksfs -- Initializes the disk and the disk information in-memory.
@@ -37,34 +129,143 @@ void remove_inode(inode_t* inode_table, int index);
  * fresh: indication if the user would like to create a new disk (1) or use an existing disk (0)
 */
 void mksfs(int fresh) {
+    /* The tail blocks and the metadata held in memory for the disk in use are written before the
+       disk is opened again */
+    drop_tails(-1, true);
+    if (batch_depth > 0) {
+        batch_depth = 1;
+        sfs_batch_commit();
+    }
+
     current_dir = 1;
     if (fresh == 1) {
         /* To setup a new disk */
+        /* Compute the layout of the disk from the geometry set by sfs_set_geometry */
+        compute_geometry(&disk_geometry, format_block_size, format_num_blocks, format_inode_count);
         /* Initialize a fresh disk */
-        init_fresh_disk(DISK_NAME, BLOCK_SIZE, SUPERBLOCK_SIZE + INODE_TABLE_SIZE + 
-            DATA_BLOCK_SIZE + DIR_BLOCK_SIZE + FREE_BITMAP_SIZE);
+        open_disk(true);
+        alloc_tables();
         /* Initialize the super block */
         init_superblock();
         /* Initialize the inode table and the inode cache */
-        init_inode_table((inode_t *) &inode_table);
+        init_inode_table((inode_t *) inode_table);
         /* Initialize the directory table and the directory cache */
-        init_dir_entry_table((dirent_t *) &dir_table);
+        init_dir_entry_table((dirent_t *) dir_table);
         /* Initialize the free bitmap */
         init_fbm();
     } else {
         /* To setup an existing disk */
         /* Initialize the disk */
-        init_disk(DISK_NAME, BLOCK_SIZE, SUPERBLOCK_SIZE + INODE_TABLE_SIZE + 
-            DATA_BLOCK_SIZE + DIR_BLOCK_SIZE + FREE_BITMAP_SIZE);
-        /* Check if the disk has a valid format */
+        open_disk(false);
+        /* Check if the disk has a valid format and read its geometry */
         check_valid_disk();
+        /* Open the disk again if its geometry is not the one it has been opened with */
+        block_device_t *device = get_block_device();
+        if (device -> block_size != BLOCK_SIZE || device -> num_blocks != disk_geometry.num_blocks)
+            open_disk(false);
+        /* A mapped image file shorter than its geometry does not hold the whole disk */
+        device = get_block_device();
+        if (device == NULL || device -> num_blocks < disk_geometry.num_blocks) {
+            printf("Invalid File Format -- The disk is smaller than its geometry.\n");
+            exit(EXIT_FAILURE);
+        }
+        alloc_tables();
         /* Copy the inode table to the inode cache */
-        set_inode_table((inode_t *) &inode_table);
+        set_inode_table((inode_t *) inode_table);
+        /* Copy the free bitmap to the free bitmap cache */
+        set_fbm();
         /* Copy the directory table to the directory cache */
-        set_dir_entry_table(((inode_t *) &inode_table)[0], (dirent_t *) &dir_table);
+        set_dir_entry_table(((inode_t *) inode_table)[0], (dirent_t *) dir_table);
+        /* Count the free space again if the disk has changed since the last checkpoint */
+        if (!read_counters(&disk_counters)) {
+            count_free_blocks(&disk_counters);
+            disk_counters.free_inodes = count_free_inodes((inode_t *) inode_table);
+            checkpoint_superblock();
+        }
     }
+    /* Initialize the fingerprint index of the deduplication mode */
+    if (dedup_mode) build_dedup_index((inode_t *) inode_table);
+    else init_dedup_index();
     /* Initialize the file descriptor table */
     init_fdt((fdt_t *) &fd_table);
+
+    /* The log starts over from the first clean segment */
+    log_checkpoint = 0;
+    log_clean_failed = -1;
+
+    /* In the ordered mode, the metadata is held in memory until the next sync point */
+    durability_mode = mount_durability;
+    if (durability_mode == SFS_DURABILITY_ORDERED) sfs_batch_begin();
+    ordered_commit_time = get_time();
+}
+
+/**
+ * sfs_mount -- Mounts the disk stored at the given path for the calling thread. Each thread
+ *              keeps the state of its own disk, so threads that mount different disks share
+ *              nothing and need no locking. Every other function of the API works on the disk
+ *              mounted by the calling thread, and a thread mounts one disk at a time. A disk
+ *              previously opened by mksfs in the thread is written and closed first.
+ * 
+ * path: filename of the image, used as the prefix of the image files of a striped disk
+ * options: how the disk is opened, or NULL to open an existing disk with the default options
+ * 
+ * returns the mounted file system or NULL if the thread has already mounted a disk, the
+ * options are not valid or the disk cannot be opened
+*/
+sfs_t* sfs_mount(const char* path, const sfs_options_t* options) {
+    sfs_options_t defaults = { 0, SFS_DURABILITY_NONE, SFS_DEVICE_FILE };
+    if (options == NULL) options = &defaults;
+    if (mounted_fs != NULL || path == NULL) return NULL;
+    if (options -> durability != SFS_DURABILITY_NONE && options -> durability != SFS_DURABILITY_ORDERED &&
+        options -> durability != SFS_DURABILITY_STRICT) return NULL;
+    if (options -> device != SFS_DEVICE_FILE && options -> device != SFS_DEVICE_MMAP &&
+        options -> device != SFS_DEVICE_RAM) return NULL;
+
+    release_disk();
+
+    sfs_t *fs = (sfs_t *) malloc(sizeof(sfs_t));
+    fs -> path = strdup(path);
+    disk_path = fs -> path;
+    disk_type = options -> device;
+    mount_durability = options -> durability;
+
+    if (!options -> fresh) {
+        /* A disk without a valid superblock is not mounted, where mksfs would end the process */
+        geometry_t geometry;
+        if (open_disk(false) < 0 || read_geometry(&geometry) < 0) {
+            close_disk();
+            disk_path = DISK_NAME;
+            free(fs -> path);
+            free(fs);
+            return NULL;
+        }
+    }
+
+    mksfs(options -> fresh ? 1 : 0);
+    mounted_fs = fs;
+    return fs;
+}
+
+/**
+ * sfs_unmount -- Writes the disk mounted by the calling thread to the storage, closes it and
+ *                frees the memory that was kept for it.
+ * 
+ * fs: file system returned by sfs_mount in the calling thread
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_unmount(sfs_t* fs) {
+    if (fs == NULL || fs != mounted_fs) return -1;
+
+    drop_tails(-1, true);
+    int result = get_block_device() != NULL && flush_blocks() == 0 ? 0 : -1;
+    release_disk();
+
+    disk_path = DISK_NAME;
+    mounted_fs = NULL;
+    free(fs -> path);
+    free(fs);
+    return result;
 }
 
 /**
@@ -78,19 +279,15 @@ void mksfs(int fresh) {
  * the counter has reached the end of the directory table.
 */
 int sfs_getnextfilename(char* fname) {
-    int dir_length = 1;
-
-    /* Get the length of the directory table */
-    for (int i = 1; i < DIR_ENTRY_SIZE; i++) {
-        if (((dirent_t *) &dir_table)[i].inode < 0) break;
-        dir_length++;
-    }
+    /* Skip the entries of the files that have been removed */
+    while (current_dir < DIR_ENTRY_SIZE && ((dirent_t *) dir_table)[current_dir].inode < 0)
+        current_dir++;
 
-    /* Check if the current directory index has reached the end of the directoru table */
-    if (current_dir >= dir_length) return 0;
+    /* Check if the current directory index has reached the end of the directory table */
+    if (current_dir >= DIR_ENTRY_SIZE) return 0;
 
     /* Set the filename of the current index to the buffer (fname) */
-    strcpy(fname, ((dirent_t *) &dir_table)[current_dir].filename);
+    strcpy(fname, ((dirent_t *) dir_table)[current_dir].filename);
     /* Increment the current directory index for the next sfs_getnextfilename */
     current_dir++;
 
@@ -105,7 +302,7 @@ int sfs_getnextfilename(char* fname) {
  * 
  * returns the size of the file found in the given INode
 */
-int sfs_getfilesize(const char* path) {
+int64_t sfs_getfilesize(const char* path) {
     /* Get the INode that corresponds to the file in the path */
     int inode = find_inode_with_path(path, (dirent_t *) dir_table);
 
@@ -114,8 +311,8 @@ int sfs_getfilesize(const char* path) {
         printf("Invalid Read -- Cannot fin %s", path);
         return -1;
     }
-    /* Returns the size of the file in the path */
-    return ((inode_t *) &inode_table)[inode].size;
+    /* Returns the size of the file in the path, with the bytes buffered past its end */
+    return get_file_size(inode);
 }
 
 /**
@@ -129,28 +326,33 @@ int sfs_getfilesize(const char* path) {
 int sfs_fopen(char *name) {
     int fdt_index = -1;
     int inode = -1;
-    int size = 0;
+    int64_t size = 0;
 
     /* Get the inode corresponding to the filename from the directory table */
-    inode = find_inode_with_filename(name, (dirent_t *) &dir_table);
+    inode = find_inode_with_filename(name, (dirent_t *) dir_table);
 
     if (inode > 0) {
         /* If the file exists in the disk */
         /* Get the size of the file */
-        size = ((inode_t *) &inode_table)[inode].size;
+        size = get_file_size(inode);
     } else {
         /* If the file does not exist in the disk */
         /* Find the first available INode from the INode table */
-        inode = find_free_inode((inode_t *) &inode_table);
+        inode = find_free_inode((inode_t *) inode_table);
         /* Find the first available directory entry from the directory table */
-        int dir_index = find_free_entry((dirent_t *) &dir_table);
-        /* Create the file in the disk */
-        create_file(name, (inode_t *) &inode_table, inode, (dirent_t *) &dir_table, dir_index);
+        int dir_index = find_free_entry((dirent_t *) dir_table);
+        /* Checks if the file system has room for another file */
+        if (inode < 0 || dir_index < 0) return -1;
 
         /* Update the INode table */
-        init_inode((inode_t *) &inode_table, inode);
-        /* Update the directory table */
-        insert_dir_entry((dirent_t *) &dir_table, dir_index, name, inode);
+        if (compression_mode) ((inode_t *) inode_table)[inode].flags = INODE_FLAG_COMPRESS;
+        init_inode((inode_t *) inode_table, inode);
+        /* Create the file in the directory table and on the disk, or release the INode if it cannot be */
+        if (create_file(name, (inode_t *) inode_table, inode, (dirent_t *) dir_table, dir_index) < 0) {
+            remove_inode((inode_t *) inode_table, inode);
+            return sync_operation(-1);
+        }
+        sync_operation(0);
     }
 
     /* Find the first available file descriptor entry */
@@ -163,170 +365,234 @@ int sfs_fopen(char *name) {
 
 /**
  * sfs_fclose -- Closes the file in the file descriptor table using its index.
+ *               The clusters of a compressed file written through the entry are
+ *               compressed before it returns, so the close takes longer than the writes.
  * 
  * fileID: file descriptor table index
  * 
  * returns -1 or 0 if its a success
 */
 int sfs_fclose(int fileID) {
-    return close_fdt_entry((fdt_t *) &fd_table, fileID);
+    int inode = get_fdt_inode(fileID);
+    int flushed = 0;
+    if (inode >= 0) {
+        /* The bytes buffered by the entry and its tail block are written first */
+        flushed = drop_tail(fileID, true);
+        /* Compresses the clusters that have been written through the file descriptor entry */
+        fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+        compress_file(inode, entry -> compress_start, entry -> compress_end);
+        /* The blocks reserved for the entry that have not been written can be used by any file */
+        release_prealloc_window(&entry -> prealloc);
+    }
+    int result = close_fdt_entry((fdt_t *) &fd_table, fileID);
+    return sync_operation(flushed < 0 ? -1 : result);
 }
 
 /**
- * sfs_fwrite -- Writes the given buffer to file.
- * 
- * limitations:
- * - It has only been tested to write on the first block
- * - It does not allocate blocks past the 12 direct pointers
- * - It only writes characters and not individual bytes
+ * sfs_setvbuf -- Sets how the writes through a file descriptor entry are buffered. With
+ *                SFS_BUFFER_FULL, the writes that continue the buffered bytes are copied to
+ *                a buffer of the given size, which is written to the file with a single write
+ *                once it is full, by sfs_fflush, or when the entry is closed. SFS_BUFFER_TIMED
+ *                also writes the buffer once it is older than the interval set by
+ *                sfs_set_flush_interval. The buffered bytes are written first when the file
+ *                is used through another entry.
  * 
  * fileID: file descriptor index
- * buf: buffer that will be written onto the file
- * length: size of the buffer
+ * mode: SFS_BUFFER_NONE, SFS_BUFFER_FULL or SFS_BUFFER_TIMED
+ * size: size of the buffer in bytes, ignored by SFS_BUFFER_NONE
+ * 
+ * returns -1 or 0 if its a success
 */
-int sfs_fwrite(int fileID, const char *buf, int length) {
-    if (fileID < 0) return -1;
-    block_t temp;
-
-    /* Gets File Descriptor Table information */
-    int inode = ((fdt_t *) &fd_table)[fileID].inum;
-    int size = ((fdt_t *) &fd_table)[fileID].foffset;
-
-    /* Checks if the file descriptor entry has a file */
-    if (inode < 0) return -1;
-
-    /* Checks which inode pointer to find the starting block */
-    int pointer_index = size / BLOCK_SIZE;
-    /* Gets the starting block to write */
-    int block_index = ((inode_t *) &inode_table)[inode].pointers[pointer_index];
+int sfs_setvbuf(int fileID, int mode, int size) {
+    if (get_fdt_inode(fileID) < 0) return -1;
+    if (mode != SFS_BUFFER_NONE && mode != SFS_BUFFER_FULL && mode != SFS_BUFFER_TIMED) return -1;
+    if (mode != SFS_BUFFER_NONE && size < 1) return -1;
+
+    /* The bytes buffered until now are written with the previous mode */
+    int result = drop_tail(fileID, true);
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    entry -> buffer_mode = mode;
+    entry -> buffer_size = mode == SFS_BUFFER_NONE ? 0 : size;
+
+    return sync_operation(result);
+}
 
-    if (block_index < 0) {
-        /* If the pointer does not have a block assigned */
-        block_index = find_free_block();
-        ((inode_t *) &inode_table)[inode].pointers[pointer_index] = block_index;
+/**
+ * sfs_fflush -- Writes the bytes buffered by a file descriptor entry to its file.
+ * 
+ * fileID: file descriptor index, or -1 for every entry
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fflush(int fileID) {
+    int result = 0;
+    if (fileID == -1) {
+        for (int i = 0; i < FDT_SIZE && buffer_count + tail_count > 0; i++)
+            if (flush_tail(i) < 0) result = -1;
+    } else if (get_fdt_inode(fileID) >= 0) {
+        result = flush_tail(fileID);
     } else {
-        /* If the pointer has a block */
-        read_blocks(block_index, 1, &temp);
-    }
-
-    int current_length = length;
-
-    while (true) {
-        if (length > BLOCK_SIZE - size) {
-            /* If the length of the buffer to write exceeds the block size from the read/write pointer */
-            /* Gets how many bytes will be written in the current block */
-            current_length -= BLOCK_SIZE - size;
-
-            strcpy(((char *) &temp) + size, buf);
-            write_blocks(block_index, 1, &temp);
-
-            /* Checks if we have written the whole buffer */
-            if (current_length <= 0) break;
-
-            /* If not, we reset the values and write to the next pointer */
-            size = 0;
-
-            pointer_index++;
-            int block_index = ((inode_t *) &inode_table)[inode].pointers[pointer_index];
-
-            if (block_index < 0) {
-                /* If the pointer does not have a block assigned */
-                block_index = find_free_block();
-                ((inode_t *) &inode_table)[inode].pointers[pointer_index] = block_index;
-            } else {
-                /* If the pointer has a block */
-                read_blocks(block_index, 1, &temp);
-            }
-        } else {
-            /* If the length of the buffer to write can be done in same block */
-            /* Writing from the buffer thats into account the read/write pointer */
-            strcpy(((char *) &temp) + size, buf);
-            write_blocks(block_index, 1, &temp);
-            break;
-        }
+        return -1;
     }
 
-    ((inode_t *) &inode_table)[inode].size = size + length;
-    write_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, &inode_table);
+    return sync_operation(result);
+}
 
-    ((fdt_t *) &fd_table)[fileID].foffset += length;
+/**
+ * sfs_set_flush_interval -- Sets how long the bytes buffered with SFS_BUFFER_TIMED are kept.
+ *                           The age of the buffers is checked by each read and write.
+ * 
+ * milliseconds: age of a buffer at which it is written
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_flush_interval(int milliseconds) {
+    if (milliseconds < 0) return -1;
 
-    return length;
+    flush_interval = milliseconds;
+    return 0;
 }
 
 /**
- * sfs_fread -- Reads the file and copies it to the given buffer.
+ * sfs_fwrite -- Writes the given buffer to file at the read/write pointer
+ *               and moves the read/write pointer past the written bytes.
+ * 
+ * fileID: file descriptor index
+ * buf: buffer that will be written onto the file
+ * length: size of the buffer
  * 
- * limitations:
- * - It has only been tested to read on the first block
- * - It only writes characters and not individual bytes
+ * returns the number of bytes written or -1
+*/
+int sfs_fwrite(int fileID, const char *buf, int length) {
+    sfs_iovec_t iov = { .base = (void *) buf, .length = length };
+    return sfs_fwritev(fileID, &iov, 1);
+}
+
+/**
+ * sfs_fread -- Reads the file at the read/write pointer and copies it to the given buffer.
+ *              The read stops at the end of the file.
  * 
  * fileID: file descriptor index
  * buf: buffer to be written on with the file's data
  * length: size of the buffer
+ * 
+ * returns the number of bytes read or -1
 */
 int sfs_fread(int fileID, char *buf, int length) {
-    if (fileID < 0) return -1;
-    block_t temp;
-
-    /* Gets File Descriptor Table information */
-    int inode = ((fdt_t *) &fd_table)[fileID].inum;
-    int size = ((fdt_t *) &fd_table)[fileID].foffset;
+    sfs_iovec_t iov = { .base = buf, .length = length };
+    return sfs_freadv(fileID, &iov, 1);
+}
 
+/**
+ * sfs_fwritev -- Writes the buffers of the vector one after the other to the file
+ *                at the read/write pointer. Contiguous blocks of the whole vector
+ *                are written with a single block request.
+ * 
+ * fileID: file descriptor index
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1
+*/
+int sfs_fwritev(int fileID, const sfs_iovec_t *iov, int iovcnt) {
     /* Checks if the file descriptor entry has a file */
+    int inode = get_fdt_inode(fileID);
     if (inode < 0) return -1;
 
-    /* Checks which inode pointer to find the starting block */
-    int pointer_index = size / BLOCK_SIZE;
-    /* Gets the starting block to write */
-    int block_index = ((inode_t *) &inode_table)[inode].pointers[pointer_index];
-
-    if (block_index < 0) {
-        /* If the pointer does not have a block assigned */
-        return -1;
-    } else {
-        /* If the pointer has a block */
-        read_blocks(block_index, 1, &temp);
+    flush_timed_buffers();
+    /* A small write is buffered, or goes to the tail block of the entry when it is within a block */
+    int length = write_buffer(fileID, ((fdt_t *) &fd_table)[fileID].foffset, iov, iovcnt);
+    if (length < 0) length = write_tail(fileID, ((fdt_t *) &fd_table)[fileID].foffset, iov, iovcnt);
+    if (length < 0) {
+        drop_tails(inode, true);
+        maintain_log();
+        length = write_entry(fileID, ((fdt_t *) &fd_table)[fileID].foffset, iov, iovcnt);
     }
+    mark_compress_range(fileID, ((fdt_t *) &fd_table)[fileID].foffset, length);
+    if (length > 0) ((fdt_t *) &fd_table)[fileID].foffset += length;
 
-    int current_length = length;
+    return sync_operation(length);
+}
 
-    while (true) {
-        if (length > BLOCK_SIZE - size) {
-            /* If the length of the buffer to read exceeds the block size from the read/write pointer */
-            /* Gets how many bytes will be read in the current block */
-            current_length -= BLOCK_SIZE - size;
+/**
+ * sfs_freadv -- Reads the file at the read/write pointer and scatters it into the
+ *               buffers of the vector. Contiguous blocks of the whole vector are
+ *               read with a single block request.
+ * 
+ * fileID: file descriptor index
+ * iov: buffers to be written on with the file's data
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes read or -1
+*/
+int sfs_freadv(int fileID, const sfs_iovec_t *iov, int iovcnt) {
+    /* Checks if the file descriptor entry has a file */
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0) return -1;
 
-            strcpy(buf, ((char *) &temp) + size);
+    flush_timed_buffers();
+    /* A read within the tail block of the entry is served from memory */
+    int length = read_tail(fileID, ((fdt_t *) &fd_table)[fileID].foffset, iov, iovcnt);
+    if (length < 0) {
+        flush_tails(inode);
+        length = read_file(inode, ((fdt_t *) &fd_table)[fileID].foffset, iov, iovcnt);
+    }
+    if (length > 0) ((fdt_t *) &fd_table)[fileID].foffset += length;
 
-            /* Checks if we have written the whole buffer */
-            if (current_length <= 0) break;
+    return length;
+}
 
-            /* If not, we reset the values and write to the next pointer */
-            size = 0;
+/**
+ * sfs_pwrite -- Writes the given buffer to file at the given offset. The read/write
+ *               pointer of the file descriptor entry is left untouched.
+ * 
+ * fileID: file descriptor index
+ * buf: buffer that will be written onto the file
+ * length: size of the buffer
+ * offset: location in the file where the buffer is written
+ * 
+ * returns the number of bytes written or -1
+*/
+int sfs_pwrite(int fileID, const char *buf, int length, int64_t offset) {
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0 || offset < 0) return -1;
+
+    flush_timed_buffers();
+    sfs_iovec_t iov = { .base = (void *) buf, .length = length };
+    length = write_buffer(fileID, offset, &iov, 1);
+    if (length < 0) length = write_tail(fileID, offset, &iov, 1);
+    if (length < 0) {
+        drop_tails(inode, true);
+        maintain_log();
+        length = write_entry(fileID, offset, &iov, 1);
+    }
+    mark_compress_range(fileID, offset, length);
 
-            pointer_index++;
-            int block_index = ((inode_t *) &inode_table)[inode].pointers[pointer_index];
+    return sync_operation(length);
+}
 
-            if (block_index < 0) {
-                /* If the pointer does not have a block assigned */
-                return -1;
-            } else {
-                /* If the pointer has a block */
-                read_blocks(block_index, 1, &temp);
-            }
-        } else {
-            /* If the length of the buffer to read can be done in same block */
-            /* Reading from the file thats into account the read/write pointer */
-            strcpy(buf, ((char *) &temp) + size);
-            break;
-        }
-    }
-    ((inode_t *) &inode_table)[inode].size = length;
+/**
+ * sfs_pread -- Reads the file at the given offset and copies it to the given buffer.
+ *              The read/write pointer of the file descriptor entry is left untouched.
+ * 
+ * fileID: file descriptor index
+ * buf: buffer to be written on with the file's data
+ * length: size of the buffer
+ * offset: location in the file where the read starts
+ * 
+ * returns the number of bytes read or -1
+*/
+int sfs_pread(int fileID, char *buf, int length, int64_t offset) {
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0 || offset < 0) return -1;
 
-    ((fdt_t *) &fd_table)[fileID].foffset += length;
+    flush_timed_buffers();
+    sfs_iovec_t iov = { .base = buf, .length = length };
+    int read = read_tail(fileID, offset, &iov, 1);
+    if (read >= 0) return read;
 
-    return length;
+    flush_tails(inode);
+    return read_file(inode, offset, &iov, 1);
 }
 
 /**
@@ -338,6 +604,20 @@ int sfs_fread(int fileID, char *buf, int length) {
  * returns -1 or 0 if its a success
 */
 int sfs_fseek(int fileID, int loc) {
+    return sfs_fseek64(fileID, loc);
+}
+
+/**
+ * sfs_fseek64 -- Changes the read/write pointer of a file descriptor entry to
+ *                a location that may be past 2 GB.
+ * 
+ * fileID: file descriptor entry index
+ * loc: new location of the read/write pointer
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fseek64(int fileID, int64_t loc) {
+    if (loc < 0 || loc > INODE_MAX_FILE_SIZE) return -1;
     return seek_fdt_entry((fdt_t *) &fd_table, fileID, loc);
 }
 
@@ -350,119 +630,2042 @@ int sfs_fseek(int fileID, int loc) {
 */
 int sfs_remove(char *file) {
     /* Get INode of the file from the directory table in memory */
-    int inode_index = find_inode_with_filename(file, (dirent_t *) &dir_table);
+    int inode_index = find_inode_with_filename(file, (dirent_t *) dir_table);
     /* Get directory entry index of the file from the directory table in memory */
-    int dir_index = remove_dir_entry_mem((dirent_t *) &dir_table, file);
+    int dir_index = remove_dir_entry_mem((dirent_t *) dir_table, file);
 
     /* Checks if directory entry has been found */
     if (dir_index < 0) return -1;
 
+    /* The tail blocks of the removed file are not written */
+    drop_tails(inode_index, false);
+
     /* Get the block index of the directory entry */
-    int dir_block_index = ((inode_t *) &inode_table)[0].pointers[dir_index / DIR_PER_BLOCK];
+    int dir_block_index = ((inode_t *) inode_table)[0].pointers[dir_index / DIR_PER_BLOCK];
 
-    /* Remove the directory entry from the specific block */
-    remove_dir_entry_disk(dir_block_index, dir_index);
+    /* Write the block of the removed directory entry */
+    write_dir_entry((dirent_t *) dir_table, dir_block_index, dir_index);
     /* Decrement the size of the inode since a directory entry has been removed */
-    remove_entry_inode((inode_t *) &inode_table);
+    remove_entry_inode((inode_t *) inode_table);
 
     /* Reset the INode and remove all data that have been assigned to each respective pointer */
-    remove_inode((inode_t *) &inode_table, inode_index);
+    remove_inode((inode_t *) inode_table, inode_index);
 
-    return 0;
+    return sync_operation(0);
 }
 
 /**
- * set_dire_entry_table -- Sets the directory entries on the disk to the one in-memory.
+ * sfs_clone -- Creates a copy of a file that shares the data blocks of the source file.
+ *              Each data block gets one more reference and is copied on the first write
+ *              to either file, so only the INode and the directory entry are written.
  * 
- * inode: INode linked to the directory table
- * dir_table: directory table in memory
+ * src: filename to be copied
+ * dst: filename of the copy, which must not exist
+ * 
+ * returns -1 or 0 if its a success
 */
-void set_dir_entry_table(inode_t inode, dirent_t* dir_table) {
-    block_t block[1];
-    for (int index = 0; index < DIR_BLOCK_SIZE; index++) {
-        if (inode.pointers[index] < 0) return;
-        read_blocks(inode.pointers[index], 1, &block);
-        for (int dir_index = 0; dir_index < DIR_PER_BLOCK; dir_index++)
-            dir_table[dir_index + index * DIR_PER_BLOCK] = ((dirent_t *) &block)[dir_index];
+int sfs_clone(char *src, char *dst) {
+    int src_index = find_inode_with_filename(src, (dirent_t *) dir_table);
+    if (src_index <= 0 || find_inode_with_filename(dst, (dirent_t *) dir_table) > 0) return -1;
+
+    /* Find the INode and the directory entry of the copy */
+    int inode = find_free_inode((inode_t *) inode_table);
+    int dir_index = find_free_entry((dirent_t *) dir_table);
+    if (inode < 0 || dir_index < 0) return -1;
+
+    /* The data blocks that are shared must be up to date and are no longer written in place */
+    drop_tails(src_index, true);
+
+    inode_t *source = &((inode_t *) inode_table)[src_index];
+    inode_t *copy = &((inode_t *) inode_table)[inode];
+
+    /* Check that each data block can be shared once more */
+    block_addr_t *blocks;
+    int64_t count = collect_inode_blocks(source, false, &blocks);
+    if (count < 0) return -1;
+    for (int64_t i = 0; i < count; i++) {
+        if (get_block_refs(blocks[i]) >= BLOCK_MAX_REFS) {
+            free(blocks);
+            return -1;
+        }
+    }
+
+    /* The indirect blocks hold the pointers of the copy, so they are copied instead of shared */
+    sfs_batch_begin();
+    inode_t clone = *source;
+    if (copy_inode_blocks(source, &clone) < 0) {
+        sfs_batch_commit();
+        free(blocks);
+        return -1;
     }
+    *copy = clone;
+    update_counters(0, 0, -1);
+    for (int64_t i = 0; i < count; i++)
+        ref_block(blocks[i]);
+    free(blocks);
+
+    write_inode((inode_t *) inode_table, inode);
+    /* The references and the indirect blocks of the copy are released if it cannot be created */
+    int result = create_file(dst, (inode_t *) inode_table, inode, (dirent_t *) dir_table, dir_index);
+    if (result < 0) remove_inode((inode_t *) inode_table, inode);
+    sfs_batch_commit();
+
+    return result;
 }
 
 /**
- * create_file -- Creates a file and places it on the disk.
+ * sfs_copy_range -- Copies a range of a file to another file, or to another range of the same
+ *                   file, without going through a buffer of the caller. When both offsets are
+ *                   at the same location within their blocks, the whole blocks of the range
+ *                   are shared like sfs_clone does, and the holes stay holes. The other bytes
+ *                   are copied by the file system in chunks of contiguous blocks. The read/write
+ *                   pointers of the file descriptor entries are left untouched.
  * 
- * name: filename to be created
- * inode_table: INode table in memory
- * inode_index: index of the INode entry where the file will be referred to
- * dir_table: directory table in memory
- * dir_index: index of the directory entry where the filename will be referred to
+ * src_fd: file descriptor index of the source file
+ * src_off: location in the source file where the range starts
+ * dst_fd: file descriptor index of the destination file
+ * dst_off: location in the destination file where the range is copied
+ * length: size of the range, which stops at the end of the source file
+ * 
+ * returns the number of bytes copied or -1, also when the ranges overlap within a file
 */
-void create_file(char* name, inode_t* inode_table, int inode_index, dirent_t* dir_table, int dir_index) {
-    int disk_block_index = -1;
-    block_t block;
+int64_t sfs_copy_range(int src_fd, int64_t src_off, int dst_fd, int64_t dst_off, int64_t length) {
+    int src = get_fdt_inode(src_fd), dst = get_fdt_inode(dst_fd);
+    if (src < 0 || dst < 0 || src_off < 0 || dst_off < 0 || length < 0) return -1;
+
+    /* The buffered bytes of both files are written first so that the copy reads and replaces them */
+    flush_timed_buffers();
+    drop_tails(src, true);
+    drop_tails(dst, true);
+
+    int64_t size = ((inode_t *) inode_table)[src].size;
+    if (length > size - src_off) length = size - src_off;
+    if (length > INODE_MAX_FILE_SIZE - dst_off) length = INODE_MAX_FILE_SIZE - dst_off;
+    if (length <= 0) return 0;
+    if (src == dst && src_off < dst_off + length && dst_off < src_off + length) return -1;
+
+    maintain_log();
+    sfs_batch_begin();
+    int64_t copied = copy_file(src_fd, src_off, dst_fd, dst_off, length);
+    if (sfs_batch_commit() < 0) return -1;
+
+    return copied;
+}
 
-    /* Initializes the INode related to the file to the first available pointer */
-    for (int index = 0; index < INODE_POINTER_SIZE + 1; index++) {
-        if (inode_table[0].pointers[index] > -1) {
-            disk_block_index = inode_table[0].pointers[index];
-            read_blocks(inode_table[0].pointers[index], 1, &block);
-        } else {
-            disk_block_index = find_free_block();
-            
-            inode_table[0].pointers[index] = disk_block_index;
+/**
+ * sfs_set_compression -- Sets if the files created from now on are compressed.
+ * 
+ * enable: compress new files (1) or not (0)
+*/
+void sfs_set_compression(int enable) {
+    compression_mode = enable != 0;
+}
+
+/**
+ * sfs_fsetcompression -- Sets if the file of a file descriptor entry is compressed.
+ *                        Enabling the compression compresses the whole file when
+ *                        the file descriptor entry is closed. Disabling it expands
+ *                        the compressed clusters back to one data block per pointer.
+ * 
+ * fileID: file descriptor index
+ * enable: compress the file (1) or not (0)
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fsetcompression(int fileID, int enable) {
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0) return -1;
+
+    drop_tails(inode, true);
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    if (enable) {
+        file -> flags |= INODE_FLAG_COMPRESS;
+        mark_compress_range(fileID, 0, file -> size);
+    } else if ((file -> flags & INODE_FLAG_COMPRESS) && !(file -> flags & INODE_FLAG_INLINE)) {
+        /* The compressed clusters are expanded, since only the files that are compressed are
+           expected to hold some */
+        int64_t clusters = (file -> size + COMPRESS_CLUSTER_SIZE - 1) / COMPRESS_CLUSTER_SIZE;
+        for (int64_t cluster = 0; cluster < clusters; cluster++) {
+            if (expand_cluster(file, cluster) < 0) {
+                write_inode((inode_t *) inode_table, inode);
+                return sync_operation(-1);
+            }
         }
+        file -> flags &= ~INODE_FLAG_COMPRESS;
+    } else {
+        file -> flags &= ~INODE_FLAG_COMPRESS;
+    }
+    write_inode((inode_t *) inode_table, inode);
 
-        inode_table[0].size += sizeof(dirent_t);
-        write_blocks(SUPERBLOCK_SIZE, 1, inode_table);
+    return sync_operation(0);
+}
 
-        /* Initializes the directory entry to the defined position */
-        int dir_blk_index = dir_index % (BLOCK_SIZE / sizeof(dirent_t));
-        strcpy(((dirent_t *) &block)[dir_blk_index].filename, name);
-        ((dirent_t *) &block)[dir_blk_index].inode = inode_index;
+/**
+ * sfs_set_dedup -- Sets if the blocks written from now on are deduplicated. A block
+ *                  whose content is already in a data block shares that data block.
+ *                  Before a disk is opened, the index is built when it is opened.
+ * 
+ * enable: deduplicate blocks (1) or not (0)
+*/
+void sfs_set_dedup(int enable) {
+    drop_tails(-1, true);
+    /* The fingerprint index is built from the files already on the disk, or when it is opened */
+    if (enable && !dedup_mode && inode_table != NULL) build_dedup_index((inode_t *) inode_table);
+    dedup_mode = enable != 0;
+}
 
-        write_blocks(disk_block_index, 1, &block);
-        break;
-    }
+/**
+ * sfs_fallocate -- Assigns zeroed data blocks to a range of the file so that writing
+ *                  to it does not need to find free blocks. The file grows if the
+ *                  range ends past the end of the file. A range that does not fit on
+ *                  the disk leaves the file as it was.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fallocate(int fileID, int64_t offset, int64_t length) {
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0 || offset < 0 || length <= 0) return -1;
+
+    drop_tails(inode, true);
+    return sync_operation(allocate_file(inode, offset, length));
 }
 
 /**
- * remove_inode -- Removes all data to the requested INode In-Memory and on the disk.
+ * sfs_punch_hole -- Frees the data blocks of a range of the file so that it is read as zeros.
+ *                   The size of the file is not changed.
  * 
- * inode_table: INode table in memory
- * index: Index of the INode to be reset
+ * fileID: file descriptor index
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns -1 or 0 if its a success
 */
-void remove_inode(inode_t* inode_table, int index) {
-    block_t temp_block;
+int sfs_punch_hole(int fileID, int64_t offset, int64_t length) {
+    int inode = get_fdt_inode(fileID);
+    if (inode < 0 || offset < 0 || length < 0) return -1;
 
-    inode_table[index].mode = 0;
-    inode_table[index].link_cnt = 0;
-    inode_table[index].size = 0;
+    drop_tails(inode, true);
+    return sync_operation(punch_file(inode, offset, length));
+}
 
-    /* Clear all data in each pointer */
-    for (int i = 0; i < INODE_POINTER_SIZE; i++) {
-        if (inode_table[index].pointers[i] < 0) break;
+/**
+ * sfs_set_discard -- Sets if the data blocks freed from now on are cleared by sfs_discard.
+ *                    The data blocks are never cleared when they are freed.
+ * 
+ * enable: clear the freed data blocks (1) or not (0)
+*/
+void sfs_set_discard(int enable) {
+    set_discard_mode(enable != 0);
+}
 
-        int block_index = inode_table[index].pointers[i];
-        memset(&temp_block, 0, BLOCK_SIZE);
-        write_blocks(block_index, 1, &temp_block);
-        reset_free_block(block_index);
-        inode_table[index].pointers[i] = -1;
-    }
+/**
+ * sfs_discard -- Clears the data blocks that have been freed since the last call and that
+ *                are still free. It can be called when the file system is idle.
+ * 
+ * returns the number of data blocks that have been cleared
+*/
+int sfs_discard() {
+    return discard_free_blocks();
+}
+
+/**
+ * sfs_batch_begin -- Starts a batch of metadata updates. The blocks of the INode table,
+ *                    the directory table and the free bitmap changed by the following calls
+ *                    are kept in memory and each of them is written once by sfs_batch_commit.
+ *                    Batches can be nested, only the outermost commit writes the blocks.
+ *                    A batch is committed early at the end of a call that leaves it holding
+ *                    more than INODE_HELD_LIMIT indirect blocks, and then goes on.
+*/
+void sfs_batch_begin() {
+    if (batch_depth++ > 0) return;
 
-    /* Clear all data in the indirect pointer */
-    if (inode_table[index].ind_pointer != -1) {
+    begin_fbm_batch();
+    begin_inode_batch();
+    begin_dir_batch();
+}
 
-        block_t ind_block, ind_inner_block;
-        read_blocks(inode_table[index].ind_pointer, 1, &ind_block);
-        memset(&ind_inner_block, 0, BLOCK_SIZE);
-        for (int i = 0; i < BLOCK_SIZE / sizeof(int); i++) {
-            int block_id = ((int *) &ind_block)[i];
-            if (block_id < 0) break;
-            write_blocks(block_id, 1, &ind_inner_block);
-            reset_free_block(block_id);
-        }
-        reset_free_block(inode_table[index].ind_pointer);
-        inode_table[index].ind_pointer = -1;
+/**
+ * sfs_batch_commit -- Ends a batch of metadata updates. The free bitmap is written first,
+ *                     then the INode table and the directory table last so that a directory
+ *                     entry on the disk never refers to an INode that has not been written.
+ *                     The counters of the superblock are checkpointed once the batch is written.
+ * 
+ * returns 0 or -1 if no batch has been started
+*/
+int sfs_batch_commit() {
+    if (batch_depth == 0) return -1;
+    if (--batch_depth > 0) return 0;
+
+    commit_fbm_batch();
+    commit_inode_batch((inode_t *) inode_table);
+    commit_dir_batch((dirent_t *) dir_table);
+    checkpoint_superblock();
+    return sync_operation(0);
+}
+
+/**
+ * sfs_statfs -- Gets the size and the free space of the file system from the counters kept
+ *               by the allocators, without reading the free bitmap.
+ * 
+ * stat: where the statistics are copied to
+ * 
+ * returns 0 or -1 if stat is NULL
+*/
+int sfs_statfs(sfs_statfs_t* stat) {
+    if (stat == NULL) return -1;
+
+    stat -> block_size = BLOCK_SIZE;
+    stat -> total_blocks = DATA_BLOCK_SIZE;
+    /* The blocks freed during a batch are only free once it is committed */
+    stat -> free_blocks = disk_counters.free_blocks - get_released_blocks();
+    stat -> used_blocks = DATA_BLOCK_SIZE - stat -> free_blocks;
+    stat -> total_inodes = INODE_LENGTH - 1;
+    stat -> free_inodes = disk_counters.free_inodes;
+    stat -> used_inodes = INODE_LENGTH - 1 - disk_counters.free_inodes;
+    stat -> free_extents = disk_counters.free_extents;
+    stat -> average_free_extent = disk_counters.free_extents > 0 ?
+        stat -> free_blocks / disk_counters.free_extents : 0;
+    return 0;
+}
+
+/**
+ * sfs_fragmentation -- Measures the fragmentation of a file as the number of runs of contiguous
+ *                      data blocks it is stored in, following the order of its pointers.
+ * 
+ * path: filename of the file
+ * 
+ * returns the number of runs, where 1 is a contiguous file and 0 a file without data blocks,
+ * or -1 if the file does not exist
+*/
+int64_t sfs_fragmentation(const char* path) {
+    int inode = find_inode_with_filename((char *) path, (dirent_t *) dir_table);
+    if (inode <= 0) return -1;
+
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    int64_t *pointers;
+    int64_t count = get_data_pointers(file, &pointers, false);
+    if (count < 0) return -1;
+
+    int64_t runs = 0;
+    block_addr_t previous = -1;
+    for (int64_t i = 0; i < count; i++) {
+        block_addr_t block_index = get_inode_block(file, pointers[i]);
+        if (i == 0 || block_index != previous + 1) runs++;
+        previous = block_index;
     }
+    free(pointers);
+
+    return runs;
+}
+
+/**
+ * sfs_defrag -- Moves the data blocks of a file into a single run of contiguous blocks. The
+ *               blocks are copied before the pointers are changed, and the old blocks are
+ *               released last, so the file always refers to either its old or its new blocks.
+ *               The blocks shared with other files are left in place.
+ * 
+ * path: filename of the file
+ * max_blocks: maximum number of blocks moved by this call, or 0 for no limit. A file that is
+ *             not done is continued by the next call, so a small limit keeps each call short
+ *             when the file system is in use.
+ * 
+ * returns the number of blocks moved, 0 once the file is contiguous or cannot be moved,
+ * or -1 if the file does not exist
+*/
+int sfs_defrag(const char* path, int max_blocks) {
+    int inode = find_inode_with_filename((char *) path, (dirent_t *) dir_table);
+    if (inode <= 0 || max_blocks < 0) return -1;
+
+    drop_tails(inode, true);
+    return sync_operation(defrag_file(inode, max_blocks));
+}
+
+/**
+ * sfs_set_log_mode -- Sets if the data blocks are written like a log. Every data block written
+ *                     from now on goes to a new block taken in order from the current segment,
+ *                     and the old block is released, so the writes are sequential. Once few
+ *                     segments are clean, the writes run the segment cleaner first, and in the
+ *                     ordered mode the metadata is also checkpointed after a number of segments.
+ * 
+ * enable: write the data blocks like a log (1) or in place (0)
+*/
+void sfs_set_log_mode(int enable) {
+    drop_tails(-1, true);
+    log_mode = enable != 0;
+    set_log_mode(log_mode);
+}
+
+/**
+ * sfs_clean -- Cleans the segments of the log that are worth it with the cost-benefit policy.
+ *              The used blocks of a segment are moved to the head of the log, so that the
+ *              whole segment can be written again. A segment that holds indirect blocks,
+ *              directory blocks or shared blocks is left in place.
+ * 
+ * max_segments: maximum number of segments cleaned by this call
+ * 
+ * returns the number of segments cleaned or -1
+*/
+int sfs_clean(int max_segments) {
+    if (max_segments < 1) return -1;
+
+    return sync_operation(clean_log_segments(max_segments));
+}
 
-    write_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, inode_table);
-}
\ No newline at end of file
+/**
+ * sfs_fsync -- Writes the data and the metadata of the file system to the storage, so that
+ *              the file of the file descriptor entry is kept if the system stops. The blocks
+ *              of a file are not tracked apart from the others, so every file is written.
+ * 
+ * fileID: file descriptor index
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fsync(int fileID) {
+    if (get_fdt_inode(fileID) < 0) return -1;
+
+    return sync_disk();
+}
+
+/**
+ * sfs_sync -- Writes the data and the metadata of the file system to the storage.
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_sync() {
+    return sync_disk();
+}
+
+/**
+ * sfs_set_durability -- Sets when the disk opened by the next call to mksfs is written to
+ *                       the storage. With SFS_DURABILITY_NONE, the operating system decides
+ *                       when the blocks are written. With SFS_DURABILITY_ORDERED, the metadata
+ *                       is held in memory and written at each call to sfs_fsync or sfs_sync,
+ *                       or once it holds many freed blocks or is a few seconds old, after the
+ *                       data blocks it refers to are on the storage. With
+ *                       SFS_DURABILITY_STRICT, each operation is on the storage when it returns.
+ * 
+ * mode: SFS_DURABILITY_NONE, SFS_DURABILITY_ORDERED or SFS_DURABILITY_STRICT
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_durability(int mode) {
+    if (mode != SFS_DURABILITY_NONE && mode != SFS_DURABILITY_ORDERED && mode != SFS_DURABILITY_STRICT) return -1;
+
+    mount_durability = mode;
+    return 0;
+}
+
+/**
+ * sfs_set_stripes -- Sets the number of image files the disk is spread across by the next
+ *                    call to mksfs. Each run of unit blocks is placed on the next image
+ *                    file, so that the large reads and writes use all of them in parallel.
+ * 
+ * members: number of image files, where 1 keeps the disk in a single image file
+ * unit: number of consecutive blocks placed on the same image file
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_stripes(int members, int unit) {
+    if (members < 1 || members > STRIPE_MAX_MEMBERS || (members > 1 && unit < 1)) return -1;
+
+    disk_members = members;
+    disk_stripe_unit = unit;
+    return 0;
+}
+
+/**
+ * sfs_set_writeback -- Sets the write-back cache of the disk opened by the next call to mksfs.
+ *                      The written blocks are held in memory, and a flusher thread writes them
+ *                      back in the order of the block numbers once they are older than expire_ms
+ *                      or once background_percent of dirty_limit blocks are dirty. A write only
+ *                      waits for the flusher once dirty_limit blocks are dirty, and sfs_fsync,
+ *                      sfs_sync and the strict mode write back every dirty block. A striped disk
+ *                      is not cached.
+ * 
+ * dirty_limit: number of dirty blocks held in memory, where 0 writes each block right away
+ * background_percent: percentage of dirty_limit, from 1 to 100, at which the flusher starts
+ * expire_ms: age in milliseconds at which a dirty block is written back
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_writeback(int dirty_limit, int background_percent, int expire_ms) {
+    if (dirty_limit < 0 || background_percent < 1 || background_percent > 100 || expire_ms < 0) return -1;
+
+    writeback_limit = dirty_limit;
+    writeback_percent = background_percent;
+    writeback_expire = expire_ms;
+    return 0;
+}
+
+/**
+ * sfs_set_geometry -- Sets the geometry of the disk created by the next call to mksfs(1).
+ *                     The geometry is stored in the superblock, so mksfs(0) reads it back.
+ *                     A disk in use takes about 5 bytes of memory per block, for the free
+ *                     bitmap and the discarded, released and reserved marks of each block.
+ * 
+ * block_size: size of a block, a power of 2 from 512 to 4096
+ * num_blocks: number of blocks of the disk
+ * inode_count: number of INodes, which is also the number of directory entries
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_geometry(int block_size, int64_t num_blocks, int inode_count) {
+    geometry_t geometry;
+    if (compute_geometry(&geometry, block_size, num_blocks, inode_count) < 0) return -1;
+
+    format_block_size = block_size;
+    format_num_blocks = num_blocks;
+    format_inode_count = inode_count;
+    return 0;
+}
+
+/**
+ * sfs_set_device -- Sets the type of block device opened by the next call to mksfs.
+ *                   A RAM disk only lives in memory, so mksfs(0) keeps the RAM disk
+ *                   that is in use and its blocks are lost when it is created again.
+ * 
+ * type: SFS_DEVICE_FILE, SFS_DEVICE_MMAP or SFS_DEVICE_RAM
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_device(int type) {
+    if (type != SFS_DEVICE_FILE && type != SFS_DEVICE_MMAP && type != SFS_DEVICE_RAM) return -1;
+
+    disk_type = type;
+    return 0;
+}
+
+/**
+ * alloc_tables -- Allocates the INode table and the directory table in memory for the
+ *                 geometry of the disk.
+*/
+void alloc_tables() {
+    free(inode_table);
+    free(dir_table);
+    inode_table = (char *) calloc(INODE_TABLE_SIZE, BLOCK_SIZE);
+    dir_table = (char *) calloc(DIR_BLOCK_SIZE, BLOCK_SIZE);
+}
+
+/**
+ * open_disk -- Opens the block device of the disk with the type set by sfs_set_device,
+ *              sfs_set_stripes and sfs_set_writeback, and uses it for every read and write.
+ * 
+ * fresh: create a new disk (true) or use an existing disk (false)
+ * 
+ * returns 0 or -1 if the block device cannot be opened
+*/
+int open_disk(bool fresh) {
+    int64_t num_blocks = disk_geometry.num_blocks;
+    block_device_t *device = get_block_device();
+
+    if (disk_type == SFS_DEVICE_RAM) {
+        if (!fresh && device != NULL && device -> type == BLOCK_DEVICE_RAM &&
+            device -> block_size == BLOCK_SIZE && device -> num_blocks == num_blocks) return 0;
+        device = open_ram_device(BLOCK_SIZE, num_blocks);
+        if (writeback_limit > 0) device = open_writeback_device(device, writeback_limit, writeback_percent, writeback_expire);
+        return set_block_device(device);
+    }
+    if (disk_members > 1)
+        return set_block_device(open_stripe_device(disk_path, disk_members, disk_stripe_unit, BLOCK_SIZE, num_blocks, fresh));
+
+    /* The dirty blocks of the disk in use are written back before its image file is created again */
+    if (fresh && device != NULL && device -> type != BLOCK_DEVICE_RAM) close_disk();
+    if (disk_type == SFS_DEVICE_MMAP) device = open_mmap_device(disk_path, BLOCK_SIZE, num_blocks, fresh);
+    else device = open_file_device(disk_path, BLOCK_SIZE, num_blocks, fresh);
+    if (writeback_limit > 0) device = open_writeback_device(device, writeback_limit, writeback_percent, writeback_expire);
+    return set_block_device(device);
+}
+
+/**
+ * set_dire_entry_table -- Sets the directory entries on the disk to the one in-memory.
+ * 
+ * inode: INode linked to the directory table
+ * dir_table: directory table in memory
+*/
+void set_dir_entry_table(inode_t inode, dirent_t* dir_table) {
+    block_t block[1];
+
+    /* The entries of the blocks that have not been assigned yet are unused */
+    for (int dir_index = 1; dir_index < DIR_ENTRY_SIZE; dir_index++)
+        dir_table[dir_index].inode = -1;
+    for (int index = 0; index < DIR_BLOCK_SIZE; index++) {
+        if (inode.pointers[index] < 0) return;
+        read_blocks(inode.pointers[index], 1, &block);
+        for (int dir_index = 0; dir_index < DIR_PER_BLOCK; dir_index++)
+            dir_table[dir_index + index * DIR_PER_BLOCK] = ((dirent_t *) &block)[dir_index];
+    }
+}
+
+/**
+ * create_file -- Creates a file and places it on the disk.
+ * 
+ * name: filename to be created
+ * inode_table: INode table in memory
+ * inode_index: index of the INode entry where the file will be referred to
+ * dir_table: directory table in memory
+ * dir_index: index of the directory entry where the filename will be referred to
+ * 
+ * returns 0 or -1 if the directory needs a block and the disk is full
+*/
+int create_file(char* name, inode_t* inode_table, int inode_index, dirent_t* dir_table, int dir_index) {
+    int pointer_index = dir_index / DIR_PER_BLOCK;
+
+    /* Assign a block to the directory when its last block is full */
+    if (inode_table[0].pointers[pointer_index] < 0) {
+        block_addr_t block_index = find_free_block();
+        if (block_index < 0) return -1;
+        inode_table[0].pointers[pointer_index] = block_index;
+    }
+
+    inode_table[0].size += sizeof(dirent_t);
+    write_inode(inode_table, 0);
+
+    /* Initializes the directory entry to the defined position */
+    insert_dir_entry(dir_table, dir_index, name, inode_index);
+    write_dir_entry(dir_table, inode_table[0].pointers[pointer_index], dir_index);
+    return 0;
+}
+
+/**
+ * remove_inode -- Removes all data to the requested INode In-Memory and on the disk.
+ *                 The data blocks are not cleared, they are released with a single
+ *                 update of the free bitmap.
+ * 
+ * inode_table: INode table in memory
+ * index: Index of the INode to be reset
+*/
+void remove_inode(inode_t* inode_table, int index) {
+    /* Collect the data blocks of each pointer and the indirect blocks */
+    block_addr_t *blocks;
+    int64_t count = collect_inode_blocks(&inode_table[index], true, &blocks);
+
+    if (inode_table[index].link_cnt != 0) update_counters(0, 0, 1);
+    count_pointer_change();
+    inode_table[index].mode = 0;
+    inode_table[index].link_cnt = 0;
+    inode_table[index].size = 0;
+    inode_table[index].flags = 0;
+    inode_table[index].ind_pointer = -1;
+    inode_table[index].dind_pointer = -1;
+    inode_table[index].tind_pointer = -1;
+    memset(inode_table[index].pointers, -1, sizeof(inode_table[index].pointers));
+    memset(inode_table[index].inline_data, 0, INODE_INLINE_SIZE);
+
+    if (count > 0) reset_free_blocks(blocks, count);
+    free(blocks);
+    write_inode(inode_table, index);
+}
+
+/**
+ * get_fdt_inode -- Gets the INode of an open file descriptor entry.
+ * 
+ * fileID: file descriptor index
+ * 
+ * returns the INode index or -1 if the entry has no file
+*/
+int get_fdt_inode(int fileID) {
+    if (fileID < 0 || fileID >= FDT_SIZE) return -1;
+    return ((fdt_t *) &fd_table)[fileID].inum;
+}
+
+/**
+ * get_iov_length -- Gets the total size of the buffers of a vector.
+ * 
+ * iov: buffers of the vector
+ * iovcnt: number of buffers
+ * 
+ * returns the total size or -1 if the vector is invalid
+*/
+int get_iov_length(const sfs_iovec_t* iov, int iovcnt) {
+    if (iov == NULL || iovcnt < 0) return -1;
+
+    int length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].length < 0) return -1;
+        length += iov[i].length;
+    }
+    return length;
+}
+
+/**
+ * copy_iov -- Copies bytes between a contiguous buffer and the buffers of a vector
+ *             as if the vector was one contiguous buffer.
+ * 
+ * iov: buffers of the vector
+ * iovcnt: number of buffers
+ * skip: number of bytes of the vector to skip before copying
+ * buffer: contiguous buffer
+ * length: number of bytes to copy
+ * to_iov: copies from the buffer to the vector (true) or from the vector to the buffer (false)
+*/
+void copy_iov(const sfs_iovec_t* iov, int iovcnt, int skip, char* buffer, int length, bool to_iov) {
+    for (int i = 0; i < iovcnt && length > 0; i++) {
+        if (skip >= iov[i].length) {
+            skip -= iov[i].length;
+            continue;
+        }
+
+        int current_length = iov[i].length - skip;
+        if (current_length > length) current_length = length;
+
+        if (to_iov) memcpy((char *) iov[i].base + skip, buffer, current_length);
+        else memcpy(buffer, (char *) iov[i].base + skip, current_length);
+
+        buffer += current_length;
+        length -= current_length;
+        skip = 0;
+    }
+}
+
+/**
+ * write_file -- Writes the buffers of a vector to the file at the given offset.
+ *               The blocks are handled in chunks where each run of contiguous
+ *               data blocks is written with a single block request. Partial blocks
+ *               at the edges of the chunk are read before being written back.
+ *               A data block shared with other pointers is copied on write, and
+ *               in deduplication mode a block whose content is already on the
+ *               disk is shared instead of written.
+ * 
+ * inode: INode of the file
+ * offset: location in the file where the vector is written
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1
+*/
+int write_file(int inode, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    int length = get_iov_length(iov, iovcnt);
+    if (length < 0) return -1;
+
+    /* The file cannot grow past the last pointer of the INode */
+    if (length > INODE_MAX_FILE_SIZE - offset)
+        length = INODE_MAX_FILE_SIZE - offset;
+    if (length <= 0) return 0;
+
+    if (file -> flags & INODE_FLAG_INLINE) {
+        if (offset + length <= INODE_INLINE_SIZE) {
+            /* If the file still fits in the INode, only the INode is written */
+            copy_iov(iov, iovcnt, 0, file -> inline_data + offset, length, false);
+            if (offset + length > file -> size) file -> size = offset + length;
+            write_inode((inode_t *) inode_table, inode);
+            return length;
+        }
+
+        /* If the file outgrows the INode, the inline data is moved to a data block */
+        if (uninline_file(inode) < 0) return -1;
+    }
+
+    char *buffer = (char *) malloc(IO_CHUNK_BLOCKS * BLOCK_SIZE);
+    block_addr_t map[IO_CHUNK_BLOCKS + 2 * COMPRESS_CLUSTER_BLOCKS];
+    block_addr_t *blocks;
+    bool skip[IO_CHUNK_BLOCKS];
+    uint64_t hashes[IO_CHUNK_BLOCKS];
+    int written = 0;
+
+    /* The blocks of compressed files are not shared since they are written in place */
+    bool dedup = dedup_mode && !(file -> flags & INODE_FLAG_COMPRESS);
+
+    while (written < length) {
+        int64_t position = offset + written;
+        int64_t pointer_index = position / BLOCK_SIZE;
+        int block_offset = position % BLOCK_SIZE;
+
+        /* Gets how many bytes and blocks are handled in this chunk */
+        int current_length = length - written;
+        if (current_length > IO_CHUNK_BLOCKS * BLOCK_SIZE - block_offset)
+            current_length = IO_CHUNK_BLOCKS * BLOCK_SIZE - block_offset;
+        int nblocks = (block_offset + current_length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        /* Expands the compressed clusters that are overwritten by the chunk */
+        int64_t first = get_cluster_map(file, pointer_index, nblocks, map);
+        blocks = map + (pointer_index - first);
+        bool expanded = true;
+        for (int i = 0; i < pointer_index + nblocks - first && expanded; i += COMPRESS_CLUSTER_BLOCKS)
+            if (is_compressed_cluster(map + i))
+                expanded = expand_cluster(file, (first + i) / COMPRESS_CLUSTER_BLOCKS) == 0;
+        if (!expanded) break;
+        get_inode_blocks(file, pointer_index, nblocks, blocks);
+
+        /* The indirect blocks are allocated first so that the placed blocks can always be assigned */
+        if (reserve_inode_blocks(file, pointer_index, nblocks) < 0) {
+            if (reuse_released_blocks(inode)) continue;
+            break;
+        }
+
+        /* Reads the partial blocks at the edges of the chunk */
+        int last = nblocks - 1;
+        int end_offset = (block_offset + current_length) % BLOCK_SIZE;
+        if (block_offset > 0)
+            load_block(blocks[0], buffer);
+        if (end_offset > 0 && (last > 0 || block_offset == 0))
+            load_block(blocks[last], buffer + last * BLOCK_SIZE);
+
+        copy_iov(iov, iovcnt, written, buffer + block_offset, current_length, false);
+
+        /* Places every block of the chunk */
+        for (int i = 0; i < nblocks; i++) {
+            char *data = buffer + i * BLOCK_SIZE;
+            skip[i] = false;
+
+            if (dedup) {
+                /* A data block that already has the same content is shared instead of written */
+                hashes[i] = hash_block(data);
+                block_addr_t shared = find_dedup_block(data, hashes[i]);
+                /* The blocks placed before in the chunk are written afterwards, so their content
+                   on the disk is about to change */
+                for (int k = 0; k < i && shared >= 0; k++)
+                    if (!skip[k] && blocks[k] == shared) shared = -1;
+                if (shared >= 0 && (shared == blocks[i] || ref_block(shared) == 0)) {
+                    if (blocks[i] >= 0 && shared != blocks[i]) reset_free_block(blocks[i]);
+                    blocks[i] = shared;
+                    skip[i] = true;
+                    continue;
+                }
+            }
+
+            /* A data block that is only referred by this pointer is written in place, except in
+               log mode where every block written goes to the head of the log */
+            if (blocks[i] >= 0 && get_block_refs(blocks[i]) == 1 && !log_mode) continue;
+
+            /* Otherwise a new data block is assigned, and a shared data block is copied on write */
+            block_addr_t block_index = find_free_block();
+            if (block_index < 0) {
+                /* If the disk is full, only the blocks that have been placed are written */
+                nblocks = i;
+                current_length = nblocks * BLOCK_SIZE - block_offset;
+                break;
+            }
+            if (blocks[i] >= 0) reset_free_block(blocks[i]);
+            blocks[i] = block_index;
+        }
+        if (current_length <= 0 || set_inode_blocks(file, pointer_index, nblocks, blocks) < 0) {
+            /* Once the disk is full, the blocks freed since the last sync point are used when the
+               chunk has placed nothing, so that the committed metadata refers to no block it has released */
+            if (current_length <= 0 && reuse_released_blocks(inode)) continue;
+            break;
+        }
+
+        /* Writes each run of contiguous data blocks with a single request */
+        for (int i = 0; i < nblocks;) {
+            int run = 1;
+            if (!skip[i]) {
+                while (i + run < nblocks && !skip[i + run] && blocks[i + run] == blocks[i] + run) run++;
+                write_blocks(blocks[i], run, buffer + i * BLOCK_SIZE);
+                for (int j = i; j < i + run && dedup; j++)
+                    insert_dedup_block(blocks[j], hashes[j]);
+            }
+            i += run;
+        }
+
+        /* A write that has not placed any block does not grow the file */
+        written += current_length;
+        if (offset + written > file -> size) file -> size = offset + written;
+    }
+    free(buffer);
+
+    write_inode((inode_t *) inode_table, inode);
+
+    return written;
+}
+
+/**
+ * read_file -- Reads the file at the given offset and scatters it into the buffers
+ *              of a vector. The blocks are handled in chunks where each run of
+ *              contiguous data blocks is read with a single block request, and
+ *              pointers without a data block are read as zeros.
+ * 
+ * inode: INode of the file
+ * offset: location in the file where the read starts
+ * iov: buffers to be written on with the file's data
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes read or -1
+*/
+int read_file(int inode, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    int length = get_iov_length(iov, iovcnt);
+    if (length < 0) return -1;
+
+    /* The read stops at the end of the file */
+    if (length > file -> size - offset) length = file -> size - offset;
+    if (length <= 0) return 0;
+
+    /* Inline data is served from the INode table in memory */
+    if (file -> flags & INODE_FLAG_INLINE) {
+        copy_iov(iov, iovcnt, 0, file -> inline_data + offset, length, true);
+        return length;
+    }
+
+    char *buffer = (char *) malloc(IO_CHUNK_BLOCKS * BLOCK_SIZE);
+    char *cluster_buffer = NULL;
+    block_addr_t map[IO_CHUNK_BLOCKS + 2 * COMPRESS_CLUSTER_BLOCKS];
+    int read = 0;
+
+    while (read < length) {
+        int64_t position = offset + read;
+        int64_t pointer_index = position / BLOCK_SIZE;
+        int block_offset = position % BLOCK_SIZE;
+
+        /* Gets how many bytes and blocks are handled in this chunk */
+        int current_length = length - read;
+        if (current_length > IO_CHUNK_BLOCKS * BLOCK_SIZE - block_offset)
+            current_length = IO_CHUNK_BLOCKS * BLOCK_SIZE - block_offset;
+        int nblocks = (block_offset + current_length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        int64_t first = get_cluster_map(file, pointer_index, nblocks, map);
+        block_addr_t *blocks = map + (pointer_index - first);
+
+        for (int i = 0; i < nblocks;) {
+            int run = 1;
+            int cluster_start = (pointer_index + i) / COMPRESS_CLUSTER_BLOCKS * COMPRESS_CLUSTER_BLOCKS - first;
+
+            if (is_compressed_cluster(map + cluster_start)) {
+                /* Only the clusters touched by the read are decompressed */
+                if (cluster_buffer == NULL) cluster_buffer = (char *) malloc(COMPRESS_CLUSTER_SIZE);
+                if (read_compressed_cluster(map + cluster_start, cluster_buffer) < 0) {
+                    read = -1;
+                    break;
+                }
+
+                int slot = pointer_index + i - first - cluster_start;
+                run = COMPRESS_CLUSTER_BLOCKS - slot;
+                if (run > nblocks - i) run = nblocks - i;
+                memcpy(buffer + i * BLOCK_SIZE, cluster_buffer + slot * BLOCK_SIZE, run * BLOCK_SIZE);
+            } else if (blocks[i] < 0) {
+                memset(buffer + i * BLOCK_SIZE, 0, BLOCK_SIZE);
+            } else {
+                /* Reads each run of contiguous data blocks with a single request, which stops
+                   before a compressed cluster even if its first block comes next on the disk */
+                while (i + run < nblocks && blocks[i + run] == blocks[i] + run &&
+                    !((pointer_index + i + run) % COMPRESS_CLUSTER_BLOCKS == 0 &&
+                      is_compressed_cluster(blocks + i + run))) run++;
+                read_blocks(blocks[i], run, buffer + i * BLOCK_SIZE);
+            }
+            i += run;
+        }
+        if (read < 0) break;
+
+        copy_iov(iov, iovcnt, read, buffer + block_offset, current_length, true);
+        read += current_length;
+    }
+    free(buffer);
+    free(cluster_buffer);
+
+    return read;
+}
+
+/**
+ * get_cluster_map -- Gets the data blocks of a range of pointers extended to whole
+ *                    compression clusters.
+ * 
+ * inode: INode of the file
+ * pointer_index: index of the first pointer of the range
+ * count: number of pointers of the range
+ * map: buffer where the data block indices are copied to
+ * 
+ * returns the index of the first pointer copied to the map
+*/
+int64_t get_cluster_map(inode_t* inode, int64_t pointer_index, int count, block_addr_t* map) {
+    int64_t first = pointer_index - pointer_index % COMPRESS_CLUSTER_BLOCKS;
+    int64_t last = pointer_index + count + COMPRESS_CLUSTER_BLOCKS - 1;
+    last -= last % COMPRESS_CLUSTER_BLOCKS;
+
+    get_inode_blocks(inode, first, last - first, map);
+    return first;
+}
+
+/**
+ * mark_compress_range -- Records the compression clusters written through a file
+ *                        descriptor entry so that they are compressed when it is closed.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the write started
+ * length: number of bytes written
+*/
+void mark_compress_range(int fileID, int64_t offset, int length) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    if (length <= 0 || !(((inode_t *) inode_table)[entry -> inum].flags & INODE_FLAG_COMPRESS)) return;
+
+    int64_t start = offset / COMPRESS_CLUSTER_SIZE;
+    int64_t end = (offset + length - 1) / COMPRESS_CLUSTER_SIZE;
+    if (entry -> compress_start < 0 || start < entry -> compress_start) entry -> compress_start = start;
+    if (end > entry -> compress_end) entry -> compress_end = end;
+}
+
+/**
+ * compress_file -- Compresses the requested clusters of a file. The compression is done when
+ *                  the file is closed so that it is kept out of the sfs_fwrite calls.
+ * 
+ * inode: INode of the file
+ * start: index of the first cluster
+ * end: index of the last cluster
+*/
+void compress_file(int inode, int64_t start, int64_t end) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    if (start < 0 || !(file -> flags & INODE_FLAG_COMPRESS) || (file -> flags & INODE_FLAG_INLINE)) return;
+
+    int freed = 0;
+    for (int64_t cluster = start; cluster <= end && cluster * COMPRESS_CLUSTER_BLOCKS < INODE_MAX_POINTERS; cluster++)
+        freed += compress_cluster(file, cluster);
+
+    if (freed > 0) write_inode((inode_t *) inode_table, inode);
+}
+
+/**
+ * load_block -- Reads a data block, or sets the buffer to zeros if no data block is assigned.
+ * 
+ * block_index: index of the data block
+ * buffer: buffer where the data block is copied to
+*/
+void load_block(block_addr_t block_index, char* buffer) {
+    if (block_index < 0) memset(buffer, 0, BLOCK_SIZE);
+    else read_blocks(block_index, 1, buffer);
+}
+
+/**
+ * uninline_file -- Moves the data inlined in the INode to a data block.
+ * 
+ * inode: INode of the file
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int uninline_file(int inode) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    if (!(file -> flags & INODE_FLAG_INLINE)) return 0;
+
+    char inline_data[INODE_INLINE_SIZE];
+    sfs_iovec_t inline_iov = { .base = inline_data, .length = file -> size };
+    memcpy(inline_data, file -> inline_data, INODE_INLINE_SIZE);
+
+    file -> flags &= ~INODE_FLAG_INLINE;
+    memset(file -> inline_data, 0, INODE_INLINE_SIZE);
+    file -> size = 0;
+    if (inline_iov.length > 0 && write_file(inode, 0, &inline_iov, 1) < inline_iov.length) return -1;
+
+    write_inode((inode_t *) inode_table, inode);
+    return 0;
+}
+
+/**
+ * allocate_file -- Assigns a data block to every pointer of a range of the file that
+ *                  does not have one. The new data blocks are set to zeros where each
+ *                  run of contiguous data blocks is written with a single block request.
+ *                  The pointers assigned are holes again if the range cannot be allocated.
+ * 
+ * inode: INode of the file
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int allocate_file(int inode, int64_t offset, int64_t length) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    if (length > INODE_MAX_FILE_SIZE - offset) return -1;
+
+    int64_t end = offset + length;
+    if ((file -> flags & INODE_FLAG_INLINE) && end > INODE_INLINE_SIZE && uninline_file(inode) < 0) return -1;
+
+    int result = 0;
+    int64_t size = file -> size;
+    if (!(file -> flags & INODE_FLAG_INLINE)) {
+        char *zeros = (char *) calloc(IO_CHUNK_BLOCKS, BLOCK_SIZE);
+        block_addr_t map[IO_CHUNK_BLOCKS + 2 * COMPRESS_CLUSTER_BLOCKS];
+        bool fresh[IO_CHUNK_BLOCKS];
+
+        /* The pointers assigned so far, which are holes again if the range cannot be allocated */
+        int64_t *assigned = NULL;
+        int64_t count = 0, capacity = 0;
+
+        for (int64_t pointer_index = offset / BLOCK_SIZE; pointer_index * BLOCK_SIZE < end && result == 0;) {
+            int64_t remaining = (end - pointer_index * BLOCK_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            int nblocks = remaining > IO_CHUNK_BLOCKS ? IO_CHUNK_BLOCKS : remaining;
+
+            /* The indirect blocks are allocated first so that the new blocks can always be assigned */
+            if (reserve_inode_blocks(file, pointer_index, nblocks) < 0) {
+                if (pointer_index * BLOCK_SIZE > file -> size) file -> size = pointer_index * BLOCK_SIZE;
+                if (reuse_released_blocks(inode)) continue;
+                result = -1;
+                break;
+            }
+
+            int64_t first = get_cluster_map(file, pointer_index, nblocks, map);
+            block_addr_t *blocks = map + (pointer_index - first);
+
+            /* The slots saved by a compressed cluster already hold data */
+            for (int i = 0; i < nblocks; i++) {
+                fresh[i] = blocks[i] == -1;
+                if (!fresh[i]) continue;
+
+                blocks[i] = find_free_block();
+                if (blocks[i] < 0 && pointer_index * BLOCK_SIZE > file -> size) file -> size = pointer_index * BLOCK_SIZE;
+                if (blocks[i] < 0 && reuse_released_blocks(inode)) blocks[i] = find_free_block();
+                if (blocks[i] < 0) {
+                    nblocks = i;
+                    result = -1;
+                    break;
+                }
+            }
+            if (set_inode_blocks(file, pointer_index, nblocks, blocks) < 0) {
+                for (int i = 0; i < nblocks; i++)
+                    if (fresh[i]) reset_free_block(blocks[i]);
+                result = -1;
+                break;
+            }
+
+            for (int i = 0; i < nblocks;) {
+                int run = 1;
+                if (fresh[i]) {
+                    while (i + run < nblocks && fresh[i + run] && blocks[i + run] == blocks[i] + run) run++;
+                    write_blocks(blocks[i], run, zeros);
+                }
+                i += run;
+            }
+
+            if (count + nblocks > capacity) {
+                capacity = (count + nblocks) * 2;
+                assigned = (int64_t *) realloc(assigned, capacity * sizeof(int64_t));
+            }
+            for (int i = 0; i < nblocks; i++)
+                if (fresh[i]) assigned[count++] = pointer_index + i;
+            pointer_index += nblocks;
+        }
+
+        /* A range that does not fit leaves the file as it was */
+        if (result < 0) {
+            for (int64_t i = 0; i < count; i++) {
+                reset_free_block(get_inode_block(file, assigned[i]));
+                set_inode_block(file, assigned[i], -1);
+            }
+            prune_inode_blocks(file);
+            file -> size = size;
+        }
+        free(assigned);
+        free(zeros);
+    }
+
+    if (result == 0 && end > file -> size) file -> size = end;
+    write_inode((inode_t *) inode_table, inode);
+
+    return result;
+}
+
+/**
+ * punch_file -- Sets a range of the file to zeros without changing its size. The data blocks
+ *               that are entirely in the range are freed and their pointers become holes,
+ *               while the partial blocks at the edges of the range are written with zeros.
+ * 
+ * inode: INode of the file
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int punch_file(int inode, int64_t offset, int64_t length) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    if (length > INODE_MAX_FILE_SIZE - offset) length = INODE_MAX_FILE_SIZE - offset;
+    if (length <= 0) return 0;
+
+    int64_t end = offset + length;
+    if (file -> flags & INODE_FLAG_INLINE) {
+        if (offset < INODE_INLINE_SIZE)
+            memset(file -> inline_data + offset, 0, (end < INODE_INLINE_SIZE ? end : INODE_INLINE_SIZE) - offset);
+        write_inode((inode_t *) inode_table, inode);
+        return 0;
+    }
+
+    /* The partial blocks at the edges are written with zeros */
+    int64_t first_full = (offset + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int64_t last_full = end / BLOCK_SIZE;
+    if (first_full > last_full) {
+        zero_range(inode, offset, length);
+    } else {
+        if (offset % BLOCK_SIZE > 0) zero_range(inode, offset, first_full * BLOCK_SIZE - offset);
+        if (end % BLOCK_SIZE > 0) zero_range(inode, last_full * BLOCK_SIZE, end - last_full * BLOCK_SIZE);
+    }
+
+    /* The data blocks that are entirely in the range are freed */
+    block_addr_t map[IO_CHUNK_BLOCKS + 2 * COMPRESS_CLUSTER_BLOCKS];
+    for (int64_t pointer_index = first_full; pointer_index < last_full;) {
+        int nblocks = last_full - pointer_index > IO_CHUNK_BLOCKS ? IO_CHUNK_BLOCKS : last_full - pointer_index;
+
+        int64_t first = get_cluster_map(file, pointer_index, nblocks, map);
+        bool expanded = false;
+        for (int i = 0; i < pointer_index + nblocks - first; i += COMPRESS_CLUSTER_BLOCKS) {
+            /* A compressed cluster partly in the range is decompressed so that its pointers can be freed */
+            bool whole = first + i >= pointer_index && first + i + COMPRESS_CLUSTER_BLOCKS <= pointer_index + nblocks;
+            if (is_compressed_cluster(map + i) && !whole) {
+                if (expand_cluster(file, (first + i) / COMPRESS_CLUSTER_BLOCKS) < 0) return -1;
+                expanded = true;
+            }
+        }
+        if (expanded) get_inode_blocks(file, pointer_index, nblocks, map + (pointer_index - first));
+
+        block_addr_t *blocks = map + (pointer_index - first);
+        block_addr_t freed[IO_CHUNK_BLOCKS];
+        int count = 0;
+        for (int i = 0; i < nblocks; i++) {
+            if (blocks[i] >= 0) freed[count++] = blocks[i];
+            blocks[i] = -1;
+        }
+        set_inode_blocks(file, pointer_index, nblocks, blocks);
+        reset_free_blocks(freed, count);
+        pointer_index += nblocks;
+    }
+
+    /* The indirect blocks are freed once all of their pointers are holes */
+    prune_inode_blocks(file);
+
+    write_inode((inode_t *) inode_table, inode);
+    return 0;
+}
+
+/**
+ * zero_range -- Writes zeros to a range of the file that is inside a single block. Nothing is
+ *               written if the block is a hole. The zeros are written past the end of the file
+ *               as well so that the file does not read old data if it grows, but the size of
+ *               the file is not changed.
+ * 
+ * inode: INode of the file
+ * offset: location in the file where the range starts
+ * length: size of the range
+*/
+void zero_range(int inode, int64_t offset, int length) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    block_addr_t map[2 * COMPRESS_CLUSTER_BLOCKS];
+    int64_t pointer_index = offset / BLOCK_SIZE;
+
+    int64_t first = get_cluster_map(file, pointer_index, 1, map);
+    if (map[pointer_index - first] == -1) return;
+
+    char zeros[BLOCK_SIZE];
+    memset(zeros, 0, BLOCK_SIZE);
+    sfs_iovec_t iov = { .base = zeros, .length = length };
+
+    int64_t size = file -> size;
+    write_file(inode, offset, &iov, 1);
+    file -> size = size;
+}
+
+/**
+ * get_data_pointers -- Gets the index of each pointer of the file that has a data block,
+ *                      in the order of the file.
+ * 
+ * inode: INode of the file
+ * pointers: where the list of pointer indices is returned, to be freed by the caller
+ * movable: only keep the data blocks that are not shared with another file
+ * 
+ * returns the number of pointers or -1 if the list cannot be allocated
+*/
+int64_t get_data_pointers(inode_t* inode, int64_t** pointers, bool movable) {
+    int64_t capacity = IO_CHUNK_BLOCKS, count = 0;
+    int64_t end = (inode -> size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    block_addr_t blocks[IO_CHUNK_BLOCKS];
+
+    *pointers = (int64_t *) malloc(capacity * sizeof(int64_t));
+    if (*pointers == NULL) return -1;
+    if (inode -> flags & INODE_FLAG_INLINE) return 0;
+
+    for (int64_t pointer_index = 0; pointer_index < end; pointer_index += IO_CHUNK_BLOCKS) {
+        int nblocks = end - pointer_index > IO_CHUNK_BLOCKS ? IO_CHUNK_BLOCKS : end - pointer_index;
+        get_inode_blocks(inode, pointer_index, nblocks, blocks);
+
+        for (int i = 0; i < nblocks; i++) {
+            /* Holes and the slots saved by a compressed cluster have no data block */
+            if (blocks[i] < 0 || (movable && get_block_refs(blocks[i]) > 1)) continue;
+
+            if (count == capacity) {
+                int64_t *grown = (int64_t *) realloc(*pointers, 2 * capacity * sizeof(int64_t));
+                if (grown == NULL) {
+                    free(*pointers);
+                    return -1;
+                }
+                *pointers = grown;
+                capacity *= 2;
+            }
+            (*pointers)[count++] = pointer_index + i;
+        }
+    }
+    return count;
+}
+
+/**
+ * defrag_file -- Moves the data blocks of a file that are not shared into a single run. The
+ *                run continues the blocks at the start of the file that are already contiguous
+ *                when the blocks after them are available, otherwise the whole file is moved
+ *                to the first run of available blocks that is long enough. Each chunk of blocks
+ *                is copied with a single write, then its pointers are changed and the old
+ *                blocks are released.
+ * 
+ * inode: INode of the file
+ * max_blocks: maximum number of blocks moved, or 0 for no limit
+ * 
+ * returns the number of blocks moved or -1
+*/
+int defrag_file(int inode, int max_blocks) {
+    inode_t *file = &((inode_t *) inode_table)[inode];
+    int64_t *pointers;
+    int64_t count = get_data_pointers(file, &pointers, true);
+    if (count <= 0) {
+        if (count == 0) free(pointers);
+        return count;
+    }
+
+    block_addr_t *blocks = (block_addr_t *) malloc(count * sizeof(block_addr_t));
+    for (int64_t i = 0; i < count; i++)
+        blocks[i] = get_inode_block(file, pointers[i]);
+
+    /* The blocks at the start of the file that are already contiguous stay in place */
+    int64_t done = 1;
+    while (done < count && blocks[done] == blocks[0] + done) done++;
+
+    block_addr_t target = -1;
+    if (done < count) {
+        if (take_free_run(blocks[0] + done, count - done) == 0) {
+            target = blocks[0] + done;
+        } else {
+            done = 0;
+            target = find_free_run(count);
+        }
+    }
+    if (target < 0) {
+        free(blocks);
+        free(pointers);
+        return 0;
+    }
+
+    int64_t todo = count - done;
+    if (max_blocks > 0 && todo > max_blocks) todo = max_blocks;
+
+    char *buffer = (char *) malloc(IO_CHUNK_BLOCKS * BLOCK_SIZE);
+    block_addr_t old_blocks[IO_CHUNK_BLOCKS];
+    for (int64_t moved = 0; moved < todo;) {
+        int nblocks = todo - moved > IO_CHUNK_BLOCKS ? IO_CHUNK_BLOCKS : todo - moved;
+        int64_t first = done + moved;
+        block_addr_t destination = target + moved;
+
+        /* Reads each run of contiguous old blocks with a single request */
+        for (int i = 0; i < nblocks;) {
+            int run = 1;
+            while (i + run < nblocks && blocks[first + i + run] == blocks[first + i] + run) run++;
+            read_blocks(blocks[first + i], run, buffer + i * BLOCK_SIZE);
+            i += run;
+        }
+        write_blocks(destination, nblocks, buffer);
+
+        /* Each run of consecutive pointers is changed with a single update of the INode */
+        for (int i = 0; i < nblocks; i++) {
+            old_blocks[i] = blocks[first + i];
+            blocks[first + i] = destination + i;
+        }
+        for (int i = 0; i < nblocks;) {
+            int run = 1;
+            while (i + run < nblocks && pointers[first + i + run] == pointers[first + i] + run) run++;
+            set_inode_blocks(file, pointers[first + i], run, &blocks[first + i]);
+            i += run;
+        }
+        write_inode((inode_t *) inode_table, inode);
+
+        reset_free_blocks(old_blocks, nblocks);
+        for (int i = 0; i < nblocks && dedup_mode; i++) {
+            remove_dedup_block(old_blocks[i]);
+            insert_dedup_block(destination + i, hash_block(buffer + i * BLOCK_SIZE));
+        }
+        moved += nblocks;
+    }
+    free(buffer);
+
+    /* The part of the run that has not been used is released */
+    for (int64_t i = todo; i < count - done; i++)
+        reset_free_block(target + i);
+
+    free(blocks);
+    free(pointers);
+    return todo;
+}
+
+/**
+ * sync_disk -- Writes the blocks of the disk to the storage. In the ordered mode, the data
+ *              blocks are flushed before the metadata held in memory is written and flushed,
+ *              so that the metadata on the storage never refers to a data block that is not.
+ *              The metadata of a batch started by sfs_batch_begin is kept until its commit.
+ * 
+ * returns 0 or -1 if the storage cannot be written
+*/
+int sync_disk() {
+    flush_tails(-1);
+    if (durability_mode == SFS_DURABILITY_ORDERED && batch_depth == 1) return commit_ordered_batch();
+
+    /* The counters are only checkpointed once the metadata they describe has been written */
+    if (batch_depth == 0) checkpoint_superblock();
+    return flush_blocks();
+}
+
+/**
+ * commit_ordered_batch -- Writes the metadata held in memory by the ordered mode once the data
+ *                         blocks have been flushed, flushes it and starts holding the metadata again.
+ * 
+ * returns 0 or -1 if the storage cannot be written
+*/
+int commit_ordered_batch() {
+    if (flush_blocks() < 0) return -1;
+    sfs_batch_commit();
+    int result = flush_blocks();
+    sfs_batch_begin();
+    ordered_commit_time = get_time();
+    return result;
+}
+
+/**
+ * reuse_released_blocks -- Commits the metadata held by the ordered mode once the disk is full,
+ *                          since the blocks freed since the last sync point cannot be used again
+ *                          before. The INode of the file being written is committed with it.
+ * 
+ * inode: INode of the file being written
+ * 
+ * returns true if freed blocks can now be used
+*/
+bool reuse_released_blocks(int inode) {
+    if (durability_mode != SFS_DURABILITY_ORDERED || batch_depth != 1 || get_released_blocks() == 0) return false;
+
+    write_inode((inode_t *) inode_table, inode);
+    commit_ordered_batch();
+    return get_released_blocks() == 0;
+}
+
+/**
+ * sync_operation -- Ends an operation that has changed the disk. The batch is committed if it
+ *                   has grown too large or, in the ordered mode, too old, and in the strict mode,
+ *                   the blocks written by the operation are flushed before it returns.
+ * 
+ * result: result of the operation
+ * 
+ * returns the result of the operation, or -1 if the blocks cannot be flushed
+*/
+int sync_operation(int result) {
+    bound_batch();
+    if (durability_mode == SFS_DURABILITY_STRICT && flush_blocks() < 0) return -1;
+    return result;
+}
+
+/**
+ * bound_batch -- Commits the batch that is open, whatever its depth, once it holds too many
+ *                indirect blocks in memory, and starts holding the metadata again. In the
+ *                ordered mode, the data blocks are flushed first as at a sync point, and the
+ *                metadata held outside a batch of the caller is also committed once enough
+ *                blocks have been freed or once it is older than ORDERED_MAX_AGE.
+*/
+void bound_batch() {
+    if (batch_depth == 0) return;
+
+    bool ordered = durability_mode == SFS_DURABILITY_ORDERED && batch_depth == 1 &&
+        (get_released_blocks() >= ORDERED_MAX_RELEASED || get_time() - ordered_commit_time >= ORDERED_MAX_AGE);
+    if (!ordered && get_held_blocks() < INODE_HELD_LIMIT) return;
+
+    int depth = batch_depth;
+    batch_depth = 1;
+    if (durability_mode == SFS_DURABILITY_ORDERED) {
+        sync_disk();
+    } else {
+        sfs_batch_commit();
+        sfs_batch_begin();
+    }
+    batch_depth = depth;
+}
+
+/**
+ * clean_log_segments -- Moves the used blocks of the chosen segments to the head of the log.
+ *                       Each segment is read with a single request, its used blocks are
+ *                       written in order at the head of the log, then the pointers are
+ *                       changed and the old blocks are released.
+ * 
+ * max_segments: maximum number of segments cleaned
+ * 
+ * returns the number of segments cleaned
+*/
+int clean_log_segments(int max_segments) {
+    drop_tails(-1, true);
+    block_addr_t *starts = (block_addr_t *) malloc(max_segments * sizeof(block_addr_t));
+    int chosen = choose_segments(max_segments, starts);
+    int64_t slots = (int64_t) chosen * LOG_SEGMENT_BLOCKS;
+
+    /* Finds the file and the pointer of each data block of the chosen segments */
+    int *owners = (int *) malloc((slots + 1) * sizeof(int));
+    int64_t *owner_pointers = (int64_t *) malloc((slots + 1) * sizeof(int64_t));
+    for (int64_t i = 0; i < slots; i++)
+        owners[i] = -1;
+
+    for (int inode = 1; inode < INODE_LENGTH && chosen > 0; inode++) {
+        inode_t *file = &((inode_t *) inode_table)[inode];
+        if (file -> link_cnt == 0) continue;
+
+        int64_t *pointers;
+        int64_t count = get_data_pointers(file, &pointers, false);
+        if (count < 0) continue;
+
+        for (int64_t i = 0; i < count; i++) {
+            block_addr_t block_index = get_inode_block(file, pointers[i]);
+            for (int k = 0; k < chosen; k++) {
+                if (block_index < starts[k] || block_index >= starts[k] + LOG_SEGMENT_BLOCKS) continue;
+
+                /* A block referred by more than one pointer is not moved */
+                int64_t slot = (int64_t) k * LOG_SEGMENT_BLOCKS + (block_index - starts[k]);
+                owners[slot] = owners[slot] == -1 ? inode : -2;
+                owner_pointers[slot] = pointers[i];
+            }
+        }
+        free(pointers);
+    }
+
+    char *buffer = (char *) malloc(LOG_SEGMENT_BLOCKS * BLOCK_SIZE);
+    block_addr_t sources[LOG_SEGMENT_BLOCKS], destinations[LOG_SEGMENT_BLOCKS];
+    int moved_slots[LOG_SEGMENT_BLOCKS];
+    int cleaned = 0;
+
+    for (int k = 0; k < chosen; k++) {
+        int *owner = &owners[(int64_t) k * LOG_SEGMENT_BLOCKS];
+        int64_t *owner_pointer = &owner_pointers[(int64_t) k * LOG_SEGMENT_BLOCKS];
+
+        /* Every used block of the segment must be the data block of a single file */
+        int live = 0;
+        bool movable = true;
+        for (int i = 0; i < LOG_SEGMENT_BLOCKS && movable; i++) {
+            if (get_block_refs(starts[k] + i) == 0) continue;
+            movable = owner[i] >= 0 && get_block_refs(starts[k] + i) == 1;
+            sources[live] = starts[k] + i;
+            moved_slots[live++] = i;
+        }
+        if (!movable) continue;
+
+        /* Takes the new blocks first so that the segment is left untouched if the log is full */
+        int taken = 0;
+        while (taken < live && (destinations[taken] = find_log_block()) >= 0) taken++;
+        if (taken < live) {
+            reset_free_blocks(destinations, taken);
+            break;
+        }
+
+        /* The used blocks are packed in order and each run of new blocks is written with a single request */
+        read_blocks(starts[k], LOG_SEGMENT_BLOCKS, buffer);
+        for (int i = 0; i < live; i++)
+            memmove(buffer + i * BLOCK_SIZE, buffer + moved_slots[i] * BLOCK_SIZE, BLOCK_SIZE);
+        for (int i = 0; i < live;) {
+            int run = 1;
+            while (i + run < live && destinations[i + run] == destinations[i] + run) run++;
+            write_blocks(destinations[i], run, buffer + i * BLOCK_SIZE);
+            i += run;
+        }
+
+        for (int i = 0; i < live; i++) {
+            int inode = owner[moved_slots[i]];
+            set_inode_block(&((inode_t *) inode_table)[inode], owner_pointer[moved_slots[i]], destinations[i]);
+            write_inode((inode_t *) inode_table, inode);
+        }
+        reset_free_blocks(sources, live);
+        for (int i = 0; i < live && dedup_mode; i++) {
+            remove_dedup_block(sources[i]);
+            insert_dedup_block(destinations[i], hash_block(buffer + i * BLOCK_SIZE));
+        }
+        cleaned++;
+    }
+
+    free(buffer);
+    free(owners);
+    free(owner_pointers);
+    free(starts);
+    return cleaned;
+}
+
+/**
+ * maintain_log -- Runs the background work of the log mode between two writes. In the ordered
+ *                 mode, the metadata is checkpointed each time the log has filled a few segments,
+ *                 or once a segment worth of blocks has been freed when the log runs short of
+ *                 clean segments, since the freed blocks cannot be used again before. The cleaner
+ *                 then runs once few segments are clean, and is not tried again until the head
+ *                 of the log has moved if it has found nothing to clean.
+*/
+void maintain_log() {
+    if (!log_mode) return;
+
+    bool short_of_segments = get_clean_segments() < LOG_MIN_CLEAN_SEGMENTS;
+    if (durability_mode == SFS_DURABILITY_ORDERED && batch_depth == 1 &&
+        (get_log_clock() - log_checkpoint >= LOG_CHECKPOINT_SEGMENTS ||
+        (short_of_segments && get_released_blocks() >= LOG_SEGMENT_BLOCKS))) {
+        sync_disk();
+        log_checkpoint = get_log_clock();
+        short_of_segments = get_clean_segments() < LOG_MIN_CLEAN_SEGMENTS;
+    }
+
+    int64_t clock = get_log_clock();
+    if (short_of_segments && clock != log_clean_failed)
+        if (clean_log_segments(LOG_CLEAN_STEP) == 0) log_clean_failed = clock;
+}
+
+/**
+ * release_disk -- Writes the metadata held in memory for the disk opened by the thread,
+ *                 checkpoints its counters, closes it and frees its tables in memory.
+*/
+void release_disk() {
+    drop_tails(-1, true);
+    if (batch_depth > 0) {
+        batch_depth = 1;
+        sfs_batch_commit();
+    }
+    if (get_block_device() != NULL) sync_disk();
+    close_disk();
+
+    free(inode_table);
+    free(dir_table);
+    inode_table = dir_table = NULL;
+    free_fbm();
+    free_dedup_index();
+}
+
+/**
+ * map_block -- Gets the data block of a pointer of the file of a file descriptor entry. The
+ *              last pointer resolved through the entry is kept with it, and is only looked up
+ *              again once the pointers of an INode have changed.
+ * 
+ * fileID: file descriptor index
+ * pointer_index: index of the pointer within the file
+ * 
+ * returns the index of the data block or -1 if no block is assigned
+*/
+block_addr_t map_block(int fileID, int64_t pointer_index) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    if (entry -> map_pointer != pointer_index || entry -> map_changes != get_pointer_changes()) {
+        entry -> map_block = get_inode_block(&((inode_t *) inode_table)[entry -> inum], pointer_index);
+        entry -> map_pointer = pointer_index;
+        entry -> map_changes = get_pointer_changes();
+    }
+    return entry -> map_block;
+}
+
+/**
+ * write_tail -- Writes a vector that fits in a single block to the tail block of the file
+ *               descriptor entry, which holds the block in memory. The small writes to the
+ *               same block are gathered there and the block is written once it is full,
+ *               or when the file is used in another way. A block without a data block is
+ *               written first, then kept as the tail block. The tail block is not used in
+ *               the strict mode, the deduplication mode and the log mode, or for the files
+ *               that are inlined or compressed, and not for a data block that is shared or
+ *               a cluster that is compressed.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the vector is written
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1 if the vector must be written by write_file
+*/
+int write_tail(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    inode_t *file = &((inode_t *) inode_table)[entry -> inum];
+    int length = get_iov_length(iov, iovcnt);
+    int64_t pointer_index = offset / BLOCK_SIZE;
+    int block_offset = offset % BLOCK_SIZE;
+
+    if (length <= 0 || block_offset + length > BLOCK_SIZE || length > INODE_MAX_FILE_SIZE - offset) return -1;
+    if (entry -> buffer_mode != SFS_BUFFER_NONE || durability_mode == SFS_DURABILITY_STRICT || dedup_mode || log_mode ||
+        (file -> flags & (INODE_FLAG_INLINE | INODE_FLAG_COMPRESS))) return -1;
+
+    if (entry -> tail == NULL || entry -> tail_pointer != pointer_index) {
+        /* A single entry keeps a tail block of a file, so that the others can read the file from the disk.
+           Their bytes are written before the block is looked up, since they may fill a hole */
+        drop_tails(entry -> inum, true);
+
+        /* A compressed cluster stays compressed after the compression of the file is disabled,
+           and its data blocks do not hold the bytes of their pointers */
+        block_addr_t map[2 * COMPRESS_CLUSTER_BLOCKS];
+        get_cluster_map(file, pointer_index, 1, map);
+        if (is_compressed_cluster(map)) return -1;
+
+        block_addr_t block_index = map_block(fileID, pointer_index);
+        if (block_index >= 0 && get_block_refs(block_index) != 1) return -1;
+
+        int written = -1;
+        if (block_index < 0) {
+            /* A pointer without a data block is written first, and the new data block holds
+               zeros around the written bytes */
+            written = write_entry(fileID, offset, iov, iovcnt);
+            block_index = map_block(fileID, pointer_index);
+            if (written < length || block_index < 0 || block_offset + length == BLOCK_SIZE) return written;
+
+            entry -> tail = (char *) calloc(1, BLOCK_SIZE);
+            copy_iov(iov, iovcnt, 0, entry -> tail + block_offset, length, false);
+        } else {
+            entry -> tail = (char *) malloc(BLOCK_SIZE);
+            read_blocks(block_index, 1, entry -> tail);
+        }
+        entry -> tail_pointer = pointer_index;
+        entry -> tail_block = block_index;
+        entry -> tail_dirty = false;
+        tail_count++;
+        if (written >= 0) return written;
+    }
+
+    copy_iov(iov, iovcnt, 0, entry -> tail + block_offset, length, false);
+    entry -> tail_dirty = true;
+    if (offset + length > file -> size) file -> size = offset + length;
+
+    /* The block is written once the writes reach its end */
+    if (block_offset + length == BLOCK_SIZE) flush_tail(fileID);
+    return length;
+}
+
+/**
+ * read_tail -- Reads the file from the tail block of the file descriptor entry when the
+ *              read is within that block. The tail block is never part of a compressed
+ *              cluster, since write_tail does not load one.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the read starts
+ * iov: buffers to be written on with the file's data
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes read or -1 if the file must be read by read_file
+*/
+int read_tail(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    int length = get_iov_length(iov, iovcnt);
+    if (entry -> tail == NULL || length <= 0 || offset / BLOCK_SIZE != entry -> tail_pointer) return -1;
+
+    /* The read stops at the end of the file */
+    int64_t size = ((inode_t *) inode_table)[entry -> inum].size;
+    if (length > size - offset) length = size - offset;
+    if (length <= 0 || offset % BLOCK_SIZE + length > BLOCK_SIZE) return -1;
+
+    copy_iov(iov, iovcnt, 0, entry -> tail + offset % BLOCK_SIZE, length, true);
+    return length;
+}
+
+/**
+ * flush_tail -- Writes the bytes buffered by a file descriptor entry, and its tail block if it
+ *               has been written since it was read, along with the INode of its file. The tail
+ *               block is written in place, or by write_file if its data block has been changed.
+ * 
+ * fileID: file descriptor index
+ * 
+ * returns 0 or -1 if the buffered bytes cannot all be written
+*/
+int flush_tail(int fileID) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    int result = flush_buffer(fileID);
+    if (entry -> tail == NULL || !entry -> tail_dirty) return result;
+
+    entry -> tail_dirty = false;
+    if (map_block(fileID, entry -> tail_pointer) == entry -> tail_block && get_block_refs(entry -> tail_block) == 1) {
+        write_blocks(entry -> tail_block, 1, entry -> tail);
+        write_inode((inode_t *) inode_table, entry -> inum);
+        return result;
+    }
+
+    /* Only the bytes of the block that are within the file are written */
+    int64_t start = entry -> tail_pointer * BLOCK_SIZE;
+    int64_t length = ((inode_t *) inode_table)[entry -> inum].size - start;
+    sfs_iovec_t iov = { .base = entry -> tail, .length = length > BLOCK_SIZE ? BLOCK_SIZE : length };
+    if (iov.length > 0) write_entry(fileID, start, &iov, 1);
+    return result;
+}
+
+/**
+ * flush_tails -- Writes the buffered bytes and the tail blocks of the file descriptor entries
+ *                of a file.
+ * 
+ * inode: INode of the file, or -1 for every file
+*/
+void flush_tails(int inode) {
+    for (int i = 0; i < FDT_SIZE && tail_count + buffer_count > 0; i++)
+        if (inode < 0 || ((fdt_t *) &fd_table)[i].inum == inode) flush_tail(i);
+}
+
+/**
+ * drop_tail -- Frees the tail block and the buffered bytes of a file descriptor entry.
+ * 
+ * fileID: file descriptor index
+ * write: write them first (true) or discard them (false)
+ * 
+ * returns 0 or -1 if the buffered bytes cannot all be written
+*/
+int drop_tail(int fileID, bool write) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    int result = write ? flush_tail(fileID) : 0;
+
+    if (entry -> buffer != NULL) {
+        free(entry -> buffer);
+        entry -> buffer = NULL;
+        buffer_count--;
+    }
+    if (entry -> tail != NULL) {
+        free(entry -> tail);
+        entry -> tail = NULL;
+        entry -> tail_pointer = -1;
+        tail_count--;
+    }
+    return result;
+}
+
+/**
+ * drop_tails -- Frees the tail blocks and the buffered bytes of the file descriptor entries of
+ *               a file, before the file is changed in a way that they do not follow.
+ * 
+ * inode: INode of the file, or -1 for every file
+ * write: write them first (true) or discard them (false)
+*/
+void drop_tails(int inode, bool write) {
+    for (int i = 0; i < FDT_SIZE && tail_count + buffer_count > 0; i++)
+        if (inode < 0 || ((fdt_t *) &fd_table)[i].inum == inode) drop_tail(i, write);
+}
+
+/**
+ * write_buffer -- Copies a write that continues the bytes buffered by a file descriptor entry
+ *                 set up by sfs_setvbuf to its buffer. The buffered bytes are written first if
+ *                 the write does not continue them or does not fit, and the buffer is written
+ *                 once it is full. The other entries of the file write their tail block and
+ *                 their buffered bytes when a buffer is started, so the writes stay in order.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the vector is written
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1 if the vector must be written by write_file
+*/
+int write_buffer(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    int length = get_iov_length(iov, iovcnt);
+
+    /* A write as large as the buffer is written to the file right away */
+    if (entry -> buffer_mode == SFS_BUFFER_NONE || length <= 0 || length >= entry -> buffer_size ||
+        length > INODE_MAX_FILE_SIZE - offset) return -1;
+
+    if (entry -> buffer != NULL && (offset != entry -> buffer_offset + entry -> buffer_length ||
+        entry -> buffer_length + length > entry -> buffer_size)) flush_buffer(fileID);
+
+    if (entry -> buffer == NULL) {
+        drop_tails(entry -> inum, true);
+        entry -> buffer = (char *) malloc(entry -> buffer_size);
+        entry -> buffer_offset = offset;
+        entry -> buffer_length = 0;
+        entry -> buffer_time = get_time();
+        buffer_count++;
+    }
+    copy_iov(iov, iovcnt, 0, entry -> buffer + entry -> buffer_length, length, false);
+    entry -> buffer_length += length;
+
+    if (entry -> buffer_length == entry -> buffer_size) flush_buffer(fileID);
+    return length;
+}
+
+/**
+ * flush_buffer -- Writes the bytes buffered by a file descriptor entry to its file with a
+ *                 single write, and frees the buffer until the next buffered write.
+ * 
+ * fileID: file descriptor index
+ * 
+ * returns 0 or -1 if the buffered bytes cannot all be written
+*/
+int flush_buffer(int fileID) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+    if (entry -> buffer == NULL) return 0;
+
+    /* The buffer is taken from the entry first, since the log may write the buffers of every entry */
+    sfs_iovec_t iov = { .base = entry -> buffer, .length = entry -> buffer_length };
+    int64_t offset = entry -> buffer_offset;
+    entry -> buffer = NULL;
+    buffer_count--;
+
+    maintain_log();
+    int written = write_entry(fileID, offset, &iov, 1);
+    mark_compress_range(fileID, offset, written);
+    free(iov.base);
+
+    return written == iov.length ? 0 : -1;
+}
+
+/**
+ * flush_timed_buffers -- Writes the buffers of SFS_BUFFER_TIMED that are older than the
+ *                        interval set by sfs_set_flush_interval.
+*/
+void flush_timed_buffers() {
+    if (buffer_count == 0) return;
+
+    int64_t now = get_time();
+    for (int i = 0; i < FDT_SIZE && buffer_count > 0; i++) {
+        fdt_t *entry = &((fdt_t *) &fd_table)[i];
+        if (entry -> buffer != NULL && entry -> buffer_mode == SFS_BUFFER_TIMED && now - entry -> buffer_time >= flush_interval)
+            flush_buffer(i);
+    }
+}
+
+/**
+ * get_file_size -- Gets the size of a file, with the bytes buffered past its end.
+ * 
+ * inode: INode of the file
+ * 
+ * returns the size of the file
+*/
+int64_t get_file_size(int inode) {
+    int64_t size = ((inode_t *) inode_table)[inode].size;
+    for (int i = 0; i < FDT_SIZE && buffer_count > 0; i++) {
+        fdt_t *entry = &((fdt_t *) &fd_table)[i];
+        if (entry -> buffer != NULL && entry -> inum == inode && entry -> buffer_offset + entry -> buffer_length > size)
+            size = entry -> buffer_offset + entry -> buffer_length;
+    }
+    return size;
+}
+
+/**
+ * get_time -- Gets the time of a monotonic clock.
+ * 
+ * returns the time in milliseconds
+*/
+int64_t get_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * write_entry -- Writes to the file of a file descriptor entry with write_file, where the new
+ *                data blocks are taken from the preallocation window of the entry. The first
+ *                window of an entry starts after the data block before the offset, so that the
+ *                file stays contiguous when it is appended again.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the write starts
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1
+*/
+int write_entry(int fileID, int64_t offset, const sfs_iovec_t* iov, int iovcnt) {
+    fdt_t *entry = &((fdt_t *) &fd_table)[fileID];
+
+    if (entry -> prealloc.end < 0 && offset >= BLOCK_SIZE) {
+        block_addr_t previous = map_block(fileID, offset / BLOCK_SIZE - 1);
+        if (previous >= 0) entry -> prealloc.next = entry -> prealloc.end = previous + 1;
+    }
+
+    set_prealloc_window(&entry -> prealloc);
+    int written = write_file(entry -> inum, offset, iov, iovcnt);
+    set_prealloc_window(NULL);
+    return written;
+}
+
+/**
+ * copy_file -- Copies a range of the file of a file descriptor entry to the file of another.
+ *              When both offsets are at the same location within their blocks and neither
+ *              file is compressed or inlined, each chunk of whole blocks is shared by
+ *              share_blocks. A block that cannot take another reference, the partial blocks
+ *              at the edges, and the other ranges are read into a chunk buffer and written
+ *              with write_entry, so each run of contiguous blocks is a single block request.
+ * 
+ * src_fd: file descriptor index of the source file
+ * src_off: location in the source file where the range starts
+ * dst_fd: file descriptor index of the destination file
+ * dst_off: location in the destination file where the range is copied
+ * length: size of the range, which is within the source file
+ * 
+ * returns the number of bytes copied
+*/
+int64_t copy_file(int src_fd, int64_t src_off, int dst_fd, int64_t dst_off, int64_t length) {
+    int src = get_fdt_inode(src_fd), dst = get_fdt_inode(dst_fd);
+    inode_t *target = &((inode_t *) inode_table)[dst];
+    int flags = ((inode_t *) inode_table)[src].flags | (target -> flags & ~INODE_FLAG_INLINE);
+    bool share = src_off % BLOCK_SIZE == dst_off % BLOCK_SIZE && !(flags & (INODE_FLAG_INLINE | INODE_FLAG_COMPRESS));
+
+    /* The blocks can only be shared once the destination has data blocks */
+    int64_t first_full = (src_off + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE - src_off;
+    if (share && length - first_full >= BLOCK_SIZE && uninline_file(dst) < 0) share = false;
+
+    char *buffer = (char *) malloc(IO_CHUNK_BLOCKS * BLOCK_SIZE);
+    int64_t copied = 0;
+    bool pointers_changed = false;
+
+    while (copied < length) {
+        int64_t src_position = src_off + copied, dst_position = dst_off + copied;
+        int64_t remaining = length - copied;
+        int block_offset = src_position % BLOCK_SIZE;
+
+        /* Gets how many bytes are copied through the buffer in this chunk */
+        int64_t current_length = IO_CHUNK_BLOCKS * BLOCK_SIZE - block_offset;
+        if (share && block_offset == 0 && remaining >= BLOCK_SIZE) {
+            int nblocks = remaining / BLOCK_SIZE > IO_CHUNK_BLOCKS ? IO_CHUNK_BLOCKS : remaining / BLOCK_SIZE;
+            int shared = share_blocks(src, src_position / BLOCK_SIZE, dst, dst_position / BLOCK_SIZE, nblocks);
+            if (shared < 0) break;
+            if (shared > 0) {
+                pointers_changed = true;
+                copied += (int64_t) shared * BLOCK_SIZE;
+                if (dst_position + (int64_t) shared * BLOCK_SIZE > target -> size)
+                    target -> size = dst_position + (int64_t) shared * BLOCK_SIZE;
+                continue;
+            }
+            current_length = BLOCK_SIZE;
+        } else if (share) {
+            /* The partial blocks at the edges stop at the first whole block */
+            current_length = BLOCK_SIZE - block_offset;
+        }
+        if (current_length > remaining) current_length = remaining;
+
+        sfs_iovec_t iov = { .base = buffer, .length = current_length };
+        iov.length = read_file(src, src_position, &iov, 1);
+        if (iov.length <= 0) break;
+
+        int written = write_entry(dst_fd, dst_position, &iov, 1);
+        mark_compress_range(dst_fd, dst_position, written);
+        if (written > 0) copied += written;
+        if (written < iov.length) break;
+    }
+    free(buffer);
+
+    /* The indirect blocks are freed once all of their pointers are holes */
+    if (pointers_changed) prune_inode_blocks(target);
+    write_inode((inode_t *) inode_table, dst);
+
+    return copied;
+}
+
+/**
+ * share_blocks -- Assigns the data blocks of a range of pointers of a file to a range of
+ *                 pointers of another file, where each data block gets one more reference.
+ *                 The holes of the source are copied as holes, and the data blocks that the
+ *                 destination had are released.
+ * 
+ * src_inode: INode of the source file
+ * src_pointer: index of the first pointer of the source range
+ * dst_inode: INode of the destination file
+ * dst_pointer: index of the first pointer of the destination range
+ * count: number of pointers, at most IO_CHUNK_BLOCKS
+ * 
+ * returns the number of pointers assigned, which stops before the first data block that cannot
+ * take another reference, or -1 if the indirect blocks of the destination cannot be allocated
+*/
+int share_blocks(int src_inode, int64_t src_pointer, int dst_inode, int64_t dst_pointer, int count) {
+    inode_t *target = &((inode_t *) inode_table)[dst_inode];
+    block_addr_t blocks[IO_CHUNK_BLOCKS], released[IO_CHUNK_BLOCKS];
+    get_inode_blocks(&((inode_t *) inode_table)[src_inode], src_pointer, count, blocks);
+
+    /* The indirect blocks are allocated first so that the shared blocks can always be assigned */
+    bool holes = true;
+    for (int i = 0; i < count && holes; i++)
+        holes = blocks[i] < 0;
+    if (!holes && reserve_inode_blocks(target, dst_pointer, count) < 0) return -1;
+
+    int shared = 0;
+    while (shared < count && (blocks[shared] < 0 || ref_block(blocks[shared]) == 0)) shared++;
+    if (shared == 0) return 0;
+
+    int nreleased = 0;
+    get_inode_blocks(target, dst_pointer, shared, released);
+    for (int i = 0; i < shared; i++)
+        if (released[i] >= 0) released[nreleased++] = released[i];
+
+    set_inode_blocks(target, dst_pointer, shared, blocks);
+    reset_free_blocks(released, nreleased);
+    return shared;
+}
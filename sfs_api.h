@@ -8,6 +8,69 @@
 #ifndef SFS_API_H
 #define SFS_API_H
 
+#include <stdint.h>
+
+/* Types of block devices of sfs_set_device */
+#define SFS_DEVICE_FILE 0
+#define SFS_DEVICE_MMAP 1
+#define SFS_DEVICE_RAM 2
+
+/* Durability modes of sfs_set_durability */
+#define SFS_DURABILITY_NONE 0
+#define SFS_DURABILITY_ORDERED 1
+#define SFS_DURABILITY_STRICT 2
+
+/* Buffering modes of sfs_setvbuf */
+#define SFS_BUFFER_NONE 0
+#define SFS_BUFFER_FULL 1
+#define SFS_BUFFER_TIMED 2
+
+/**
+ * _sfs_options_t -- Options of a disk mounted by sfs_mount.
+ * 
+ * fresh: create a new disk (1) or use an existing disk (0)
+ * durability: SFS_DURABILITY_NONE, SFS_DURABILITY_ORDERED or SFS_DURABILITY_STRICT
+ * device: SFS_DEVICE_FILE, SFS_DEVICE_MMAP or SFS_DEVICE_RAM
+*/
+typedef struct _sfs_options_t {
+    int fresh;
+    int durability;
+    int device;
+} sfs_options_t;
+
+/* Disk mounted by a thread with sfs_mount */
+typedef struct _sfs_t sfs_t;
+
+/**
+ * _sfs_iovec_t -- One buffer of a scatter-gather request.
+ * 
+ * base: start of the buffer
+ * length: size of the buffer
+*/
+typedef struct _sfs_iovec_t {
+    void *base;
+    int length;
+} sfs_iovec_t;
+
+/**
+ * _sfs_statfs_t -- Size and free space of the file system. The blocks are the data blocks
+ *                  and the INodes are the ones that can hold a file.
+ * 
+ * free_extents: number of runs of contiguous free blocks
+ * average_free_extent: average number of blocks of a run of free blocks
+*/
+typedef struct _sfs_statfs_t {
+    int block_size;
+    int64_t total_blocks;
+    int64_t free_blocks;
+    int64_t used_blocks;
+    int total_inodes;
+    int free_inodes;
+    int used_inodes;
+    int64_t free_extents;
+    int64_t average_free_extent;
+} sfs_statfs_t;
+
 /**
  * mksfs -- Initializes the disk and the disk information in-memory.
  * 
@@ -15,6 +78,31 @@
 */
 void mksfs(int);
 
+/**
+ * sfs_mount -- Mounts the disk stored at the given path for the calling thread. Each thread
+ *              keeps the state of its own disk, so threads that mount different disks share
+ *              nothing and need no locking. Every other function of the API works on the disk
+ *              mounted by the calling thread, and a thread mounts one disk at a time. A disk
+ *              previously opened by mksfs in the thread is written and closed first.
+ * 
+ * path: filename of the image, used as the prefix of the image files of a striped disk
+ * options: how the disk is opened, or NULL to open an existing disk with the default options
+ * 
+ * returns the mounted file system or NULL if the thread has already mounted a disk, the
+ * options are not valid or the disk cannot be opened
+*/
+sfs_t* sfs_mount(const char*, const sfs_options_t*);
+
+/**
+ * sfs_unmount -- Writes the disk mounted by the calling thread to the storage, closes it and
+ *                frees the memory that was kept for it.
+ * 
+ * fs: file system returned by sfs_mount in the calling thread
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_unmount(sfs_t*);
+
 /**
  * sfs_getnextfilename -- Gets the name of the next file in the directory table.
  *                        There's also a global counter that keeps track of
@@ -35,7 +123,7 @@ int sfs_getnextfilename(char*);
  * 
  * returns the size of the file found in the given INode
 */
-int sfs_getfilesize(const char*);
+int64_t sfs_getfilesize(const char*);
 
 /**
  * sfs_fopen -- Opens the given filename or creates a new file with the filename
@@ -49,6 +137,8 @@ int sfs_fopen(char*);
 
 /**
  * sfs_fclose -- Closes the file in the file descriptor table using its index.
+ *               The clusters of a compressed file written through the entry are
+ *               compressed before it returns, so the close takes longer than the writes.
  * 
  * fileID: file descriptor table index
  * 
@@ -57,32 +147,117 @@ int sfs_fopen(char*);
 int sfs_fclose(int);
 
 /**
- * sfs_fwrite -- Writes the given buffer to file.
+ * sfs_setvbuf -- Sets how the writes through a file descriptor entry are buffered. With
+ *                SFS_BUFFER_FULL, the writes that continue the buffered bytes are copied to
+ *                a buffer of the given size, which is written to the file with a single write
+ *                once it is full, by sfs_fflush, or when the entry is closed. SFS_BUFFER_TIMED
+ *                also writes the buffer once it is older than the interval set by
+ *                sfs_set_flush_interval. The buffered bytes are written first when the file
+ *                is used through another entry.
+ * 
+ * fileID: file descriptor index
+ * mode: SFS_BUFFER_NONE, SFS_BUFFER_FULL or SFS_BUFFER_TIMED
+ * size: size of the buffer in bytes, ignored by SFS_BUFFER_NONE
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_setvbuf(int, int, int);
+
+/**
+ * sfs_fflush -- Writes the bytes buffered by a file descriptor entry to its file.
+ * 
+ * fileID: file descriptor index, or -1 for every entry
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fflush(int);
+
+/**
+ * sfs_set_flush_interval -- Sets how long the bytes buffered with SFS_BUFFER_TIMED are kept.
+ *                           The age of the buffers is checked by each read and write.
  * 
- * limitations:
- * - It has only been tested to write on the first block
- * - It does not allocate blocks past the 12 direct pointers
- * - It only writes characters and not individual bytes
+ * milliseconds: age of a buffer at which it is written
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_flush_interval(int);
+
+/**
+ * sfs_fwrite -- Writes the given buffer to file at the read/write pointer
+ *               and moves the read/write pointer past the written bytes.
  * 
  * fileID: file descriptor index
  * buf: buffer that will be written onto the file
  * length: size of the buffer
+ * 
+ * returns the number of bytes written or -1
 */
 int sfs_fwrite(int, const char*, int);
 
 /**
- * sfs_fread -- Reads the file and copies it to the given buffer.
- * 
- * limitations:
- * - It has only been tested to read on the first block
- * - It only writes characters and not individual bytes
+ * sfs_fread -- Reads the file at the read/write pointer and copies it to the given buffer.
+ *              The read stops at the end of the file.
  * 
  * fileID: file descriptor index
  * buf: buffer to be written on with the file's data
  * length: size of the buffer
+ * 
+ * returns the number of bytes read or -1
 */
 int sfs_fread(int, char*, int);
 
+/**
+ * sfs_fwritev -- Writes the buffers of the vector one after the other to the file
+ *                at the read/write pointer. Contiguous blocks of the whole vector
+ *                are written with a single block request.
+ * 
+ * fileID: file descriptor index
+ * iov: buffers that will be written onto the file
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes written or -1
+*/
+int sfs_fwritev(int, const sfs_iovec_t*, int);
+
+/**
+ * sfs_freadv -- Reads the file at the read/write pointer and scatters it into the
+ *               buffers of the vector. Contiguous blocks of the whole vector are
+ *               read with a single block request.
+ * 
+ * fileID: file descriptor index
+ * iov: buffers to be written on with the file's data
+ * iovcnt: number of buffers
+ * 
+ * returns the number of bytes read or -1
+*/
+int sfs_freadv(int, const sfs_iovec_t*, int);
+
+/**
+ * sfs_pwrite -- Writes the given buffer to file at the given offset. The read/write
+ *               pointer of the file descriptor entry is left untouched.
+ * 
+ * fileID: file descriptor index
+ * buf: buffer that will be written onto the file
+ * length: size of the buffer
+ * offset: location in the file where the buffer is written
+ * 
+ * returns the number of bytes written or -1
+*/
+int sfs_pwrite(int, const char*, int, int64_t);
+
+/**
+ * sfs_pread -- Reads the file at the given offset and copies it to the given buffer.
+ *              The read/write pointer of the file descriptor entry is left untouched.
+ * 
+ * fileID: file descriptor index
+ * buf: buffer to be written on with the file's data
+ * length: size of the buffer
+ * offset: location in the file where the read starts
+ * 
+ * returns the number of bytes read or -1
+*/
+int sfs_pread(int, char*, int, int64_t);
+
 /**
  * sfs_fseek -- Changes the read/write pointer of a file descriptor entry.
  * 
@@ -93,6 +268,17 @@ int sfs_fread(int, char*, int);
 */
 int sfs_fseek(int, int);
 
+/**
+ * sfs_fseek64 -- Changes the read/write pointer of a file descriptor entry to
+ *                a location that may be past 2 GB.
+ * 
+ * fileID: file descriptor entry index
+ * loc: new location of the read/write pointer
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fseek64(int, int64_t);
+
 /**
  * sfs_remove -- Removes the file from its allocated data blocks, INode, and directory entry.
  * 
@@ -102,4 +288,269 @@ int sfs_fseek(int, int);
 */
 int sfs_remove(char*);
 
+/**
+ * sfs_clone -- Creates a copy of a file that shares the data blocks of the source file.
+ *              Each data block gets one more reference and is copied on the first write
+ *              to either file, so only the INode and the directory entry are written.
+ * 
+ * src: filename to be copied
+ * dst: filename of the copy, which must not exist
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_clone(char*, char*);
+
+/**
+ * sfs_copy_range -- Copies a range of a file to another file, or to another range of the same
+ *                   file, without going through a buffer of the caller. When both offsets are
+ *                   at the same location within their blocks, the whole blocks of the range
+ *                   are shared like sfs_clone does, and the holes stay holes. The other bytes
+ *                   are copied by the file system in chunks of contiguous blocks. The read/write
+ *                   pointers of the file descriptor entries are left untouched.
+ * 
+ * src_fd: file descriptor index of the source file
+ * src_off: location in the source file where the range starts
+ * dst_fd: file descriptor index of the destination file
+ * dst_off: location in the destination file where the range is copied
+ * length: size of the range, which stops at the end of the source file
+ * 
+ * returns the number of bytes copied or -1, also when the ranges overlap within a file
+*/
+int64_t sfs_copy_range(int, int64_t, int, int64_t, int64_t);
+
+/**
+ * sfs_statfs -- Gets the size and the free space of the file system from the counters kept
+ *               by the allocators, without reading the free bitmap.
+ * 
+ * stat: where the statistics are copied to
+ * 
+ * returns 0 or -1 if stat is NULL
+*/
+int sfs_statfs(sfs_statfs_t*);
+
+/**
+ * sfs_fragmentation -- Measures the fragmentation of a file as the number of runs of contiguous
+ *                      data blocks it is stored in, following the order of its pointers.
+ * 
+ * path: filename of the file
+ * 
+ * returns the number of runs, where 1 is a contiguous file and 0 a file without data blocks,
+ * or -1 if the file does not exist
+*/
+int64_t sfs_fragmentation(const char*);
+
+/**
+ * sfs_defrag -- Moves the data blocks of a file into a single run of contiguous blocks. The
+ *               blocks are copied before the pointers are changed, and the old blocks are
+ *               released last, so the file always refers to either its old or its new blocks.
+ *               The blocks shared with other files are left in place.
+ * 
+ * path: filename of the file
+ * max_blocks: maximum number of blocks moved by this call, or 0 for no limit. A file that is
+ *             not done is continued by the next call, so a small limit keeps each call short
+ *             when the file system is in use.
+ * 
+ * returns the number of blocks moved, 0 once the file is contiguous or cannot be moved,
+ * or -1 if the file does not exist
+*/
+int sfs_defrag(const char*, int);
+
+/**
+ * sfs_set_log_mode -- Sets if the data blocks are written like a log. Every data block written
+ *                     from now on goes to a new block taken in order from the current segment,
+ *                     and the old block is released, so the writes are sequential. Once few
+ *                     segments are clean, the writes run the segment cleaner first, and in the
+ *                     ordered mode the metadata is also checkpointed after a number of segments.
+ * 
+ * enable: write the data blocks like a log (1) or in place (0)
+*/
+void sfs_set_log_mode(int);
+
+/**
+ * sfs_clean -- Cleans the segments of the log that are worth it with the cost-benefit policy.
+ *              The used blocks of a segment are moved to the head of the log, so that the
+ *              whole segment can be written again. A segment that holds indirect blocks,
+ *              directory blocks or shared blocks is left in place.
+ * 
+ * max_segments: maximum number of segments cleaned by this call
+ * 
+ * returns the number of segments cleaned or -1
+*/
+int sfs_clean(int);
+
+/**
+ * sfs_set_compression -- Sets if the files created from now on are compressed.
+ * 
+ * enable: compress new files (1) or not (0)
+*/
+void sfs_set_compression(int);
+
+/**
+ * sfs_fsetcompression -- Sets if the file of a file descriptor entry is compressed.
+ *                        Enabling the compression compresses the whole file when
+ *                        the file descriptor entry is closed. Disabling it expands
+ *                        the compressed clusters back to one data block per pointer.
+ * 
+ * fileID: file descriptor index
+ * enable: compress the file (1) or not (0)
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fsetcompression(int, int);
+
+/**
+ * sfs_set_dedup -- Sets if the blocks written from now on are deduplicated. A block
+ *                  whose content is already in a data block shares that data block.
+ *                  Before a disk is opened, the index is built when it is opened.
+ * 
+ * enable: deduplicate blocks (1) or not (0)
+*/
+void sfs_set_dedup(int);
+
+/**
+ * sfs_fallocate -- Assigns zeroed data blocks to a range of the file so that writing
+ *                  to it does not need to find free blocks. The file grows if the
+ *                  range ends past the end of the file. A range that does not fit on
+ *                  the disk leaves the file as it was.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fallocate(int, int64_t, int64_t);
+
+/**
+ * sfs_punch_hole -- Frees the data blocks of a range of the file so that it is read as zeros.
+ *                   The size of the file is not changed.
+ * 
+ * fileID: file descriptor index
+ * offset: location in the file where the range starts
+ * length: size of the range
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_punch_hole(int, int64_t, int64_t);
+
+/**
+ * sfs_set_discard -- Sets if the data blocks freed from now on are cleared by sfs_discard.
+ *                    The data blocks are never cleared when they are freed.
+ * 
+ * enable: clear the freed data blocks (1) or not (0)
+*/
+void sfs_set_discard(int);
+
+/**
+ * sfs_discard -- Clears the data blocks that have been freed since the last call and that
+ *                are still free. It can be called when the file system is idle.
+ * 
+ * returns the number of data blocks that have been cleared
+*/
+int sfs_discard();
+
+/**
+ * sfs_batch_begin -- Starts a batch of metadata updates. The blocks of the INode table,
+ *                    the directory table and the free bitmap changed by the following calls
+ *                    are kept in memory and each of them is written once by sfs_batch_commit.
+ *                    Batches can be nested, only the outermost commit writes the blocks.
+ *                    A batch is committed early at the end of a call that leaves it holding
+ *                    more than INODE_HELD_LIMIT indirect blocks, and then goes on.
+*/
+void sfs_batch_begin();
+
+/**
+ * sfs_batch_commit -- Ends a batch of metadata updates and writes the changed blocks.
+ * 
+ * returns 0 or -1 if no batch has been started
+*/
+int sfs_batch_commit();
+
+/**
+ * sfs_fsync -- Writes the data and the metadata of the file system to the storage, so that
+ *              the file of the file descriptor entry is kept if the system stops. The blocks
+ *              of a file are not tracked apart from the others, so every file is written.
+ * 
+ * fileID: file descriptor index
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_fsync(int);
+
+/**
+ * sfs_sync -- Writes the data and the metadata of the file system to the storage.
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_sync();
+
+/**
+ * sfs_set_durability -- Sets when the disk opened by the next call to mksfs is written to
+ *                       the storage. With SFS_DURABILITY_NONE, the operating system decides
+ *                       when the blocks are written. With SFS_DURABILITY_ORDERED, the metadata
+ *                       is held in memory and written at each call to sfs_fsync or sfs_sync,
+ *                       or once it holds many freed blocks or is a few seconds old, after the
+ *                       data blocks it refers to are on the storage. With
+ *                       SFS_DURABILITY_STRICT, each operation is on the storage when it returns.
+ * 
+ * mode: SFS_DURABILITY_NONE, SFS_DURABILITY_ORDERED or SFS_DURABILITY_STRICT
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_durability(int);
+
+/**
+ * sfs_set_stripes -- Sets the number of image files the disk is spread across by the next
+ *                    call to mksfs. Each run of unit blocks is placed on the next image
+ *                    file, so that the large reads and writes use all of them in parallel.
+ * 
+ * members: number of image files, where 1 keeps the disk in a single image file
+ * unit: number of consecutive blocks placed on the same image file
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_stripes(int, int);
+
+/**
+ * sfs_set_writeback -- Sets the write-back cache of the disk opened by the next call to mksfs.
+ *                      The written blocks are held in memory, and a flusher thread writes them
+ *                      back in the order of the block numbers once they are older than expire_ms
+ *                      or once background_percent of dirty_limit blocks are dirty. A write only
+ *                      waits for the flusher once dirty_limit blocks are dirty, and sfs_fsync,
+ *                      sfs_sync and the strict mode write back every dirty block. A striped disk
+ *                      is not cached.
+ * 
+ * dirty_limit: number of dirty blocks held in memory, where 0 writes each block right away
+ * background_percent: percentage of dirty_limit, from 1 to 100, at which the flusher starts
+ * expire_ms: age in milliseconds at which a dirty block is written back
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_writeback(int, int, int);
+
+/**
+ * sfs_set_device -- Sets the type of block device opened by the next call to mksfs.
+ *                   A RAM disk only lives in memory, so mksfs(0) keeps the RAM disk
+ *                   that is in use and its blocks are lost when it is created again.
+ * 
+ * type: SFS_DEVICE_FILE, SFS_DEVICE_MMAP or SFS_DEVICE_RAM
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_device(int);
+
+/**
+ * sfs_set_geometry -- Sets the geometry of the disk created by the next call to mksfs(1).
+ *                     The geometry is stored in the superblock, so mksfs(0) reads it back.
+ *                     A disk in use takes about 5 bytes of memory per block, for the free
+ *                     bitmap and the discarded, released and reserved marks of each block.
+ * 
+ * block_size: size of a block, a power of 2 from 512 to 4096
+ * num_blocks: number of blocks of the disk
+ * inode_count: number of INodes, which is also the number of directory entries
+ * 
+ * returns -1 or 0 if its a success
+*/
+int sfs_set_geometry(int, int64_t, int);
+
 #endif
\ No newline at end of file
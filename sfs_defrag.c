@@ -0,0 +1,71 @@
+/**
+ * Simple File System Defragmenter
+ * ------------------------------
+ * Moves the data blocks of each file of a disk image into a single run of contiguous blocks,
+ * so that a file is read sequentially with as few block requests as possible. The number of
+ * runs of each file is reported before and after it is moved. The blocks shared with other
+ * files stay in place, and a file is left in place if no run of free blocks can hold it.
+ * 
+ * The files are moved with sfs_defrag, which takes at most max_blocks blocks per call. The
+ * same calls can be made by a program that uses the file system, between its own requests.
+ * 
+ * usage: sfs_defrag [-m max_blocks]
+ * 
+ * exits with 0 once every file has been moved or 1 if the disk cannot be opened
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "constant.h"
+#include "sfs_api.h"
+
+int main(int argc, char **argv) {
+    int max_blocks = 0;
+    int option;
+
+    while ((option = getopt(argc, argv, "m:")) != -1) {
+        if (option == 'm' && atoi(optarg) >= 0) {
+            max_blocks = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-m max_blocks]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (access(DISK_NAME, R_OK | W_OK) < 0) {
+        fprintf(stderr, "Could not open %s\n", DISK_NAME);
+        return 1;
+    }
+
+    /* The geometry of the disk is read from its superblock */
+    mksfs(0);
+
+    char filename[256];
+    int files = 0, moved_files = 0;
+    int64_t total = 0;
+    while (sfs_getnextfilename(filename)) {
+        files++;
+        int64_t before = sfs_fragmentation(filename);
+        if (before <= 1) continue;
+
+        int64_t moved = 0;
+        int result;
+        while ((result = sfs_defrag(filename, max_blocks)) > 0)
+            moved += result;
+        if (moved == 0) {
+            printf("%s: %" PRId64 " runs, left in place\n", filename, before);
+            continue;
+        }
+
+        printf("%s: %" PRId64 " runs -> %" PRId64 " runs, %" PRId64 " blocks moved\n",
+            filename, before, sfs_fragmentation(filename), moved);
+        moved_files++;
+        total += moved;
+    }
+
+    printf("%s: %d files checked, %d files moved, %" PRId64 " blocks moved\n",
+        DISK_NAME, files, moved_files, total);
+    return 0;
+}
@@ -0,0 +1,221 @@
+/**
+ * Simple File System Export
+ * ------------------------------
+ * Copies the files of a disk image to a host directory. The filename of each file is its path
+ * within the directory, so a filename such as docs/a.txt creates the docs subdirectory, and a
+ * host file that is already there is replaced. Filenames that would leave the directory are
+ * skipped.
+ * 
+ * The main thread, which mounts the disk, reads each file with a single sfs_pread and hands
+ * its content through a pipeline to a pool of threads that write the host files in parallel.
+ * 
+ * usage: sfs_export [-j threads] [-i image] directory
+ * 
+ * exits with 0 once every file has been exported or 1 if a file could not be exported
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "constant.h"
+#include "sfs_api.h"
+#include "pipeline.h"
+
+#define EXPORT_MAX_THREADS 64
+/* Largest read handed to sfs_pread */
+#define EXPORT_CHUNK (1 << 30)
+
+/**
+ * _export_worker_t -- Thread of the pool with the files it has written.
+*/
+typedef struct _export_worker_t {
+    pthread_t thread;
+    int files;
+    int failed;
+    int64_t bytes;
+} export_worker_t;
+
+pipeline_t export_pipeline;
+export_worker_t export_workers[EXPORT_MAX_THREADS];
+
+/* Helper Functions */
+bool is_safe_name(const char *name);
+int read_file_data(const char *name, pipeline_item_t *item);
+void* write_worker(void *arg);
+int make_parents(char *path);
+
+int main(int argc, char **argv) {
+    char *image = DISK_NAME;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+
+    while ((option = getopt(argc, argv, "j:i:")) != -1) {
+        if (option == 'j') {
+            threads = atoi(optarg);
+        } else if (option == 'i') {
+            image = optarg;
+        } else {
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-j threads] [-i image] directory\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > EXPORT_MAX_THREADS) threads = EXPORT_MAX_THREADS;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    char *root = argv[optind];
+    if (mkdir(root, 0755) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create %s\n", root);
+        return 1;
+    }
+    sfs_t *fs = sfs_mount(image, NULL);
+    if (fs == NULL) {
+        fprintf(stderr, "Could not open %s\n", image);
+        return 1;
+    }
+
+    /* The main thread reads the files of the disk while the host files are written in parallel */
+    init_pipeline(&export_pipeline, PIPELINE_MAX_BYTES, 1);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&export_workers[i].thread, NULL, write_worker, &export_workers[i]);
+
+    char filename[256], path[PATH_MAX];
+    int failed = 0;
+    while (sfs_getnextfilename(filename)) {
+        if (!is_safe_name(filename)) {
+            fprintf(stderr, "%s: filename outside of the directory, skipped\n", filename);
+            failed++;
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", root, filename);
+        pipeline_item_t *item = new_item(filename, path);
+        if (read_file_data(filename, item) < 0) {
+            fprintf(stderr, "%s: could not be read\n", filename);
+            free_item(item);
+            failed++;
+            continue;
+        }
+        push_item(&export_pipeline, item);
+    }
+    end_producer(&export_pipeline);
+
+    int files = 0;
+    int64_t bytes = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(export_workers[i].thread, NULL);
+        files += export_workers[i].files;
+        failed += export_workers[i].failed;
+        bytes += export_workers[i].bytes;
+    }
+    free_pipeline(&export_pipeline);
+    sfs_unmount(fs);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %d files, %" PRId64 " bytes exported in %.3f s with %d threads, %d failed\n",
+        image, files, bytes, seconds, threads, failed);
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * is_safe_name -- Checks that a filename is a relative path that stays within the directory.
+ * 
+ * name: filename of the disk
+ * 
+ * returns true if the file can be written under the directory
+*/
+bool is_safe_name(const char *name) {
+    if (name[0] == '\0' || name[0] == '/') return false;
+
+    for (const char *part = name; part != NULL; part = strchr(part, '/')) {
+        if (*part == '/') part++;
+        size_t length = strcspn(part, "/");
+        if (length == 0 || (length == 1 && part[0] == '.') || (length == 2 && strncmp(part, "..", 2) == 0))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * read_file_data -- Reads a file of the disk into the content of an item.
+ * 
+ * name: filename of the disk
+ * item: item that gets the content
+ * 
+ * returns 0 or -1 if the file could not be read
+*/
+int read_file_data(const char *name, pipeline_item_t *item) {
+    int64_t size = sfs_getfilesize(name);
+    int fd = sfs_fopen((char *) name);
+    if (size < 0 || fd < 0) return -1;
+
+    item -> data = (char *) malloc(size > 0 ? size : 1);
+    while (item -> length < size) {
+        int length = size - item -> length > EXPORT_CHUNK ? EXPORT_CHUNK : size - item -> length;
+        int result = sfs_pread(fd, item -> data + item -> length, length, item -> length);
+        if (result <= 0) break;
+        item -> length += result;
+    }
+    sfs_fclose(fd);
+
+    return item -> length == size ? 0 : -1;
+}
+
+/**
+ * write_worker -- Writes the host files handed by the main thread until the disk has
+ *                 been read.
+ * 
+ * arg: worker of the thread
+*/
+void* write_worker(void *arg) {
+    export_worker_t *worker = (export_worker_t *) arg;
+    pipeline_item_t *item;
+
+    while ((item = pop_item(&export_pipeline)) != NULL) {
+        FILE *file = make_parents(item -> path) == 0 ? fopen(item -> path, "wb") : NULL;
+        bool written = file != NULL && (int64_t) fwrite(item -> data, 1, item -> length, file) == item -> length;
+        if (file != NULL && fclose(file) != 0) written = false;
+
+        if (written) {
+            worker -> files++;
+            worker -> bytes += item -> length;
+        } else {
+            fprintf(stderr, "%s: could not be written\n", item -> path);
+            worker -> failed++;
+        }
+        free_item(item);
+    }
+    return NULL;
+}
+
+/**
+ * make_parents -- Creates the directories of a host path that do not exist yet.
+ * 
+ * path: path of the host file
+ * 
+ * returns 0 or -1 if a directory could not be created
+*/
+int make_parents(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int result = mkdir(path, 0755);
+        *slash = '/';
+        if (result < 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,534 @@
+/**
+ * Simple File System Checker
+ * ------------------------------
+ * Verifies the consistency of a disk image: the pointers of the INodes against the free
+ * bitmap, the directory entries against the link counter of the INodes, the size of
+ * the files against their data blocks and the free space counters of the superblock.
+ * The problems are reported and, with -r, repaired.
+ * 
+ * The metadata regions are read with one sequential request each, and the INodes are
+ * checked by a pool of threads where each thread owns a range of the INode table and
+ * steals half of the range of another thread once its own range is done.
+ * 
+ * usage: sfs_fsck [-r] [-j threads] [image]
+ * 
+ * exits with 0 if the disk is consistent, 1 if every problem has been repaired,
+ * 4 if problems are left and 8 if the disk cannot be checked
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "constant.h"
+#include "disk_emu.h"
+#include "block.h"
+#include "super_block.h"
+#include "inode.h"
+#include "directory.h"
+#include "free_bitmap.h"
+#include "compress.h"
+#include "block_device.h"
+
+#define FSCK_OK 0
+#define FSCK_REPAIRED 1
+#define FSCK_UNREPAIRED 4
+#define FSCK_FAILED 8
+
+/* Number of INodes a thread takes from its range at a time */
+#define FSCK_CHUNK 32
+#define FSCK_MAX_THREADS 64
+
+#define DATA_START (SUPERBLOCK_SIZE + INODE_TABLE_SIZE)
+#define DATA_END (SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE)
+#define FBM_START (SUPERBLOCK_SIZE + INODE_TABLE_SIZE + DATA_BLOCK_SIZE + DIR_BLOCK_SIZE)
+
+/**
+ * _fsck_worker_t -- Thread of the pool with the range of INodes it still has to check.
+ *                   The owner takes INodes from the start of the range while the other
+ *                   threads steal from its end.
+*/
+typedef struct _fsck_worker_t {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int next;
+    int end;
+    geometry_t geometry;        /* Geometry and device of the disk, which are kept per thread */
+    block_device_t *device;
+} fsck_worker_t;
+
+/* Metadata of the disk in memory */
+inode_t *fsck_inodes = NULL;
+dirent_t *fsck_dirs = NULL;
+uint8_t *fsck_fbm = NULL;
+
+/* Number of pointers found for each block and of directory entries for each INode */
+uint16_t *fsck_refs = NULL;
+int *fsck_links = NULL;
+
+bool fsck_repair = false;
+int fsck_problems = 0;
+int fsck_repaired = 0;
+pthread_mutex_t fsck_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+fsck_worker_t fsck_workers[FSCK_MAX_THREADS];
+int fsck_threads = 1;
+
+/* Helper Functions */
+int open_image(char *filename);
+void load_metadata();
+void check_directory();
+void check_inodes();
+void* fsck_worker(void *arg);
+bool take_inodes(fsck_worker_t *worker, int *first, int *last);
+bool steal_inodes(fsck_worker_t *thief);
+void check_inode(int index);
+bool check_pointer(int index, block_addr_t *pointer, int64_t pointer_index, bool *changed);
+int64_t check_tree(int index, block_addr_t *root, int depth, int64_t first, bool *changed);
+void check_fbm();
+void check_counters();
+void write_metadata();
+bool is_data_block(block_addr_t block_index);
+void count_ref(block_addr_t block_index);
+void report(bool repaired, const char *format, ...);
+
+int main(int argc, char **argv) {
+    char *filename = DISK_NAME;
+    int option;
+
+    fsck_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((option = getopt(argc, argv, "rj:")) != -1) {
+        if (option == 'r') {
+            fsck_repair = true;
+        } else if (option == 'j') {
+            fsck_threads = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-r] [-j threads] [image]\n", argv[0]);
+            return FSCK_FAILED;
+        }
+    }
+    if (optind < argc) filename = argv[optind];
+    if (fsck_threads < 1) fsck_threads = 1;
+    if (fsck_threads > FSCK_MAX_THREADS) fsck_threads = FSCK_MAX_THREADS;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (open_image(filename) < 0) return FSCK_FAILED;
+    load_metadata();
+    check_directory();
+    check_inodes();
+    check_fbm();
+    check_counters();
+    if (fsck_repaired > 0) write_metadata();
+    close_disk();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %d INodes and %" PRId64 " blocks checked in %.3f s with %d threads, "
+        "%d problems found, %d repaired\n", filename, INODE_LENGTH, disk_geometry.num_blocks,
+        seconds, fsck_threads, fsck_problems, fsck_repaired);
+
+    if (fsck_problems == 0) return FSCK_OK;
+    return fsck_repaired == fsck_problems ? FSCK_REPAIRED : FSCK_UNREPAIRED;
+}
+
+/**
+ * open_image -- Reads the geometry from the superblock of the image and maps the image
+ *               in memory, so that the threads can read their blocks concurrently.
+ * 
+ * filename: name of the image file
+ * 
+ * returns 0 or -1 if the image cannot be checked
+*/
+int open_image(char *filename) {
+    /* The superblock fits in the smallest block size */
+    if (set_block_device(open_file_device(filename, 512, 1, false)) < 0) return -1;
+
+    geometry_t geometry;
+    if (read_geometry(&geometry) < 0) {
+        printf("%s: invalid superblock -- cannot check the file system\n", filename);
+        close_disk();
+        return -1;
+    }
+    disk_geometry = geometry;
+    close_disk();
+
+    /* A mapping past the end of the image cannot be read */
+    struct stat image;
+    if (stat(filename, &image) < 0 || image.st_size < (off_t) BLOCK_SIZE * disk_geometry.num_blocks) {
+        printf("%s: the image is smaller than its geometry\n", filename);
+        return -1;
+    }
+    return set_block_device(open_mmap_device(filename, BLOCK_SIZE, disk_geometry.num_blocks, false));
+}
+
+/**
+ * load_metadata -- Reads the INode table, the free bitmap and the blocks of the directory,
+ *                  where each region is read with a single sequential request.
+*/
+void load_metadata() {
+    fsck_inodes = (inode_t *) calloc(INODE_TABLE_SIZE, BLOCK_SIZE);
+    fsck_fbm = (uint8_t *) calloc(FREE_BITMAP_SIZE, BLOCK_SIZE);
+    fsck_dirs = (dirent_t *) calloc(DIR_BLOCK_SIZE, BLOCK_SIZE);
+    fsck_refs = (uint16_t *) calloc(disk_geometry.num_blocks, sizeof(uint16_t));
+    fsck_links = (int *) calloc(INODE_LENGTH, sizeof(int));
+
+    read_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, fsck_inodes);
+    read_blocks(FBM_START, FREE_BITMAP_SIZE, fsck_fbm);
+
+    /* The entries of the blocks that have not been assigned are unused */
+    for (int i = 0; i < DIR_ENTRY_SIZE; i++)
+        fsck_dirs[i].inode = -1;
+    for (int i = 0; i < DIR_BLOCK_SIZE; i++)
+        if (is_data_block(fsck_inodes[0].pointers[i]))
+            read_blocks(fsck_inodes[0].pointers[i], 1, &fsck_dirs[i * DIR_PER_BLOCK]);
+}
+
+/**
+ * check_directory -- Verifies that each directory entry refers to an INode in use, and
+ *                    counts the directory entries of each INode. An entry that refers
+ *                    to an INode that is not in use is removed.
+*/
+void check_directory() {
+    for (int i = 1; i < DIR_ENTRY_SIZE; i++) {
+        dirent_t *entry = &fsck_dirs[i];
+        if (entry -> inode < 0) continue;
+
+        if (entry -> inode == 0 || entry -> inode >= INODE_LENGTH || fsck_inodes[entry -> inode].link_cnt <= 0) {
+            report(fsck_repair, "directory entry %d (%.*s) refers to INode %d that is not in use",
+                i, (int) sizeof(entry -> filename), entry -> filename, entry -> inode);
+            if (fsck_repair) {
+                memset(entry -> filename, 0, sizeof(entry -> filename));
+                entry -> inode = -1;
+            }
+            continue;
+        }
+        fsck_links[entry -> inode]++;
+    }
+}
+
+/**
+ * check_inodes -- Checks every INode with the pool of threads. Each thread starts with an
+ *                 equal range of the INode table.
+*/
+void check_inodes() {
+    int per_thread = (INODE_LENGTH + fsck_threads - 1) / fsck_threads;
+
+    for (int i = 0; i < fsck_threads; i++) {
+        fsck_worker_t *worker = &fsck_workers[i];
+        pthread_mutex_init(&worker -> lock, NULL);
+        worker -> next = i * per_thread < INODE_LENGTH ? i * per_thread : INODE_LENGTH;
+        worker -> end = worker -> next + per_thread < INODE_LENGTH ? worker -> next + per_thread : INODE_LENGTH;
+        worker -> geometry = disk_geometry;
+        worker -> device = get_block_device();
+    }
+    for (int i = 0; i < fsck_threads; i++)
+        pthread_create(&fsck_workers[i].thread, NULL, fsck_worker, &fsck_workers[i]);
+    for (int i = 0; i < fsck_threads; i++) {
+        pthread_join(fsck_workers[i].thread, NULL);
+        pthread_mutex_destroy(&fsck_workers[i].lock);
+    }
+}
+
+/**
+ * fsck_worker -- Checks the INodes of the range of the thread, then steals from the
+ *                other threads until every range is empty.
+ * 
+ * arg: thread of the pool
+*/
+void* fsck_worker(void *arg) {
+    fsck_worker_t *worker = (fsck_worker_t *) arg;
+    int first, last;
+
+    /* The disk is read through the device opened by the main thread */
+    disk_geometry = worker -> geometry;
+    share_block_device(worker -> device);
+
+    while (take_inodes(worker, &first, &last) || (steal_inodes(worker) && take_inodes(worker, &first, &last)))
+        for (int index = first; index < last; index++)
+            check_inode(index);
+
+    share_block_device(NULL);
+    return NULL;
+}
+
+/**
+ * take_inodes -- Takes the next chunk of INodes from the start of the range of the thread.
+ * 
+ * worker: thread of the pool
+ * first: set to the first INode of the chunk
+ * last: set to the INode after the chunk
+ * 
+ * returns false if the range is empty
+*/
+bool take_inodes(fsck_worker_t *worker, int *first, int *last) {
+    pthread_mutex_lock(&worker -> lock);
+    *first = worker -> next;
+    *last = worker -> next + FSCK_CHUNK < worker -> end ? worker -> next + FSCK_CHUNK : worker -> end;
+    worker -> next = *last;
+    pthread_mutex_unlock(&worker -> lock);
+
+    return *first < *last;
+}
+
+/**
+ * steal_inodes -- Moves the second half of the range of another thread to the thief.
+ * 
+ * thief: thread of the pool whose range is empty
+ * 
+ * returns false if every other range is empty
+*/
+bool steal_inodes(fsck_worker_t *thief) {
+    int self = thief - fsck_workers;
+
+    for (int i = 1; i < fsck_threads; i++) {
+        fsck_worker_t *victim = &fsck_workers[(self + i) % fsck_threads];
+
+        pthread_mutex_lock(&victim -> lock);
+        int remaining = victim -> end - victim -> next;
+        int stolen = remaining / 2 > 0 ? remaining / 2 : remaining;
+        victim -> end -= stolen;
+        pthread_mutex_unlock(&victim -> lock);
+        if (stolen == 0) continue;
+
+        pthread_mutex_lock(&thief -> lock);
+        thief -> next = victim -> end;
+        thief -> end = victim -> end + stolen;
+        pthread_mutex_unlock(&thief -> lock);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * check_inode -- Verifies an INode: its link counter against its directory entries, its
+ *                pointers against the data blocks and its size against its pointers.
+ *                Each block it refers to is counted for the check of the free bitmap.
+ * 
+ * index: index of the INode
+*/
+void check_inode(int index) {
+    inode_t *inode = &fsck_inodes[index];
+    if (inode -> link_cnt <= 0) return;
+
+    /* The root directory has no directory entry */
+    int links = index == 0 ? 1 : fsck_links[index];
+    if (links == 0) {
+        report(fsck_repair, "INode %d is in use but has no directory entry", index);
+        if (fsck_repair) {
+            /* Its blocks are not counted, so they are released by the check of the free bitmap */
+            memset(inode, 0, sizeof(inode_t));
+            memset(inode -> pointers, -1, sizeof(inode -> pointers));
+            inode -> ind_pointer = inode -> dind_pointer = inode -> tind_pointer = -1;
+            return;
+        }
+    } else if (inode -> link_cnt != links) {
+        report(fsck_repair, "INode %d has a link counter of %d but %d directory entries", index, inode -> link_cnt, links);
+        if (fsck_repair) inode -> link_cnt = links;
+    }
+
+    bool changed = false;
+    int64_t last = -1;
+    for (int i = 0; i < INODE_POINTER_SIZE; i++)
+        if (check_pointer(index, &inode -> pointers[i], i, &changed)) last = i;
+
+    block_addr_t *roots[3] = { &inode -> ind_pointer, &inode -> dind_pointer, &inode -> tind_pointer };
+    int64_t first = INODE_POINTER_SIZE, span = INODE_IND_POINTER_SIZE;
+    for (int depth = 1; depth <= 3; depth++) {
+        int64_t tree_last = check_tree(index, roots[depth - 1], depth, first, &changed);
+        if (tree_last > last) last = tree_last;
+        first += span;
+        span *= INODE_IND_POINTER_SIZE;
+    }
+    if (index == 0) return;
+
+    /* The size has to cover every data block of the file */
+    if (inode -> flags & INODE_FLAG_INLINE) {
+        if (inode -> size < 0 || inode -> size > INODE_INLINE_SIZE) {
+            report(fsck_repair, "INode %d has an inline size of %" PRId64, index, inode -> size);
+            if (fsck_repair) inode -> size = inode -> size < 0 ? 0 : INODE_INLINE_SIZE;
+        }
+    } else if (inode -> size < 0 || (last >= 0 && inode -> size <= last * BLOCK_SIZE)) {
+        report(fsck_repair, "INode %d has a size of %" PRId64 " but data blocks up to pointer %" PRId64,
+            index, inode -> size, last);
+        if (fsck_repair) inode -> size = (last + 1) * BLOCK_SIZE;
+    }
+}
+
+/**
+ * check_pointer -- Verifies that a pointer refers to a data block, and counts the data block.
+ *                  A pointer outside of the data blocks becomes a hole.
+ * 
+ * index: index of the INode
+ * pointer: pointer to be checked
+ * pointer_index: index of the pointer within the file
+ * changed: set to true if the pointer is repaired
+ * 
+ * returns true if the pointer refers to a data block
+*/
+bool check_pointer(int index, block_addr_t *pointer, int64_t pointer_index, bool *changed) {
+    if (*pointer == -1 || *pointer == COMPRESSED_POINTER) return false;
+
+    if (!is_data_block(*pointer)) {
+        report(fsck_repair, "INode %d: pointer %" PRId64 " refers to block %" PRId64 " outside of the data blocks",
+            index, pointer_index, *pointer);
+        if (fsck_repair) {
+            *pointer = -1;
+            *changed = true;
+        }
+        return false;
+    }
+    count_ref(*pointer);
+    return true;
+}
+
+/**
+ * check_tree -- Verifies an indirect block and the pointers below it. An indirect block
+ *               outside of the data blocks is dropped with the pointers below it.
+ * 
+ * index: index of the INode
+ * root: pointer to the indirect block
+ * depth: number of levels of indirect blocks of the tree
+ * first: index within the file of the first pointer of the tree
+ * changed: set to true if the pointer to the indirect block is repaired
+ * 
+ * returns the index of the last pointer of the tree that refers to a data block, or -1
+*/
+int64_t check_tree(int index, block_addr_t *root, int depth, int64_t first, bool *changed) {
+    if (*root == -1) return -1;
+    if (!is_data_block(*root)) {
+        report(fsck_repair, "INode %d: indirect block %" PRId64 " is outside of the data blocks", index, *root);
+        if (fsck_repair) {
+            *root = -1;
+            *changed = true;
+        }
+        return -1;
+    }
+    count_ref(*root);
+
+    block_t block;
+    block_addr_t *entries = block.pointers;
+    bool block_changed = false;
+    int64_t last = -1, span = 1;
+    for (int level = 1; level < depth; level++)
+        span *= INODE_IND_POINTER_SIZE;
+
+    read_blocks(*root, 1, &block);
+    for (int64_t i = 0; i < INODE_IND_POINTER_SIZE; i++) {
+        int64_t pointer_index = first + i * span;
+        if (depth > 1) {
+            int64_t tree_last = check_tree(index, &entries[i], depth - 1, pointer_index, &block_changed);
+            if (tree_last > last) last = tree_last;
+        } else if (check_pointer(index, &entries[i], pointer_index, &block_changed)) {
+            last = pointer_index;
+        }
+    }
+
+    if (block_changed) write_blocks(*root, 1, &block);
+    return last;
+}
+
+/**
+ * check_fbm -- Verifies that the free bitmap holds the number of pointers that refer to each
+ *              data block, and that the blocks outside of the data blocks are taken.
+*/
+void check_fbm() {
+    for (block_addr_t i = 0; i < disk_geometry.num_blocks; i++) {
+        int expected = 1;
+        if (is_data_block(i)) expected = fsck_refs[i] < BLOCK_MAX_REFS ? fsck_refs[i] : BLOCK_MAX_REFS;
+        if (fsck_fbm[i] == expected) continue;
+
+        report(fsck_repair, "block %" PRId64 " has %d references in the free bitmap but %d pointers",
+            i, fsck_fbm[i], expected);
+        if (fsck_repair) fsck_fbm[i] = expected;
+    }
+}
+
+/**
+ * check_counters -- Verifies the free space counters of the superblock against the free bitmap
+ *                   and the INode table. Counters that have changed since their last checkpoint
+ *                   are counted again when the disk is opened, so only checkpointed ones are
+ *                   verified. The counted values are written with the other repairs.
+*/
+void check_counters() {
+    counters_t stored;
+    bool clean = read_counters(&stored);
+
+    disk_counters.free_blocks = 0;
+    disk_counters.free_extents = 0;
+    disk_counters.free_inodes = 0;
+    for (block_addr_t i = DATA_START; i < DATA_END; i++) {
+        if (fsck_fbm[i] != 0) continue;
+        disk_counters.free_blocks++;
+        if (fsck_fbm[i - 1] != 0) disk_counters.free_extents++;
+    }
+    for (int i = 0; i < INODE_LENGTH; i++)
+        if (fsck_inodes[i].link_cnt == 0) disk_counters.free_inodes++;
+
+    if (clean && (stored.free_blocks != disk_counters.free_blocks ||
+        stored.free_extents != disk_counters.free_extents || stored.free_inodes != disk_counters.free_inodes))
+        report(fsck_repair, "superblock counts %" PRId64 " free blocks in %" PRId64 " runs and %d free INodes "
+            "but the disk has %" PRId64 " free blocks in %" PRId64 " runs and %d free INodes",
+            stored.free_blocks, stored.free_extents, stored.free_inodes,
+            disk_counters.free_blocks, disk_counters.free_extents, disk_counters.free_inodes);
+}
+
+/**
+ * write_metadata -- Writes the repaired INode table, directory, free bitmap and counters to the disk.
+*/
+void write_metadata() {
+    write_blocks(SUPERBLOCK_SIZE, INODE_TABLE_SIZE, fsck_inodes);
+    for (int i = 0; i < DIR_BLOCK_SIZE; i++)
+        if (is_data_block(fsck_inodes[0].pointers[i]))
+            write_blocks(fsck_inodes[0].pointers[i], 1, &fsck_dirs[i * DIR_PER_BLOCK]);
+    write_blocks(FBM_START, FREE_BITMAP_SIZE, fsck_fbm);
+    write_superblock(true);
+    flush_blocks();
+}
+
+/**
+ * is_data_block -- Checks if a block index is inside the data blocks.
+ * 
+ * block_index: index of the block
+ * 
+ * returns true if the block is a data block
+*/
+bool is_data_block(block_addr_t block_index) {
+    return block_index >= DATA_START && block_index < DATA_END;
+}
+
+/**
+ * count_ref -- Counts one more pointer to a block. The threads count concurrently.
+ * 
+ * block_index: index of the block
+*/
+void count_ref(block_addr_t block_index) {
+    __atomic_fetch_add(&fsck_refs[block_index], 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * report -- Prints a problem of the disk.
+ * 
+ * repaired: the problem has been repaired
+ * format: description of the problem
+*/
+void report(bool repaired, const char *format, ...) {
+    va_list args;
+
+    pthread_mutex_lock(&fsck_report_lock);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf(repaired ? " -- repaired\n" : "\n");
+
+    fsck_problems++;
+    if (repaired) fsck_repaired++;
+    pthread_mutex_unlock(&fsck_report_lock);
+}
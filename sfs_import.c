@@ -0,0 +1,262 @@
+/**
+ * Simple File System Import
+ * ------------------------------
+ * Copies the regular files of a host directory tree into a disk image. The path of each file
+ * within the directory becomes its filename, e.g. docs/a.txt, and a file that is already on
+ * the disk is replaced. Files whose path does not fit in a directory entry are skipped.
+ * 
+ * The host files are read by a pool of threads that hand their content to the main thread
+ * through a pipeline, while the main thread, which mounts the disk, writes each file with a
+ * single sfs_fwrite and creates the files in batches so that the INode table, the directory
+ * and the free bitmap are written once per batch.
+ * 
+ * With -n, a new disk is created, with the geometry given by -g if any, e.g. -g 4096,65536,1024
+ * for 65536 blocks of 4096 bytes and 1024 files.
+ * 
+ * usage: sfs_import [-n] [-g block_size,num_blocks,inode_count] [-j threads] [-i image] directory
+ * 
+ * exits with 0 once every file has been imported or 1 if a file could not be imported
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "constant.h"
+#include "directory.h"
+#include "sfs_api.h"
+#include "pipeline.h"
+
+#define IMPORT_MAX_THREADS 64
+/* Number of files created by each batch of metadata updates */
+#define IMPORT_BATCH_FILES 64
+/* Largest write handed to sfs_fwrite */
+#define IMPORT_CHUNK (1 << 30)
+/* Longest filename held by a directory entry */
+#define IMPORT_MAX_NAME (sizeof(((dirent_t *) NULL) -> filename) - 1)
+
+/* Host files to be imported, taken in order by the reading threads */
+pipeline_item_t **import_files = NULL;
+int import_count = 0;
+int import_capacity = 0;
+int import_next = 0;
+pthread_mutex_t import_lock = PTHREAD_MUTEX_INITIALIZER;
+
+pipeline_t import_pipeline;
+
+/* Helper Functions */
+int find_files(const char *root, const char *name);
+void* read_worker(void *arg);
+int import_file(pipeline_item_t *item);
+
+int main(int argc, char **argv) {
+    char *image = DISK_NAME;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int fresh = 0;
+    int block_size, inode_count;
+    int64_t num_blocks;
+    int option;
+
+    while ((option = getopt(argc, argv, "ng:j:i:")) != -1) {
+        if (option == 'n') {
+            fresh = 1;
+        } else if (option == 'g' && sscanf(optarg, "%d,%" SCNd64 ",%d", &block_size, &num_blocks, &inode_count) == 3 &&
+            sfs_set_geometry(block_size, num_blocks, inode_count) == 0) {
+            continue;
+        } else if (option == 'j') {
+            threads = atoi(optarg);
+        } else if (option == 'i') {
+            image = optarg;
+        } else {
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-n] [-g block_size,num_blocks,inode_count] [-j threads] [-i image] directory\n", argv[0]);
+        return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int failed = find_files(argv[optind], "");
+    if (failed < 0) {
+        fprintf(stderr, "Could not open %s\n", argv[optind]);
+        return 1;
+    }
+
+    sfs_options_t options = { fresh, SFS_DURABILITY_NONE, SFS_DEVICE_FILE };
+    sfs_t *fs = sfs_mount(image, &options);
+    if (fs == NULL) {
+        fprintf(stderr, "Could not open %s\n", image);
+        return 1;
+    }
+
+    /* The host files are read in parallel while the main thread writes them to the disk */
+    pthread_t readers[IMPORT_MAX_THREADS];
+    init_pipeline(&import_pipeline, PIPELINE_MAX_BYTES, threads);
+    for (int i = 0; i < threads; i++)
+        pthread_create(&readers[i], NULL, read_worker, NULL);
+
+    int files = 0;
+    int64_t bytes = 0;
+    pipeline_item_t *item;
+    sfs_batch_begin();
+    while ((item = pop_item(&import_pipeline)) != NULL) {
+        if (import_file(item) < 0) {
+            failed++;
+        } else {
+            files++;
+            bytes += item -> length;
+        }
+        free_item(item);
+
+        if ((files + failed) % IMPORT_BATCH_FILES == 0) {
+            sfs_batch_commit();
+            sfs_batch_begin();
+        }
+    }
+    sfs_batch_commit();
+
+    for (int i = 0; i < threads; i++)
+        pthread_join(readers[i], NULL);
+    free_pipeline(&import_pipeline);
+    free(import_files);
+    if (sfs_unmount(fs) < 0) {
+        fprintf(stderr, "Could not write %s\n", image);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%s: %d files, %" PRId64 " bytes imported in %.3f s with %d threads, %d failed\n",
+        image, files, bytes, seconds, threads, failed);
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * find_files -- Adds the regular files of a host directory and of its subdirectories to
+ *               the list of files to be imported. Symbolic links are not followed.
+ * 
+ * root: host directory given to the tool
+ * name: path of the directory within root, empty for root itself
+ * 
+ * returns the number of files skipped or -1 if root cannot be opened
+*/
+int find_files(const char *root, const char *name) {
+    char path[PATH_MAX], child[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s%s", root, *name ? "/" : "", name);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) return *name ? 1 : -1;
+
+    int skipped = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry -> d_name, ".") == 0 || strcmp(entry -> d_name, "..") == 0) continue;
+
+        struct stat info;
+        snprintf(child, sizeof(child), "%s%s%s", name, *name ? "/" : "", entry -> d_name);
+        if (snprintf(path, sizeof(path), "%s/%s", root, child) >= (int) sizeof(path) || lstat(path, &info) < 0) continue;
+
+        if (S_ISDIR(info.st_mode)) {
+            skipped += find_files(root, child);
+        } else if (S_ISREG(info.st_mode)) {
+            if (strlen(child) > IMPORT_MAX_NAME) {
+                fprintf(stderr, "%s: filename longer than %d characters, skipped\n", child, (int) IMPORT_MAX_NAME);
+                skipped++;
+                continue;
+            }
+            if (import_count == import_capacity) {
+                import_capacity = import_capacity == 0 ? 64 : import_capacity * 2;
+                import_files = (pipeline_item_t **) realloc(import_files, import_capacity * sizeof(pipeline_item_t *));
+            }
+            import_files[import_count++] = new_item(child, path);
+        }
+    }
+    closedir(dir);
+
+    return skipped;
+}
+
+/**
+ * read_worker -- Reads the host files in turn and hands their content to the main thread.
+ *                A file that cannot be read is handed without content.
+ * 
+ * arg: unused
+*/
+void* read_worker(void *arg) {
+    while (true) {
+        pthread_mutex_lock(&import_lock);
+        int index = import_next < import_count ? import_next++ : -1;
+        pthread_mutex_unlock(&import_lock);
+        if (index < 0) break;
+
+        pipeline_item_t *item = import_files[index];
+        FILE *file = fopen(item -> path, "rb");
+        struct stat info;
+        if (file != NULL && fstat(fileno(file), &info) == 0) {
+            item -> data = (char *) malloc(info.st_size > 0 ? info.st_size : 1);
+            item -> length = fread(item -> data, 1, info.st_size, file);
+            if (item -> length != info.st_size) {
+                free(item -> data);
+                item -> data = NULL;
+                item -> length = 0;
+            }
+        }
+        if (file != NULL) fclose(file);
+        push_item(&import_pipeline, item);
+    }
+
+    end_producer(&import_pipeline);
+    return NULL;
+}
+
+/**
+ * import_file -- Writes the content of a host file to the disk in place of the file with
+ *                the same name. The file is removed again if the disk is full.
+ * 
+ * item: host file with its content
+ * 
+ * returns 0 or -1 if the file could not be imported
+*/
+int import_file(pipeline_item_t *item) {
+    if (item -> data == NULL) {
+        fprintf(stderr, "%s: could not be read\n", item -> path);
+        return -1;
+    }
+
+    /* A file already on the disk is replaced */
+    sfs_remove(item -> name);
+    int fd = sfs_fopen(item -> name);
+    if (fd < 0) {
+        fprintf(stderr, "%s: no INode or directory entry left\n", item -> name);
+        return -1;
+    }
+
+    int64_t written = 0;
+    while (written < item -> length) {
+        int length = item -> length - written > IMPORT_CHUNK ? IMPORT_CHUNK : item -> length - written;
+        int result = sfs_fwrite(fd, item -> data + written, length);
+        if (result <= 0) break;
+        written += result;
+    }
+    sfs_fclose(fd);
+
+    if (written < item -> length) {
+        fprintf(stderr, "%s: disk full\n", item -> name);
+        sfs_remove(item -> name);
+        return -1;
+    }
+    return 0;
+}
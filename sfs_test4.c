@@ -0,0 +1,846 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sfs_api.h"
+#include "scan.h"
+#include "inode.h"
+#include "writeback.h"
+
+#define LARGE_SIZE (200 * 1024 + 123)
+
+void red () {
+  printf("\033[1;31m");
+}
+
+void green () {
+  printf("\033[1;32m");
+}
+
+void reset () {
+  printf("\033[0m");
+}
+
+void check(int passed, char *name) {
+    if (passed) {
+        green();
+        printf("%s test passed\n", name);
+    } else {
+        red();
+        printf("ERROR: %s test failed\n", name);
+    }
+    reset();
+}
+
+/* Each thread mounts its own disk, writes a file and reads it back once the disk is mounted again */
+void* mount_worker(void *arg) {
+    int index = *(int *) arg;
+    char path[20], data[8192], out[8192];
+    sprintf(path, "file_sys.t%d", index);
+    for (int i = 0; i < 8192; i++)
+        data[i] = (char) (i * 7 + index);
+
+    sfs_options_t options = { 1, SFS_DURABILITY_NONE, SFS_DEVICE_FILE };
+    sfs_t *fs = sfs_mount(path, &options);
+    int passed = fs != NULL && sfs_mount(path, &options) == NULL;
+    int f = sfs_fopen("thread.bin");
+    passed = passed && sfs_fwrite(f, data, 8192) == 8192;
+    sfs_fclose(f);
+    passed = passed && sfs_unmount(fs) == 0 && sfs_unmount(fs) == -1;
+
+    fs = sfs_mount(path, NULL);
+    f = sfs_fopen("thread.bin");
+    passed = passed && fs != NULL && sfs_pread(f, out, 8192, 0) == 8192 && memcmp(data, out, 8192) == 0;
+    sfs_fclose(f);
+    passed = passed && sfs_unmount(fs) == 0;
+
+    *(int *) arg = passed;
+    return NULL;
+}
+
+/* The device behind a write-back cache fails its writes while this is set */
+int failing_writes = 0;
+int (*ram_write)(block_device_t *device, int64_t start_address, int nblocks, void *buffer);
+
+int flaky_write(block_device_t *device, int64_t start_address, int nblocks, void *buffer) {
+    return failing_writes ? -1 : ram_write(device, start_address, nblocks, buffer);
+}
+
+/* Gets the scan kernels that a new thread starts with */
+void* scan_level_worker(void *arg) {
+    *(int *) arg = get_scan_level();
+    return NULL;
+}
+
+int main() {
+    /* The deduplication mode can be set before a disk is opened */
+    sfs_set_dedup(1);
+    mksfs(1);
+    sfs_set_dedup(0);
+
+    /* Write and read back a file that uses the indirect pointer */
+    char *large = (char *) malloc(LARGE_SIZE);
+    char *out = (char *) malloc(LARGE_SIZE);
+    for (int i = 0; i < LARGE_SIZE; i++)
+        large[i] = (char) (i * 31 + i / 1024);
+
+    int f = sfs_fopen("large.bin");
+    int written = sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_fseek(f, 0);
+    int read = sfs_fread(f, out, LARGE_SIZE);
+    check(written == LARGE_SIZE && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Large sfs_fwrite/sfs_fread");
+    check(sfs_getfilesize("large.bin") == LARGE_SIZE, "Large sfs_getfilesize");
+
+    /* Positional reads and writes do not move the read/write pointer */
+    char word[8];
+    sfs_fseek(f, 10);
+    sfs_pwrite(f, "positio", 7, 5000);
+    memcpy(large + 5000, "positio", 7);
+    memset(word, 0, sizeof(word));
+    sfs_pread(f, word, 7, 5000);
+    read = sfs_fread(f, out, 4);
+    check(strcmp(word, "positio") == 0 && read == 4 && memcmp(out, large + 10, 4) == 0, "sfs_pwrite/sfs_pread");
+    check(sfs_pread(f, out, 100, LARGE_SIZE - 10) == 10, "sfs_pread at the end of the file");
+
+    /* Scatter-gather reads and writes */
+    char head[3], middle[2000], tail[50];
+    sfs_iovec_t iov[3] = {
+        { .base = head, .length = sizeof(head) },
+        { .base = middle, .length = sizeof(middle) },
+        { .base = tail, .length = sizeof(tail) }
+    };
+    sfs_fseek(f, 1020);
+    read = sfs_freadv(f, iov, 3);
+    check(read == 2053 && memcmp(head, large + 1020, 3) == 0 && memcmp(middle, large + 1023, 2000) == 0 &&
+        memcmp(tail, large + 3023, 50) == 0, "sfs_freadv");
+
+    memset(head, 'a', sizeof(head));
+    memset(middle, 'b', sizeof(middle));
+    memset(tail, 'c', sizeof(tail));
+    sfs_fseek(f, 3000);
+    written = sfs_fwritev(f, iov, 3);
+    memset(large + 3000, 'a', 3);
+    memset(large + 3003, 'b', 2000);
+    memset(large + 5003, 'c', 50);
+    sfs_fseek(f, 0);
+    read = sfs_fread(f, out, LARGE_SIZE);
+    check(written == 2053 && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "sfs_fwritev");
+    sfs_fclose(f);
+
+    /* The data is still there after the disk is opened again */
+    mksfs(0);
+    f = sfs_fopen("large.bin");
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Reopened disk");
+    sfs_fclose(f);
+
+    check(sfs_remove("large.bin") == 0, "sfs_remove");
+
+    /* Small files are kept inside the INode until they outgrow it */
+    char small[100];
+    for (int i = 0; i < sizeof(small); i++)
+        small[i] = 'A' + i % 26;
+    f = sfs_fopen("small.txt");
+    sfs_fwrite(f, small, 10);
+    sfs_fwrite(f, small + 10, 30);
+    memset(out, 0, sizeof(small));
+    read = sfs_pread(f, out, sizeof(small), 0);
+    check(read == 40 && memcmp(out, small, 40) == 0, "Inline sfs_fwrite/sfs_fread");
+    sfs_fwrite(f, small + 40, 60);
+    memset(out, 0, sizeof(small));
+    read = sfs_pread(f, out, sizeof(small), 0);
+    check(read == 100 && memcmp(out, small, 100) == 0, "Inline file grown past the INode");
+    sfs_fclose(f);
+    sfs_remove("small.txt");
+
+    /* Compressed files are read back the same way */
+    char *text = (char *) malloc(LARGE_SIZE);
+    for (int i = 0; i < LARGE_SIZE; i++)
+        text[i] = "The quick brown fox jumps over the lazy dog "[(i + i / 5000) % 44];
+    f = sfs_fopen("text.txt");
+    sfs_fsetcompression(f, 1);
+    sfs_fwrite(f, text, LARGE_SIZE);
+    sfs_statfs_t uncompressed, compressed;
+    sfs_statfs(&uncompressed);
+    sfs_fclose(f);
+    sfs_statfs(&compressed);
+    check(compressed.free_blocks > uncompressed.free_blocks, "Blocks freed by the compression");
+    f = sfs_fopen("text.txt");
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(text, out, LARGE_SIZE) == 0, "Compressed sfs_fread");
+    read = sfs_pread(f, out, 3000, 70000);
+    check(read == 3000 && memcmp(text + 70000, out, 3000) == 0, "Compressed sfs_pread");
+    sfs_pwrite(f, "overwritten", 11, 9000);
+    memcpy(text + 9000, "overwritten", 11);
+    sfs_fclose(f);
+    f = sfs_fopen("text.txt");
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(text, out, LARGE_SIZE) == 0, "Compressed file overwritten");
+    sfs_fclose(f);
+    sfs_remove("text.txt");
+
+    /* A small write to a compressed cluster of a file that is no longer compressed keeps the cluster */
+    sfs_set_compression(1);
+    f = sfs_fopen("decompressed.txt");
+    sfs_fwrite(f, text, 4096);
+    sfs_fclose(f);
+    sfs_set_compression(0);
+    f = sfs_fopen("decompressed.txt");
+    sfs_fsetcompression(f, 0);
+    sfs_fseek(f, 10);
+    sfs_fwrite(f, "x", 1);
+    read = sfs_pread(f, out, 4096, 0);
+    int patched = read == 4096 && out[10] == 'x' && memcmp(out, text, 10) == 0 && memcmp(out + 11, text + 11, 4085) == 0;
+    sfs_fclose(f);
+    mksfs(0);
+    f = sfs_fopen("decompressed.txt");
+    read = sfs_pread(f, out, 4096, 0);
+    check(patched && read == 4096 && out[10] == 'x' && memcmp(out + 11, text + 11, 4085) == 0,
+        "Small write to a compressed cluster after sfs_fsetcompression(0)");
+    sfs_fclose(f);
+    sfs_remove("decompressed.txt");
+
+    /* The blocks of a file whose compression is disabled are shared one by one */
+    sfs_set_compression(1);
+    f = sfs_fopen("expanded.txt");
+    sfs_fwrite(f, text, 16384);
+    sfs_fclose(f);
+    sfs_set_compression(0);
+    f = sfs_fopen("expanded.txt");
+    int expanded_copy = sfs_fopen("expanded_copy.txt");
+    int64_t expanded = sfs_fsetcompression(f, 0) == 0 ? sfs_copy_range(f, 0, expanded_copy, 1024, 16384) : -1;
+    memset(out, 0, 16384);
+    read = sfs_pread(expanded_copy, out, 16384, 1024);
+    check(expanded == 16384 && read == 16384 && memcmp(out, text, 16384) == 0, "Copy of a file whose compression is disabled");
+    sfs_fclose(expanded_copy);
+    sfs_fclose(f);
+    sfs_remove("expanded_copy.txt");
+    sfs_remove("expanded.txt");
+
+    /* A cluster that does not compress is read without the compressed cluster after it */
+    char mixed[12000];
+    unsigned int seed = 1;
+    for (int i = 0; i < sizeof(mixed); i++) {
+        seed = seed * 1103515245 + 12345;
+        mixed[i] = i < 9000 ? (char) (seed >> 16) : 0;
+    }
+    f = sfs_fopen("mixed.bin");
+    sfs_fsetcompression(f, 1);
+    sfs_fwrite(f, mixed, sizeof(mixed));
+    sfs_fclose(f);
+    f = sfs_fopen("mixed.bin");
+    read = sfs_pread(f, out, sizeof(mixed), 0);
+    int mixed_read = read == sizeof(mixed) && memcmp(mixed, out, sizeof(mixed)) == 0;
+    sfs_fallocate(f, sizeof(mixed), 4096);
+    read = sfs_pread(f, out, sizeof(mixed), 0);
+    check(mixed_read && read == sizeof(mixed) && memcmp(mixed, out, sizeof(mixed)) == 0, "Uncompressed cluster before a compressed one");
+    sfs_fclose(f);
+    sfs_remove("mixed.bin");
+
+    /* Files with the same blocks share them and are copied on write */
+    sfs_set_dedup(1);
+    int f1 = sfs_fopen("copy1.bin");
+    int f2 = sfs_fopen("copy2.bin");
+    sfs_fwrite(f1, large, LARGE_SIZE);
+    sfs_fwrite(f2, large, LARGE_SIZE);
+    sfs_pwrite(f2, "changed", 7, 20000);
+    read = sfs_pread(f1, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Deduplicated file left unchanged");
+    memcpy(large + 20000, "changed", 7);
+    read = sfs_pread(f2, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Deduplicated file copied on write");
+    sfs_fclose(f1);
+    sfs_fclose(f2);
+    sfs_remove("copy1.bin");
+    read = sfs_pread(f2 = sfs_fopen("copy2.bin"), out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Deduplicated file kept after remove");
+    sfs_fclose(f2);
+    sfs_remove("copy2.bin");
+
+    /* A block overwritten in place is not shared by a later block of the same write */
+    char x[1024], y[1024], zx[2048];
+    memset(x, 'x', sizeof(x));
+    memset(y, 'y', sizeof(y));
+    memset(zx, 'z', 1024);
+    memset(zx + 1024, 'x', 1024);
+    f = sfs_fopen("inplace.bin");
+    sfs_fwrite(f, x, sizeof(x));
+    sfs_fwrite(f, y, sizeof(y));
+    sfs_pwrite(f, zx, sizeof(zx), 0);
+    read = sfs_pread(f, out, sizeof(zx), 0);
+    check(read == sizeof(zx) && memcmp(zx, out, sizeof(zx)) == 0, "Deduplicated block overwritten in place");
+    sfs_fclose(f);
+    sfs_remove("inplace.bin");
+    sfs_set_dedup(0);
+
+    /* Holes are read as zeros and only the written blocks are assigned */
+    char *zeros = (char *) calloc(LARGE_SIZE, 1);
+    f = sfs_fopen("sparse.bin");
+    sfs_fseek(f, 150000);
+    sfs_fwrite(f, "end", 3);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == 150003 && memcmp(out, zeros, 150000) == 0 && memcmp(out + 150000, "end", 3) == 0, "Sparse file");
+
+    check(sfs_fallocate(f, 0, 160000) == 0 && sfs_getfilesize("sparse.bin") == 160000, "sfs_fallocate");
+    sfs_pwrite(f, large, 160000, 0);
+    check(sfs_punch_hole(f, 1000, 100000) == 0, "sfs_punch_hole");
+    memset(large + 1000, 0, 100000);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == 160000 && memcmp(out, large, 160000) == 0, "Punched file");
+    sfs_fclose(f);
+    sfs_remove("sparse.bin");
+    free(zeros);
+
+    /* Freed data blocks are cleared by sfs_discard */
+    sfs_set_discard(1);
+    f = sfs_fopen("discard.bin");
+    sfs_fwrite(f, large, 20000);
+    sfs_fclose(f);
+    sfs_remove("discard.bin");
+    check(sfs_discard() == 21 && sfs_discard() == 0, "sfs_discard");
+    sfs_set_discard(0);
+
+    /* Clones share the data blocks of the file until one of them is written */
+    f = sfs_fopen("original.bin");
+    sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_fclose(f);
+    check(sfs_clone("original.bin", "clone.bin") == 0 && sfs_clone("original.bin", "clone.bin") == -1 &&
+        sfs_getfilesize("clone.bin") == LARGE_SIZE, "sfs_clone");
+    f = sfs_fopen("clone.bin");
+    sfs_pwrite(f, "cloned", 6, 150000);
+    sfs_fclose(f);
+    f = sfs_fopen("original.bin");
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Original file left unchanged");
+    sfs_fclose(f);
+    sfs_remove("original.bin");
+    memcpy(large + 150000, "cloned", 6);
+    f = sfs_fopen("clone.bin");
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Cloned file copied on write");
+    sfs_fclose(f);
+    sfs_remove("clone.bin");
+
+    /* A copy at the same offset within the blocks shares the whole blocks of the range */
+    f = sfs_fopen("source.bin");
+    sfs_fwrite(f, large, LARGE_SIZE);
+    int copy = sfs_fopen("copy.bin");
+    sfs_statfs_t shared_before, shared_after;
+    sfs_statfs(&shared_before);
+    int64_t copied = sfs_copy_range(f, 0, copy, 0, LARGE_SIZE + 1000);
+    sfs_statfs(&shared_after);
+    read = sfs_pread(copy, out, LARGE_SIZE, 0);
+    check(copied == LARGE_SIZE && shared_before.free_blocks - shared_after.free_blocks <= 4 &&
+        read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "sfs_copy_range");
+    sfs_pwrite(copy, "copied", 6, 150000);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Source of a copy left unchanged");
+
+    /* Other offsets are copied by the file system, and a range may not overlap itself */
+    copied = sfs_copy_range(f, 100, copy, 7, 50000);
+    read = sfs_pread(copy, out, 50000, 7);
+    int unaligned = copied == 50000 && read == 50000 && memcmp(large + 100, out, 50000) == 0;
+    copied = sfs_copy_range(copy, 0, copy, LARGE_SIZE + 3000, 5000);
+    read = sfs_pread(copy, out, 5000, LARGE_SIZE + 3000);
+    unaligned = unaligned && copied == 5000 && read == 5000 && memcmp(large, out, 7) == 0 && memcmp(large + 100, out + 7, 4993) == 0;
+    check(unaligned && sfs_copy_range(copy, 0, copy, 4000, 5000) == -1 && sfs_copy_range(f, LARGE_SIZE - 10, copy, 0, 1000) == 10 &&
+        sfs_copy_range(f, 0, -1, 0, 10) == -1, "Unaligned sfs_copy_range");
+    sfs_fclose(copy);
+    sfs_fclose(f);
+    sfs_remove("source.bin");
+    sfs_remove("copy.bin");
+
+    /* The metadata of the ordered mode is written at the sync points */
+    check(sfs_set_durability(SFS_DURABILITY_ORDERED) == 0 && sfs_set_durability(3) == -1, "sfs_set_durability");
+    mksfs(0);
+    f = sfs_fopen("durable.bin");
+    written = sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_remove("durable.bin");
+    sfs_fclose(f);
+    f = sfs_fopen("durable.bin");
+    written += sfs_fwrite(f, large, LARGE_SIZE);
+    check(written == 2 * LARGE_SIZE && sfs_fsync(f) == 0 && sfs_fsync(-1) == -1, "sfs_fsync");
+    sfs_fclose(f);
+
+    /* The blocks freed since the last sync point are used again once the disk is full */
+    char *filler = (char *) calloc(900 * 1024, 1);
+    written = 0;
+    for (int round = 0; round < 3; round++) {
+        int g = sfs_fopen("filler.bin");
+        written += sfs_fwrite(g, filler, 900 * 1024);
+        sfs_fclose(g);
+        sfs_remove("filler.bin");
+    }
+    sfs_statfs_t held;
+    sfs_statfs(&held);
+    check(written == 3 * 900 * 1024 && held.free_blocks + held.used_blocks == held.total_blocks, "Freed blocks reused in the ordered mode");
+
+    /* The ordered mode commits its metadata once many blocks have been freed since the last sync */
+    sfs_statfs_t synced;
+    sfs_sync();
+    sfs_statfs(&synced);
+    written = 0;
+    for (int round = 0; round < 2; round++) {
+        int g = sfs_fopen("filler.bin");
+        written += sfs_fwrite(g, filler, 600 * 1024);
+        sfs_fclose(g);
+        sfs_remove("filler.bin");
+    }
+    sfs_statfs(&held);
+    check(written == 2 * 600 * 1024 && held.free_blocks == synced.free_blocks, "Freed blocks bound the ordered mode");
+    free(filler);
+    sfs_set_durability(SFS_DURABILITY_STRICT);
+    mksfs(0);
+    f = sfs_fopen("durable.bin");
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0 && sfs_sync() == 0, "Strict mode after the ordered mode");
+    sfs_fclose(f);
+    sfs_remove("durable.bin");
+    sfs_set_durability(SFS_DURABILITY_NONE);
+    mksfs(0);
+
+    /* The free space is counted as the blocks and INodes are used and released */
+    sfs_statfs_t before, during, after;
+    sfs_statfs(&before);
+    f = sfs_fopen("statfs.bin");
+    sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_fclose(f);
+    sfs_statfs(&during);
+    check(before.free_blocks + before.used_blocks == before.total_blocks &&
+        during.used_blocks >= before.used_blocks + LARGE_SIZE / 1024 &&
+        during.used_inodes == before.used_inodes + 1 && during.free_extents >= 1, "sfs_statfs");
+    sfs_remove("statfs.bin");
+    sfs_statfs(&during);
+    mksfs(0);
+    sfs_statfs(&after);
+    check(during.free_blocks == before.free_blocks && during.free_inodes == before.free_inodes &&
+        after.free_blocks == during.free_blocks && after.free_extents == during.free_extents &&
+        after.free_inodes == during.free_inodes, "sfs_statfs on the reopened disk");
+
+    /* A range larger than the free space is not allocated at all */
+    f = sfs_fopen("fallocate.bin");
+    sfs_fwrite(f, large, 2000);
+    sfs_statfs(&before);
+    int denied = sfs_fallocate(f, 0, (int64_t) (before.free_blocks + 8) * 1024) == -1;
+    sfs_statfs(&after);
+    read = sfs_pread(f, out, 4000, 0);
+    check(denied && sfs_getfilesize("fallocate.bin") == 2000 && after.free_blocks == before.free_blocks &&
+        read == 2000 && memcmp(out, large, 2000) == 0, "Failed sfs_fallocate");
+    sfs_fclose(f);
+    sfs_remove("fallocate.bin");
+
+    /* Files written in turns are spread across the disk until they are defragmented */
+    int fa = sfs_fopen("fragment_a.bin");
+    int fb = sfs_fopen("fragment_b.bin");
+    for (int i = 0; i < 40; i++) {
+        sfs_fwrite(fa, large + i * 2048, 2048);
+        sfs_fwrite(fb, text + i * 2048, 2048);
+    }
+    sfs_fclose(fb);
+    int64_t runs = sfs_fragmentation("fragment_a.bin");
+    int calls = 0, moved;
+    while ((moved = sfs_defrag("fragment_a.bin", 16)) > 0 && moved <= 16) calls++;
+    check(runs > 1 && moved == 0 && calls > 1 && sfs_fragmentation("fragment_a.bin") == 1 &&
+        sfs_fragmentation("missing.bin") == -1, "sfs_defrag");
+    read = sfs_pread(fa, out, 40 * 2048, 0);
+    check(read == 40 * 2048 && memcmp(large, out, 40 * 2048) == 0, "Defragmented file");
+    sfs_fclose(fa);
+    fb = sfs_fopen("fragment_b.bin");
+    read = sfs_pread(fb, out, 40 * 2048, 0);
+    check(read == 40 * 2048 && memcmp(text, out, 40 * 2048) == 0, "File next to a defragmented file");
+    sfs_fclose(fb);
+    sfs_remove("fragment_a.bin");
+    sfs_remove("fragment_b.bin");
+
+    /* In log mode, a block written again is moved to the head of the log */
+    sfs_set_log_mode(1);
+    int fl = sfs_fopen("log.bin");
+    sfs_fwrite(fl, large, 16 * 1024);
+    sfs_pwrite(fl, text, 1024, 4 * 1024);
+    memcpy(out + 16 * 1024, large, 16 * 1024);
+    memcpy(out + 16 * 1024 + 4 * 1024, text, 1024);
+    read = sfs_pread(fl, out, 16 * 1024, 0);
+    check(read == 16 * 1024 && memcmp(out, out + 16 * 1024, 16 * 1024) == 0 &&
+        sfs_fragmentation("log.bin") == 3, "Log mode writes out of place");
+    sfs_fclose(fl);
+    sfs_remove("log.bin");
+
+    /* Removing every other file leaves segments half used, which the cleaner packs */
+    char name[20];
+    int found;
+    for (int i = 0; i < 16; i++) {
+        sprintf(name, "segment%d.bin", i);
+        f = sfs_fopen(name);
+        sfs_fwrite(f, large + i * 8192, 8192);
+        sfs_fclose(f);
+    }
+    for (int i = 0; i < 16; i += 2) {
+        sprintf(name, "segment%d.bin", i);
+        sfs_remove(name);
+    }
+    sfs_statfs(&before);
+    int cleaned = sfs_clean(2);
+    sfs_statfs(&after);
+    check(cleaned >= 1 && after.free_blocks == before.free_blocks && sfs_clean(0) == -1, "sfs_clean");
+    found = 0;
+    for (int i = 1; i < 16; i += 2) {
+        sprintf(name, "segment%d.bin", i);
+        f = sfs_fopen(name);
+        if (sfs_pread(f, out, 8192, 0) == 8192 && memcmp(out, large + i * 8192, 8192) == 0) found++;
+        sfs_fclose(f);
+        sfs_remove(name);
+    }
+    check(found == 8, "Files of the cleaned segments");
+    sfs_set_log_mode(0);
+
+    /* Files created and removed in a batch are on the disk once it is committed */
+    sfs_batch_begin();
+    for (int i = 0; i < 60; i++) {
+        sprintf(name, "batch%d.txt", i);
+        f = sfs_fopen(name);
+        sfs_fwrite(f, name, strlen(name));
+        sfs_fclose(f);
+    }
+    for (int i = 0; i < 60; i += 2) {
+        sprintf(name, "batch%d.txt", i);
+        sfs_remove(name);
+    }
+    check(sfs_batch_commit() == 0 && sfs_batch_commit() == -1, "sfs_batch_commit");
+    mksfs(0);
+    found = 0;
+    for (int i = 0; i < 60; i++) {
+        sprintf(name, "batch%d.txt", i);
+        memset(out, 0, sizeof(name));
+        if (sfs_getfilesize(name) == (i % 2 ? (int) strlen(name) : -1)) found++;
+        if (i % 2 == 0) continue;
+        f = sfs_fopen(name);
+        if (sfs_pread(f, out, sizeof(name), 0) != (int) strlen(name) || strcmp(out, name) != 0) found--;
+        sfs_fclose(f);
+    }
+    check(found == 60, "Batched files on the reopened disk");
+    for (int i = 1; i < 60; i += 2) {
+        sprintf(name, "batch%d.txt", i);
+        sfs_remove(name);
+    }
+
+    /* A disk striped across image files is read back the same way */
+    check(sfs_set_stripes(4, 8) == 0, "sfs_set_stripes");
+    mksfs(1);
+    f = sfs_fopen("striped.bin");
+    written = sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_fclose(f);
+    mksfs(0);
+    f = sfs_fopen("striped.bin");
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(written == LARGE_SIZE && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Striped disk");
+    sfs_fclose(f);
+    sfs_set_stripes(1, 0);
+
+    /* A write whose indirect block does not fit keeps only the blocks that can be assigned */
+    mksfs(1);
+    f = sfs_fopen("nearly_full.bin");
+    for (sfs_statfs(&before); before.free_blocks > 14; sfs_statfs(&before))
+        sfs_fwrite(f, large, before.free_blocks > 64 ? 32 * 1024 : 1024);
+    sfs_fclose(f);
+    fa = sfs_fopen("indirect.bin");
+    written = sfs_fwrite(fa, large, 14 * 1024);
+    sfs_fclose(fa);
+    sfs_remove("indirect.bin");
+    sfs_statfs(&after);
+    check(before.free_blocks == 14 && written == 13 * 1024 && after.free_blocks == 14, "Indirect block on a full disk");
+    sfs_remove("nearly_full.bin");
+
+    /* The disk can be mapped in memory or only live in memory */
+    int devices[2] = { SFS_DEVICE_MMAP, SFS_DEVICE_RAM };
+    char *device_names[2] = { "Mapped disk", "RAM disk" };
+    for (int i = 0; i < 2; i++) {
+        sfs_set_device(devices[i]);
+        mksfs(1);
+        f = sfs_fopen("device.bin");
+        written = sfs_fwrite(f, large, LARGE_SIZE);
+        sfs_fclose(f);
+        mksfs(0);
+        f = sfs_fopen("device.bin");
+        memset(out, 0, LARGE_SIZE);
+        read = sfs_pread(f, out, LARGE_SIZE, 0);
+        check(written == LARGE_SIZE && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, device_names[i]);
+        sfs_fclose(f);
+    }
+
+    /* A mapped image file cut short is refused instead of being read past its end */
+    sfs_set_device(SFS_DEVICE_MMAP);
+    truncate("file_sys", 100 * 1024);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        mksfs(0);
+        _exit(EXIT_SUCCESS);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE, "Mapped disk cut short");
+    sfs_set_device(SFS_DEVICE_FILE);
+
+    /* The geometry of the disk is stored in its superblock */
+    check(sfs_set_geometry(4096, 2048, 256) == 0 && sfs_set_geometry(1000, 2048, 256) == -1, "sfs_set_geometry");
+    mksfs(1);
+    f = sfs_fopen("geometry.bin");
+    written = sfs_fwrite(f, large, LARGE_SIZE);
+    sfs_fclose(f);
+    sfs_set_geometry(1024, 1528, 160);
+    mksfs(0);
+    f = sfs_fopen("geometry.bin");
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    FILE *image = fopen("file_sys", "rb");
+    fseek(image, 0, SEEK_END);
+    check(written == LARGE_SIZE && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0 &&
+        ftell(image) == 4096 * 2048, "Disk with 4096 byte blocks");
+    fclose(image);
+    sfs_fclose(f);
+    check(sfs_set_geometry(4096, 3LL << 30, 256) == 0, "64-bit sfs_set_geometry");
+    sfs_set_geometry(1024, 1528, 160);
+
+    /* Offsets past 4 GB are reached through the triple indirect blocks */
+    int64_t far = 5LL * 1024 * 1024 * 1024;
+    char hole[4096] = { 0 };
+    f = sfs_fopen("far.bin");
+    check(sfs_pwrite(f, "far", 3, far) == 3 && sfs_getfilesize("far.bin") == far + 3, "64-bit sfs_pwrite");
+    check(sfs_fseek64(f, far) == 0 && sfs_fread(f, tail, 3) == 3 && memcmp(tail, "far", 3) == 0, "sfs_fseek64");
+    read = sfs_pread(f, out, 4096, far - 4096);
+    check(read == 4096 && memcmp(out, hole, 4096) == 0, "64-bit hole");
+    sfs_fclose(f);
+    sfs_remove("far.bin");
+
+    /* Small appends are gathered in the tail block of the file descriptor entry */
+    f = sfs_fopen("appends.bin");
+    int other = sfs_fopen("appends.bin");
+    int appended = 0;
+    for (int i = 0; i < 500; i++)
+        appended += sfs_fwrite(f, large + i * 37, 37) == 37;
+    read = sfs_pread(f, out, 37, 499 * 37);
+    check(appended == 500 && read == 37 && memcmp(out, large + 499 * 37, 37) == 0 &&
+        sfs_getfilesize("appends.bin") == 500 * 37, "Small appends");
+    read = sfs_pread(other, out, 500 * 37, 0);
+    check(read == 500 * 37 && memcmp(out, large, 500 * 37) == 0, "Small appends read through another entry");
+    sfs_pwrite(other, "tail", 4, 499 * 37);
+    memcpy(large + 499 * 37, "tail", 4);
+    for (int i = 500; i < 600; i++)
+        sfs_fwrite(f, large + i * 37, 37);
+    sfs_fclose(f);
+    sfs_fclose(other);
+    mksfs(0);
+    f = sfs_fopen("appends.bin");
+    read = sfs_pread(f, out, 600 * 37, 0);
+    check(read == 600 * 37 && memcmp(out, large, 600 * 37) == 0, "Small appends on the reopened disk");
+    sfs_fclose(f);
+    sfs_remove("appends.bin");
+
+    /* Buffered writes reach the file when the buffer is full, flushed or closed */
+    f = sfs_fopen("buffered.bin");
+    other = sfs_fopen("buffered.bin");
+    check(sfs_setvbuf(f, SFS_BUFFER_FULL, 4096) == 0 && sfs_setvbuf(f, 7, 4096) == -1 &&
+        sfs_setvbuf(f, SFS_BUFFER_FULL, 0) == -1 && sfs_setvbuf(-1, SFS_BUFFER_FULL, 4096) == -1, "sfs_setvbuf");
+    appended = 0;
+    for (int i = 0; i < 300; i++)
+        appended += sfs_fwrite(f, large + i * 50, 50) == 50;
+    check(appended == 300 && sfs_getfilesize("buffered.bin") == 300 * 50 && sfs_fflush(f) == 0 &&
+        sfs_pread(other, out, 300 * 50, 0) == 300 * 50 && memcmp(out, large, 300 * 50) == 0, "Buffered writes");
+    check(sfs_set_flush_interval(0) == 0 && sfs_set_flush_interval(-1) == -1 &&
+        sfs_setvbuf(other, SFS_BUFFER_TIMED, 1000) == 0, "sfs_set_flush_interval");
+    for (int i = 300; i < 400; i++)
+        sfs_pwrite(i % 2 ? f : other, large + i * 50, 50, i * 50);
+    sfs_fclose(f);
+    sfs_fclose(other);
+    sfs_set_flush_interval(1000);
+    mksfs(0);
+    f = sfs_fopen("buffered.bin");
+    read = sfs_pread(f, out, 400 * 50, 0);
+    check(read == 400 * 50 && memcmp(out, large, 400 * 50) == 0, "Buffered writes on the reopened disk");
+
+    /* Bytes buffered in a hole are kept when another entry writes the same block */
+    other = sfs_fopen("buffered.bin");
+    sfs_punch_hole(f, 0, 4096);
+    sfs_setvbuf(other, SFS_BUFFER_FULL, 4096);
+    sfs_pwrite(other, "buffered", 8, 1100);
+    sfs_pwrite(f, "tail", 4, 1110);
+    read = sfs_pread(f, out, 20, 1100);
+    check(read == 20 && memcmp(out, "buffered\0\0tail", 14) == 0, "Buffered bytes in a hole");
+    sfs_fclose(other);
+    sfs_fclose(f);
+    sfs_remove("buffered.bin");
+
+    /* Files appended at the same time each take runs of contiguous blocks from their windows */
+    f = sfs_fopen("window_a.bin");
+    other = sfs_fopen("window_b.bin");
+    for (int i = 0; i < 40; i++) {
+        sfs_fwrite(f, large + i * 4096, 4096);
+        sfs_fwrite(other, text + i * 4096, 4096);
+    }
+    read = sfs_pread(other, out, 40 * 4096, 0);
+    check(sfs_fragmentation("window_a.bin") <= 3 && sfs_fragmentation("window_b.bin") <= 3 &&
+        read == 40 * 4096 && memcmp(out, text, 40 * 4096) == 0, "Preallocation windows");
+    /* The blocks still reserved by a window are used once the disk is otherwise full */
+    sfs_fclose(f);
+    f = sfs_fopen("window_c.bin");
+    while (sfs_fwrite(f, large, LARGE_SIZE) == LARGE_SIZE);
+    sfs_statfs(&after);
+    check(after.free_blocks == 0, "Reserved blocks of a full disk");
+    sfs_fclose(f);
+    sfs_fclose(other);
+
+    /* A file that needs a new block of the directory is not created on a full disk */
+    int created = 0, g = -1;
+    while (created < 150 && (g = sfs_fopen((sprintf(name, "full%d", created), name))) >= 0) {
+        sfs_fclose(g);
+        created++;
+    }
+    int refused = g < 0 && sfs_getfilesize(name) == -1;
+    sfs_remove("window_a.bin");
+    sfs_remove("window_b.bin");
+    sfs_remove("window_c.bin");
+    g = sfs_fopen(name);
+    check(refused && g >= 0 && sfs_fwrite(g, "full", 4) == 4 && sfs_pread(g, out, 4, 0) == 4 &&
+        memcmp(out, "full", 4) == 0, "File created on a full disk");
+    sfs_fclose(g);
+    for (int i = 0; i <= created; i++)
+        sfs_remove((sprintf(name, "full%d", i), name));
+
+    /* Threads that mount different disks do not change the disk of the main thread */
+    pthread_t threads[4];
+    int results[4];
+    for (int i = 0; i < 4; i++) {
+        results[i] = i;
+        pthread_create(&threads[i], NULL, mount_worker, &results[i]);
+    }
+    int mounted = 0;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        mounted += results[i];
+    }
+    check(mounted == 4 && sfs_getfilesize("geometry.bin") == LARGE_SIZE && sfs_getfilesize("thread.bin") == -1 &&
+        sfs_mount("missing_sys", NULL) == NULL, "sfs_mount");
+
+    /* The write-back cache holds the written blocks until they expire or the disk is synced */
+    check(sfs_set_writeback(64, 100, 500) == 0 && sfs_set_writeback(-1, 50, 500) == -1 &&
+        sfs_set_writeback(64, 0, 500) == -1 && sfs_set_writeback(64, 50, -1) == -1, "sfs_set_writeback");
+    sfs_set_device(SFS_DEVICE_MMAP);
+    mksfs(1);
+    f = sfs_fopen("writeback.bin");
+    written = sfs_fwrite(f, text, 4096);
+    sfs_fclose(f);
+    int expired[2];
+    for (int i = 0; i < 2; i++) {
+        if (i == 1) usleep(1500 * 1000);
+        image = fopen("file_sys", "rb");
+        expired[i] = 0;
+        while (fread(out, 1, 1024, image) == 1024)
+            expired[i] += memcmp(out, text, 1024) == 0;
+        fclose(image);
+    }
+    check(written == 4096 && expired[0] == 0 && expired[1] == 1, "Dirty blocks written back once expired");
+
+    /* A writer waits for the flusher once the cache is full */
+    sfs_set_writeback(8, 50, 10000);
+    sfs_set_device(SFS_DEVICE_FILE);
+    mksfs(1);
+    f = sfs_fopen("writeback.bin");
+    written = sfs_fwrite(f, large, LARGE_SIZE);
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(written == LARGE_SIZE && read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0 && sfs_fsync(f) == 0,
+        "Writes throttled by the write-back cache");
+    sfs_fclose(f);
+    sfs_set_writeback(0, 100, 0);
+    mksfs(0);
+    f = sfs_fopen("writeback.bin");
+    memset(out, 0, LARGE_SIZE);
+    read = sfs_pread(f, out, LARGE_SIZE, 0);
+    check(read == LARGE_SIZE && memcmp(large, out, LARGE_SIZE) == 0, "Write-back cache on the reopened disk");
+    sfs_fclose(f);
+
+    /* A block whose write back fails stays dirty until a flush writes it back */
+    block_device_t *ram = open_ram_device(1024, 16);
+    ram_write = ram -> write;
+    ram -> write = flaky_write;
+    writeback_t *cache = open_writeback(ram, 8, 8, 60000);
+    failing_writes = 1;
+    write_writeback(cache, 3, 1, large);
+    int first_flush = flush_writeback(cache), dirty = get_dirty_count(cache);
+    memset(out, 0, 1024);
+    read = read_writeback(cache, 3, 1, out);
+    failing_writes = 0;
+    int second_flush = flush_writeback(cache);
+    memset(out + 1024, 0, 1024);
+    ram -> read(ram, 3, 1, out + 1024);
+    check(first_flush == -1 && dirty == 1 && read == 1 && memcmp(out, large, 1024) == 0 && second_flush == 0 &&
+        get_dirty_count(cache) == 0 && memcmp(out + 1024, large, 1024) == 0, "Failed write back kept dirty");
+    close_writeback(cache);
+
+    /* Each version of the scan kernels finds the same entries as a plain loop */
+    int scan_level = get_scan_level(), kernels = 0, agreed = 0;
+    for (int level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+        if (set_scan_level(level) < 0) continue;
+        int passed = 1;
+        for (int zero = 0; zero < 300; zero++) {
+            memset(out, 1, 300);
+            out[zero] = 0;
+            passed &= scan_zero_byte((uint8_t *) out, zero / 2, 300) == zero &&
+                scan_zero_byte((uint8_t *) out, zero + 1, 300) == -1;
+        }
+        memset(out, 0, 100 * 32);
+        int *fields = (int *) (out + 100 * 32);
+        for (int i = 0; i < 100; i++) {
+            sprintf(out + i * 32, "entry%d", i);
+            fields[i * 3 + 1] = i * 3;
+        }
+        passed &= scan_entries(out, 100, 32, "entry57", 8) == 57 && scan_entries(out, 100, 32, "entry5", 7) == 5 &&
+            scan_entries(out, 100, 32, "entry100", 9) == -1 && scan_entries(out, 100, 32, out + 99 * 32, 32) == 99;
+        passed &= scan_int32(fields, 100, 12, 4, 3 * 37) == 37 && scan_int32(fields, 100, 12, 4, 3 * 99) == 99 &&
+            scan_int32(fields, 100, 12, 4, -5) == -1;
+        kernels++;
+        agreed += passed;
+    }
+    set_scan_level(scan_level);
+    check(kernels >= 1 && agreed == kernels, "Scan kernels");
+
+    /* The kernels forced by a thread are not used by the other threads */
+    int thread_level = -1;
+    pthread_t scan_thread;
+    set_scan_level(SCAN_SCALAR);
+    pthread_create(&scan_thread, NULL, scan_level_worker, &thread_level);
+    pthread_join(scan_thread, NULL);
+    check(get_scan_level() == SCAN_SCALAR && thread_level == scan_level, "Scan kernels of a thread");
+    set_scan_level(scan_level);
+
+    /* A long batch of the ordered mode is committed before it holds too many indirect blocks */
+    sfs_set_geometry(512, 20000, 32);
+    sfs_set_durability(SFS_DURABILITY_ORDERED);
+    mksfs(1);
+    f = sfs_fopen("held.bin");
+    int bounded = 1;
+    written = 0;
+    for (int chunk = 0; chunk < 130; chunk++) {
+        written += sfs_fwrite(f, large, 64 * 1024);
+        bounded &= get_held_blocks() < INODE_HELD_LIMIT;
+    }
+    sfs_fclose(f);
+    sfs_set_durability(SFS_DURABILITY_NONE);
+    mksfs(0);
+    f = sfs_fopen("held.bin");
+    read = sfs_pread(f, out, 64 * 1024, 129 * 64 * 1024);
+    check(bounded && written == 130 * 64 * 1024 && read == 64 * 1024 && memcmp(large, out, 64 * 1024) == 0,
+        "Indirect blocks held by the ordered mode");
+    sfs_fclose(f);
+    sfs_set_geometry(1024, 1528, 160);
+
+    free(text);
+    free(large);
+    free(out);
+}
@@ -0,0 +1,358 @@
+#include "stripe.h"
+#include "block.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* Signals the caller when every worker is done */
+typedef struct _stripe_done_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;        /* Workers that have not finished the current request */
+} stripe_done_t;
+
+/* Request handed to the worker of an image file */
+typedef struct _stripe_member_t {
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool pending;       /* A request is waiting for the worker */
+    bool stop;          /* The worker has to exit */
+    bool write;         /* The request is a write */
+    off_t offset;       /* Location of the request in the image file */
+    struct iovec *iov;  /* Parts of the caller's buffer, one per stripe unit */
+    int iovcnt;
+    int iovcap;
+    int result;         /* 0 or -1 once the request is done */
+    stripe_done_t *done; /* Signal of the disk, which belongs to the thread that opened it */
+} stripe_member_t;
+
+THREAD_LOCAL stripe_member_t stripe_members[STRIPE_MAX_MEMBERS];
+THREAD_LOCAL int stripe_count = 0;
+THREAD_LOCAL int stripe_unit_blocks = 0;
+THREAD_LOCAL int stripe_block_size = 0;
+THREAD_LOCAL int64_t stripe_max_block = 0;
+
+THREAD_LOCAL stripe_done_t stripe_done = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+
+/* Helper Functions */
+int open_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks, bool fresh);
+void* stripe_worker(void *arg);
+int run_member(stripe_member_t *member);
+int transfer_stripe(int64_t start_address, int nblocks, void *buffer, bool write);
+int add_member_iov(stripe_member_t *member, void *base, size_t length);
+
+/**
+ * init_fresh_stripe -- Initializes a striped disk where the blocks are spread across
+ *                      multiple image files filled with 0's. The image files are named
+ *                      after the filename followed by the index of the member, e.g. file_sys.0.
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the disk
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int init_fresh_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks) {
+    return open_stripe(filename, members, stripe_unit, block_size, num_blocks, true);
+}
+
+/**
+ * init_stripe -- Initializes an existing striped disk.
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the disk
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int init_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks) {
+    return open_stripe(filename, members, stripe_unit, block_size, num_blocks, false);
+}
+
+/**
+ * is_stripe_open -- Checks if a striped disk is in use.
+ * 
+ * returns true if a striped disk has been initialized
+*/
+bool is_stripe_open() {
+    return stripe_count > 0;
+}
+
+/**
+ * read_stripe -- Reads a series of blocks of the striped disk into the buffer. Each image
+ *                file that holds a part of the blocks is read by its own worker in parallel.
+ * 
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer where the blocks are read
+ * 
+ * returns the number of blocks read or -1 if the request is invalid
+*/
+int read_stripe(int64_t start_address, int nblocks, void *buffer) {
+    return transfer_stripe(start_address, nblocks, buffer, false);
+}
+
+/**
+ * write_stripe -- Writes a series of blocks of the striped disk from the buffer. Each image
+ *                 file that holds a part of the blocks is written by its own worker in parallel.
+ * 
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer of the blocks to be written
+ * 
+ * returns the number of blocks written or -1 if the request is invalid
+*/
+int write_stripe(int64_t start_address, int nblocks, void *buffer) {
+    return transfer_stripe(start_address, nblocks, buffer, true);
+}
+
+/**
+ * flush_stripe -- Flushes the image files of the striped disk to the storage.
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int flush_stripe() {
+    int result = 0;
+    for (int i = 0; i < stripe_count; i++)
+        if (fdatasync(stripe_members[i].fd) < 0) result = -1;
+    return result;
+}
+
+/**
+ * close_stripe -- Stops the workers and closes the image files of the striped disk.
+*/
+void close_stripe() {
+    for (int i = 0; i < stripe_count; i++) {
+        stripe_member_t *member = &stripe_members[i];
+
+        pthread_mutex_lock(&member -> lock);
+        member -> stop = true;
+        pthread_cond_signal(&member -> cond);
+        pthread_mutex_unlock(&member -> lock);
+        pthread_join(member -> thread, NULL);
+
+        pthread_mutex_destroy(&member -> lock);
+        pthread_cond_destroy(&member -> cond);
+        close(member -> fd);
+        free(member -> iov);
+    }
+    stripe_count = 0;
+}
+
+/**
+ * open_stripe -- Opens or creates the image files of a striped disk and starts one worker
+ *                per image file. A striped disk that is already open is closed first.
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the disk
+ * fresh: create the image files (true) or open existing ones (false)
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int open_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks, bool fresh) {
+    close_stripe();
+    if (members < 1 || members > STRIPE_MAX_MEMBERS || stripe_unit < 1) return -1;
+
+    /* Each image file holds the same number of whole stripe units */
+    int64_t rows = (num_blocks + members * stripe_unit - 1) / (members * stripe_unit);
+    off_t member_size = (off_t) rows * stripe_unit * block_size;
+    char name[256];
+
+    for (int i = 0; i < members; i++) {
+        stripe_member_t *member = &stripe_members[i];
+        snprintf(name, sizeof(name), "%s.%d", filename, i);
+
+        memset(member, 0, sizeof(stripe_member_t));
+        member -> fd = open(name, fresh ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+        if (member -> fd < 0 || (fresh && ftruncate(member -> fd, member_size) < 0)) {
+            printf("Could not open %s\n\n", name);
+            if (member -> fd >= 0) close(member -> fd);
+            close_stripe();
+            return -1;
+        }
+
+        pthread_mutex_init(&member -> lock, NULL);
+        pthread_cond_init(&member -> cond, NULL);
+        member -> done = &stripe_done;
+        pthread_create(&member -> thread, NULL, stripe_worker, member);
+        stripe_count = i + 1;
+    }
+
+    stripe_unit_blocks = stripe_unit;
+    stripe_block_size = block_size;
+    stripe_max_block = num_blocks;
+    return 0;
+}
+
+/**
+ * stripe_worker -- Waits for the requests of an image file and runs them.
+ * 
+ * arg: member of the striped disk
+*/
+void* stripe_worker(void *arg) {
+    stripe_member_t *member = (stripe_member_t *) arg;
+
+    pthread_mutex_lock(&member -> lock);
+    while (true) {
+        while (!member -> pending && !member -> stop)
+            pthread_cond_wait(&member -> cond, &member -> lock);
+        if (member -> stop) break;
+        pthread_mutex_unlock(&member -> lock);
+
+        int result = run_member(member);
+
+        pthread_mutex_lock(&member -> lock);
+        member -> result = result;
+        member -> pending = false;
+
+        pthread_mutex_lock(&member -> done -> lock);
+        if (--member -> done -> running == 0) pthread_cond_signal(&member -> done -> cond);
+        pthread_mutex_unlock(&member -> done -> lock);
+    }
+    pthread_mutex_unlock(&member -> lock);
+    return NULL;
+}
+
+/**
+ * run_member -- Runs the request of an image file with as few vectored calls as possible.
+ * 
+ * member: member of the striped disk
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int run_member(stripe_member_t *member) {
+    off_t offset = member -> offset;
+
+    for (int i = 0; i < member -> iovcnt;) {
+        int count = member -> iovcnt - i < IOV_MAX ? member -> iovcnt - i : IOV_MAX;
+        ssize_t expected = 0;
+        for (int j = i; j < i + count; j++)
+            expected += member -> iov[j].iov_len;
+
+        ssize_t done = member -> write ? pwritev(member -> fd, &member -> iov[i], count, offset)
+                                     : preadv(member -> fd, &member -> iov[i], count, offset);
+        if (done != expected) return -1;
+
+        offset += expected;
+        i += count;
+    }
+    return 0;
+}
+
+/**
+ * transfer_stripe -- Splits a request of the striped disk by image file and runs each part.
+ *                    A contiguous range of blocks is a contiguous range of each image file,
+ *                    so each image file gets one vectored request. A request that touches a
+ *                    single image file is run by the caller without waking its worker.
+ * 
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer of the blocks
+ * write: write the blocks (true) or read them (false)
+ * 
+ * returns the number of blocks transferred or -1 if the request is invalid
+*/
+int transfer_stripe(int64_t start_address, int nblocks, void *buffer, bool write) {
+    if (start_address < 0 || nblocks < 0 || start_address + nblocks > stripe_max_block) {
+        printf("out of bound error %" PRId64 "\n", start_address);
+        return -1;
+    }
+    if (nblocks == 0) return 0;
+
+    int used = 0;
+    bool used_members[STRIPE_MAX_MEMBERS] = { false };
+    for (int i = 0; i < stripe_count; i++)
+        stripe_members[i].iovcnt = 0;
+
+    /* Split the request into stripe units */
+    for (int64_t block = start_address; block < start_address + nblocks;) {
+        int64_t stripe = block / stripe_unit_blocks;
+        int within = block % stripe_unit_blocks;
+        int count = stripe_unit_blocks - within;
+        if (count > start_address + nblocks - block) count = start_address + nblocks - block;
+
+        stripe_member_t *member = &stripe_members[stripe % stripe_count];
+        if (!used_members[stripe % stripe_count]) {
+            used_members[stripe % stripe_count] = true;
+            used++;
+            member -> write = write;
+            member -> offset = ((off_t) (stripe / stripe_count) * stripe_unit_blocks + within) * stripe_block_size;
+        }
+        if (add_member_iov(member, (char *) buffer + (size_t) (block - start_address) * stripe_block_size,
+            (size_t) count * stripe_block_size) < 0) return -1;
+
+        block += count;
+    }
+
+    int result = 0;
+    if (used == 1) {
+        for (int i = 0; i < stripe_count; i++)
+            if (used_members[i]) result = run_member(&stripe_members[i]);
+        return result < 0 ? -1 : nblocks;
+    }
+
+    /* Hand each part to the worker of its image file and wait for all of them */
+    stripe_done.running = used;
+    for (int i = 0; i < stripe_count; i++) {
+        if (!used_members[i]) continue;
+        pthread_mutex_lock(&stripe_members[i].lock);
+        stripe_members[i].pending = true;
+        pthread_cond_signal(&stripe_members[i].cond);
+        pthread_mutex_unlock(&stripe_members[i].lock);
+    }
+
+    pthread_mutex_lock(&stripe_done.lock);
+    while (stripe_done.running > 0)
+        pthread_cond_wait(&stripe_done.cond, &stripe_done.lock);
+    pthread_mutex_unlock(&stripe_done.lock);
+
+    for (int i = 0; i < stripe_count; i++) {
+        if (!used_members[i]) continue;
+        pthread_mutex_lock(&stripe_members[i].lock);
+        if (stripe_members[i].result < 0) result = -1;
+        pthread_mutex_unlock(&stripe_members[i].lock);
+    }
+    return result < 0 ? -1 : nblocks;
+}
+
+/**
+ * add_member_iov -- Adds a part of the caller's buffer to the request of an image file.
+ * 
+ * member: member of the striped disk
+ * base: start of the part
+ * length: size of the part
+ * 
+ * returns 0 or -1 if the request cannot grow
+*/
+int add_member_iov(stripe_member_t *member, void *base, size_t length) {
+    if (member -> iovcnt == member -> iovcap) {
+        int capacity = member -> iovcap == 0 ? 16 : member -> iovcap * 2;
+        struct iovec *iov = (struct iovec *) realloc(member -> iov, capacity * sizeof(struct iovec));
+        if (iov == NULL) return -1;
+        member -> iov = iov;
+        member -> iovcap = capacity;
+    }
+    member -> iov[member -> iovcnt].iov_base = base;
+    member -> iov[member -> iovcnt].iov_len = length;
+    member -> iovcnt++;
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Maximum number of image files of a striped disk */
+#define STRIPE_MAX_MEMBERS 16
+
+/**
+ * init_fresh_stripe -- Initializes a striped disk where the blocks are spread across
+ *                      multiple image files filled with 0's. The image files are named
+ *                      after the filename followed by the index of the member, e.g. file_sys.0.
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the disk
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int init_fresh_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks);
+
+/**
+ * init_stripe -- Initializes an existing striped disk.
+ * 
+ * filename: prefix of the image files
+ * members: number of image files
+ * stripe_unit: number of consecutive blocks placed on the same image file
+ * block_size: size of a block
+ * num_blocks: number of blocks of the disk
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int init_stripe(char *filename, int members, int stripe_unit, int block_size, int64_t num_blocks);
+
+/**
+ * is_stripe_open -- Checks if a striped disk is in use.
+ * 
+ * returns true if a striped disk has been initialized
+*/
+bool is_stripe_open();
+
+/**
+ * read_stripe -- Reads a series of blocks of the striped disk into the buffer. Each image
+ *                file that holds a part of the blocks is read by its own worker in parallel.
+ * 
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer where the blocks are read
+ * 
+ * returns the number of blocks read or -1 if the request is invalid
+*/
+int read_stripe(int64_t start_address, int nblocks, void *buffer);
+
+/**
+ * write_stripe -- Writes a series of blocks of the striped disk from the buffer. Each image
+ *                 file that holds a part of the blocks is written by its own worker in parallel.
+ * 
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer of the blocks to be written
+ * 
+ * returns the number of blocks written or -1 if the request is invalid
+*/
+int write_stripe(int64_t start_address, int nblocks, void *buffer);
+
+/**
+ * flush_stripe -- Flushes the image files of the striped disk to the storage.
+ * 
+ * returns 0 or -1 to show if the action was successful
+*/
+int flush_stripe();
+
+/**
+ * close_stripe -- Stops the workers and closes the image files of the striped disk.
+*/
+void close_stripe();
+
+#endif
@@ -1,40 +1,187 @@
 #include "super_block.h"
+#include "inode.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Geometry of the disk in use */
+THREAD_LOCAL geometry_t disk_geometry = {
+    DEFAULT_BLOCK_SIZE, DEFAULT_NUM_BLOCKS, 40, 1480, 5, 2
+};
+
+/* Free space of the disk in use */
+THREAD_LOCAL counters_t disk_counters = { 0, 0, 0 };
+
+/* The counters on the disk match the ones in memory */
+THREAD_LOCAL bool counters_clean = false;
+
+/* Largest number of directory blocks, since they are held by the direct pointers of the root */
+#define MAX_DIR_LENGTH 12
+
 /**
- * init_superblock -- Initializes the super block with default values
- *                    and writes it to the disk.
+ * init_superblock -- Initializes the super block with the geometry of the disk and the
+ *                    counters of an empty disk, and writes it to the disk.
 */
 void init_superblock() {
+    /* Only the root directory INode is used and the data blocks are a single free run */
+    disk_counters.free_blocks = DATA_BLOCK_SIZE;
+    disk_counters.free_extents = 1;
+    disk_counters.free_inodes = INODE_TABLE_SIZE * INODE_PER_BLOCK - 1;
+
+    write_superblock(true);
+}
+
+/**
+ * check_valid_dish -- Verifies that the disk is of a valid format
+ *                     by checking the MAGIC value of it's superblock.
+ *                     If it is invalid, the whole program will be exited.
+ *                     Otherwise, the geometry of the disk is read from it.
+*/
+void check_valid_disk() {
+    geometry_t geometry;
+    if (read_geometry(&geometry) < 0) {
+        printf("Invalid File Format -- Cannot open the file system.\n");
+        exit(EXIT_FAILURE);
+    }
+    disk_geometry = geometry;
+}
+
+/**
+ * read_geometry -- Reads the geometry stored in the superblock of the disk and verifies
+ *                  that its layout fits in the disk that has been formatted with it.
+ * 
+ * geometry: geometry to be read
+ * 
+ * returns 0 or -1 if the disk does not have a valid format
+*/
+int read_geometry(geometry_t* geometry) {
+    block_t block;
+    read_blocks(0, SUPERBLOCK_SIZE, &block);
+
+    superblock_t *super_block = (superblock_t *) &block;
+    if (strncmp(super_block -> magic, MAGIC, sizeof(super_block -> magic)) != 0) return -1;
+
+    geometry -> block_size = super_block -> block_size;
+    geometry -> num_blocks = super_block -> fs_size;
+    geometry -> inode_length = super_block -> inode_length;
+    geometry -> data_length = super_block -> data_length;
+    geometry -> dir_length = super_block -> dir_length;
+    geometry -> fbm_length = super_block -> fbm_length;
+
+    /* The layout has to fit in the disk that has been formatted with it */
+    if (geometry -> block_size < 512 || geometry -> block_size > BLOCK_MAX_SIZE || geometry -> inode_length < 1 ||
+        geometry -> data_length < 1 || geometry -> dir_length < 1 || geometry -> dir_length > MAX_DIR_LENGTH ||
+        (int64_t) geometry -> fbm_length * geometry -> block_size < geometry -> num_blocks ||
+        SUPERBLOCK_SIZE + geometry -> inode_length + geometry -> data_length + geometry -> dir_length +
+            geometry -> fbm_length != geometry -> num_blocks) return -1;
+    return 0;
+}
+
+/**
+ * read_counters -- Reads the counters stored in the superblock of the disk.
+ * 
+ * counters: counters to be read
+ * 
+ * returns true if the counters have been checkpointed since the last change, or false
+ * if they have to be counted again from the free bitmap and the INode table
+*/
+bool read_counters(counters_t* counters) {
+    block_t block;
+    read_blocks(0, SUPERBLOCK_SIZE, &block);
+
+    superblock_t *super_block = (superblock_t *) &block;
+    counters -> free_blocks = super_block -> free_blocks;
+    counters -> free_extents = super_block -> free_extents;
+    counters -> free_inodes = super_block -> free_inodes;
+    counters_clean = super_block -> clean == 1;
+
+    return counters_clean;
+}
+
+/**
+ * update_counters -- Adds a change of the free space to the counters. The first change after
+ *                    a checkpoint marks the counters on the disk as out of date.
+ * 
+ * blocks: change of the number of free blocks
+ * extents: change of the number of runs of free blocks
+ * inodes: change of the number of free INodes
+*/
+void update_counters(int64_t blocks, int64_t extents, int inodes) {
+    disk_counters.free_blocks += blocks;
+    disk_counters.free_extents += extents;
+    disk_counters.free_inodes += inodes;
+
+    if (counters_clean) write_superblock(false);
+}
+
+/**
+ * checkpoint_superblock -- Writes the counters to the superblock if they have changed
+ *                          since the last checkpoint.
+*/
+void checkpoint_superblock() {
+    if (!counters_clean) write_superblock(true);
+}
+
+/**
+ * compute_geometry -- Computes the layout of a disk from its size. The INode table holds
+ *                     the requested number of INodes, the directory holds as many entries
+ *                     and the free bitmap has one byte per block of the disk.
+ * 
+ * geometry: geometry to be computed
+ * block_size: size of a block, a power of 2 from 512 to BLOCK_MAX_SIZE
+ * num_blocks: number of blocks of the disk
+ * inode_count: number of INodes, including the root directory
+ * 
+ * returns 0 or -1 if the disk cannot have this geometry
+*/
+int compute_geometry(geometry_t* geometry, int block_size, int64_t num_blocks, int inode_count) {
+    if (block_size < 512 || block_size > BLOCK_MAX_SIZE || (block_size & (block_size - 1)) != 0) return -1;
+    if (num_blocks < 1 || inode_count < 2) return -1;
+
+    /* The free bitmap is held in memory and its length is an int */
+    if ((num_blocks + block_size - 1) / block_size > INT32_MAX) return -1;
+
+    /* INODE_PER_BLOCK follows the disk in use, not this geometry, and 32 bytes per directory entry */
+    int inodes_per_block = (int) (block_size / sizeof(inode_t));
+    int entries_per_block = block_size / 32;
+
+    geometry -> block_size = block_size;
+    geometry -> num_blocks = num_blocks;
+    geometry -> inode_length = (inode_count + inodes_per_block - 1) / inodes_per_block;
+    geometry -> dir_length = (inode_count + entries_per_block - 1) / entries_per_block;
+    geometry -> fbm_length = (num_blocks + block_size - 1) / block_size;
+    geometry -> data_length = num_blocks - SUPERBLOCK_SIZE - geometry -> inode_length -
+        geometry -> dir_length - geometry -> fbm_length;
+
+    if (geometry -> dir_length > MAX_DIR_LENGTH || geometry -> data_length < 1) return -1;
+    return 0;
+}
+
+/**
+ * write_superblock -- Writes the geometry and the counters of the disk to the superblock.
+ * 
+ * clean: the counters are up to date (true) or will change before the next checkpoint (false)
+*/
+void write_superblock(bool clean) {
     block_t block;
     superblock_t *super_block = (superblock_t *) &block;
     
+    memset(&block, 0, sizeof(block));
     strcpy(super_block -> magic, MAGIC);
     super_block -> block_size = BLOCK_SIZE;
-    super_block -> fs_size = FILE_SIZE;
+    super_block -> fs_size = disk_geometry.num_blocks;
     super_block -> inode_length = INODE_TABLE_SIZE;
     super_block -> root_dir = 0;
     super_block -> dir_length = DIR_BLOCK_SIZE;
     super_block -> dir_root_dir = 0;
     super_block -> fbm_length = FREE_BITMAP_SIZE;
     super_block -> fbm_root_dir = 0;
+    super_block -> data_length = DATA_BLOCK_SIZE;
+    super_block -> free_blocks = disk_counters.free_blocks;
+    super_block -> free_extents = disk_counters.free_extents;
+    super_block -> free_inodes = disk_counters.free_inodes;
+    super_block -> clean = clean;
 
     write_blocks(0, SUPERBLOCK_SIZE, &block);
+    counters_clean = clean;
 }
-
-/**
- * check_valid_dish -- Verifies that the disk is of a valid format
- *                     by checking the MAGIC value of it's superblock.
- *                     If it is invalid, the whole program will be exited.
-*/
-void check_valid_disk() {
-    block_t block;
-    read_blocks(0, SUPERBLOCK_SIZE, &block);
-
-    if (strcmp(((superblock_t *) &block) -> magic, MAGIC) != 0) {
-        printf("Invalid File Format -- Cannot open the file system.\n");
-        exit(EXIT_FAILURE);
-    }
-}
\ No newline at end of file
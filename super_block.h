@@ -1,24 +1,47 @@
+#ifndef SUPER_BLOCK_H
+#define SUPER_BLOCK_H
+
 #include "disk_emu.h"
 #include "constant.h"
 #include "block.h"
+#include <stdint.h>
+#include <stdbool.h>
 
-#define MAGIC "0xACBD0005"
+/* Changed each time the format on the disk changes, so that older images are not mounted */
+#define MAGIC "0xACBD000A"
 
 typedef struct _superblock_t {
     char magic[10];
     int block_size;
-    int fs_size;
+    int64_t fs_size;
     int inode_length;
     int root_dir;
     int dir_length;
     int dir_root_dir;
     int fbm_length;
     int fbm_root_dir;
+    int64_t data_length;
+    int64_t free_blocks;
+    int64_t free_extents;
+    int free_inodes;
+    int clean;
 } superblock_t;
 
 /**
- * init_superblock -- Initializes the super block with default values
- *                    and writes it to the disk.
+ * _counters_t -- Free space of the disk in use, updated by the allocators as blocks and
+ *                INodes are used and released. An extent is a run of contiguous free blocks.
+*/
+typedef struct _counters_t {
+    int64_t free_blocks;
+    int64_t free_extents;
+    int free_inodes;
+} counters_t;
+
+extern THREAD_LOCAL counters_t disk_counters;
+
+/**
+ * init_superblock -- Initializes the super block with the geometry of the disk and the
+ *                    counters of an empty disk, and writes it to the disk.
 */
 void init_superblock();
 
@@ -26,5 +49,65 @@ void init_superblock();
  * check_valid_dish -- Verifies that the disk is of a valid format
  *                     by checking the MAGIC value of it's superblock.
  *                     If it is invalid, the whole program will be exited.
+ *                     Otherwise, the geometry of the disk is read from it.
+*/
+void check_valid_disk();
+
+/**
+ * read_geometry -- Reads the geometry stored in the superblock of the disk and verifies
+ *                  that its layout fits in the disk that has been formatted with it.
+ * 
+ * geometry: geometry to be read
+ * 
+ * returns 0 or -1 if the disk does not have a valid format
+*/
+int read_geometry(geometry_t* geometry);
+
+/**
+ * read_counters -- Reads the counters stored in the superblock of the disk.
+ * 
+ * counters: counters to be read
+ * 
+ * returns true if the counters have been checkpointed since the last change, or false
+ * if they have to be counted again from the free bitmap and the INode table
+*/
+bool read_counters(counters_t* counters);
+
+/**
+ * update_counters -- Adds a change of the free space to the counters. The first change after
+ *                    a checkpoint marks the counters on the disk as out of date.
+ * 
+ * blocks: change of the number of free blocks
+ * extents: change of the number of runs of free blocks
+ * inodes: change of the number of free INodes
+*/
+void update_counters(int64_t blocks, int64_t extents, int inodes);
+
+/**
+ * checkpoint_superblock -- Writes the counters to the superblock if they have changed
+ *                          since the last checkpoint.
+*/
+void checkpoint_superblock();
+
+/**
+ * write_superblock -- Writes the geometry and the counters of the disk to the superblock.
+ * 
+ * clean: the counters are up to date (true) or will change before the next checkpoint (false)
+*/
+void write_superblock(bool clean);
+
+/**
+ * compute_geometry -- Computes the layout of a disk from its size. The INode table holds
+ *                     the requested number of INodes, the directory holds as many entries
+ *                     and the free bitmap has one byte per block of the disk.
+ * 
+ * geometry: geometry to be computed
+ * block_size: size of a block, a power of 2 from 512 to BLOCK_MAX_SIZE
+ * num_blocks: number of blocks of the disk
+ * inode_count: number of INodes, including the root directory
+ * 
+ * returns 0 or -1 if the disk cannot have this geometry
 */
-void check_valid_disk();
\ No newline at end of file
+int compute_geometry(geometry_t* geometry, int block_size, int64_t num_blocks, int inode_count);
+
+#endif
\ No newline at end of file
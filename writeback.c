@@ -0,0 +1,476 @@
+#include "writeback.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* Dirty block held by the cache until the flusher writes it back */
+typedef struct _writeback_entry_t {
+    int64_t block;
+    int64_t dirtied;        /* Time in milliseconds when the block first became dirty */
+    int64_t generation;     /* Incremented by each write, so a block written during its write back stays dirty */
+    bool writing;           /* The block is being written back */
+    bool failing;           /* The last write back of the block has failed */
+    struct _writeback_entry_t *next;
+    struct _writeback_entry_t *older;   /* Neighbours in the order in which the blocks became dirty */
+    struct _writeback_entry_t *newer;
+    char data[];
+} writeback_entry_t;
+
+struct _writeback_t {
+    block_device_t *lower;
+    pthread_mutex_t lock;       /* Protects the entries and the counters */
+    pthread_mutex_t io_lock;    /* Serializes the requests to the lower device, taken after lock */
+    pthread_cond_t changed;     /* Signaled when blocks have been written back */
+    pthread_cond_t wake;        /* Signaled when the flusher has work to do */
+    pthread_t thread;
+    bool stop;
+    bool failed;                /* A write back has failed since the last flush */
+
+    writeback_entry_t **table;  /* Dirty blocks hashed by block number */
+    int64_t mask;
+    writeback_entry_t *oldest;  /* Dirty blocks in the order in which they became dirty */
+    writeback_entry_t *newest;
+    int dirty;                  /* Number of dirty blocks */
+    int writing;                /* Number of dirty blocks being written back */
+    int failing;                /* Number of dirty blocks whose last write back has failed */
+    int64_t cleaned;            /* Number of blocks written back and dropped */
+    int dirty_limit;
+    int background;
+    int expire_ms;
+    int64_t cursor;             /* Block number where the next pass of the flusher starts */
+};
+
+/* Helper Functions */
+void* writeback_worker(void *arg);
+int write_back_blocks(writeback_t *cache, bool all);
+writeback_entry_t* find_dirty_block(writeback_t *cache, int64_t block);
+void remove_dirty_block(writeback_t *cache, writeback_entry_t *entry);
+int compare_block_addrs(const void *a, const void *b);
+int64_t get_writeback_time();
+
+/**
+ * open_writeback -- Starts a write-back cache in front of a block device. The written blocks
+ *                   are kept in memory as dirty blocks, and a flusher thread writes them back
+ *                   in the order of the block numbers once they are older than expire_ms or
+ *                   once background blocks are dirty. The writers wait only while dirty_limit
+ *                   blocks are dirty.
+ * 
+ * lower: block device where the blocks are written back, which is closed with the cache
+ * dirty_limit: number of dirty blocks at which the writers wait for the flusher
+ * background: number of dirty blocks at which the flusher writes them back regardless of age
+ * expire_ms: age in milliseconds at which a dirty block is written back
+ * 
+ * returns the cache or NULL if the flusher thread cannot be started
+*/
+writeback_t* open_writeback(block_device_t *lower, int dirty_limit, int background, int expire_ms) {
+    writeback_t *cache = (writeback_t *) calloc(1, sizeof(writeback_t));
+    cache -> lower = lower;
+    cache -> dirty_limit = dirty_limit;
+    cache -> background = background < 1 ? 1 : background > dirty_limit ? dirty_limit : background;
+    cache -> expire_ms = expire_ms;
+
+    /* The table has at least as many chains as there can be dirty blocks */
+    int64_t size = 16;
+    while (size < dirty_limit && size < (1 << 20)) size *= 2;
+    cache -> table = (writeback_entry_t **) calloc(size, sizeof(writeback_entry_t *));
+    cache -> mask = size - 1;
+
+    /* The flusher waits on a monotonic clock so that its timer does not follow the wall clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&cache -> wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&cache -> changed, NULL);
+    pthread_mutex_init(&cache -> lock, NULL);
+    pthread_mutex_init(&cache -> io_lock, NULL);
+
+    if (pthread_create(&cache -> thread, NULL, writeback_worker, cache) != 0) {
+        pthread_cond_destroy(&cache -> wake);
+        pthread_cond_destroy(&cache -> changed);
+        pthread_mutex_destroy(&cache -> lock);
+        pthread_mutex_destroy(&cache -> io_lock);
+        free(cache -> table);
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/**
+ * read_writeback -- Reads a series of blocks from the device, where the dirty blocks are
+ *                   read from the cache.
+ * 
+ * cache: write-back cache
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer where the blocks are read
+ * 
+ * returns the number of blocks read or -1 if the device cannot be read
+*/
+int read_writeback(writeback_t *cache, int64_t start_address, int nblocks, void *buffer) {
+    block_device_t *lower = cache -> lower;
+
+    /* The writers are not held up by the read of the device */
+    pthread_mutex_lock(&cache -> lock);
+    int64_t cleaned = cache -> cleaned;
+    pthread_mutex_unlock(&cache -> lock);
+    pthread_mutex_lock(&cache -> io_lock);
+    int result = lower -> read(lower, start_address, nblocks, buffer);
+    pthread_mutex_unlock(&cache -> io_lock);
+
+    /* A block written back and dropped in between may have been read before its write back,
+       so the read is done again with the lock held, where no block can be dropped */
+    pthread_mutex_lock(&cache -> lock);
+    if (result >= 0 && cache -> cleaned != cleaned) {
+        pthread_mutex_lock(&cache -> io_lock);
+        result = lower -> read(lower, start_address, nblocks, buffer);
+        pthread_mutex_unlock(&cache -> io_lock);
+    }
+
+    if (result >= 0 && cache -> dirty > 0) {
+        for (int i = 0; i < nblocks; i++) {
+            writeback_entry_t *entry = find_dirty_block(cache, start_address + i);
+            if (entry != NULL) memcpy((char *) buffer + (size_t) i * lower -> block_size, entry -> data, lower -> block_size);
+        }
+    }
+    pthread_mutex_unlock(&cache -> lock);
+    return result;
+}
+
+/**
+ * write_writeback -- Copies a series of blocks to the cache, where they are dirty until the
+ *                    flusher writes them back. The writer waits while the cache is full.
+ * 
+ * cache: write-back cache
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * buffer: buffer of the blocks to be written
+ * 
+ * returns the number of blocks written
+*/
+int write_writeback(writeback_t *cache, int64_t start_address, int nblocks, void *buffer) {
+    int block_size = cache -> lower -> block_size;
+    int64_t now = get_writeback_time();
+
+    pthread_mutex_lock(&cache -> lock);
+    for (int i = 0; i < nblocks; i++) {
+        int64_t block = start_address + i;
+        writeback_entry_t *entry = find_dirty_block(cache, block);
+
+        if (entry == NULL) {
+            /* Only a block that is not dirty yet adds to the dirty memory, so it is throttled here.
+               The blocks that cannot be written back do not hold up the writers */
+            while (cache -> dirty - cache -> failing >= cache -> dirty_limit) {
+                pthread_cond_signal(&cache -> wake);
+                pthread_cond_wait(&cache -> changed, &cache -> lock);
+            }
+            entry = find_dirty_block(cache, block);
+        }
+        if (entry == NULL) {
+            entry = (writeback_entry_t *) malloc(sizeof(writeback_entry_t) + block_size);
+            entry -> block = block;
+            entry -> dirtied = now;
+            entry -> generation = 0;
+            entry -> writing = false;
+            entry -> failing = false;
+            entry -> next = cache -> table[block & cache -> mask];
+            cache -> table[block & cache -> mask] = entry;
+            entry -> older = cache -> newest;
+            entry -> newer = NULL;
+            if (cache -> newest != NULL) cache -> newest -> newer = entry;
+            else cache -> oldest = entry;
+            cache -> newest = entry;
+            cache -> dirty++;
+            if (cache -> dirty == 1 || cache -> dirty == cache -> background) pthread_cond_signal(&cache -> wake);
+        }
+        memcpy(entry -> data, (char *) buffer + (size_t) i * block_size, block_size);
+        entry -> generation++;
+
+        /* New data of a block whose write back has failed is written back again */
+        if (entry -> failing) {
+            entry -> failing = false;
+            cache -> failing--;
+        }
+    }
+    pthread_mutex_unlock(&cache -> lock);
+    return nblocks;
+}
+
+/**
+ * flush_writeback -- Writes back every dirty block and flushes the device to the storage.
+ *                    The blocks whose write back fails stay dirty, and are written back
+ *                    again by the next flush.
+ * 
+ * cache: write-back cache
+ * 
+ * returns 0 or -1 if a block could not be written back since the last flush
+*/
+int flush_writeback(writeback_t *cache) {
+    pthread_mutex_lock(&cache -> lock);
+    for (writeback_entry_t *entry = cache -> oldest; entry != NULL; entry = entry -> newer)
+        entry -> failing = false;
+    cache -> failing = 0;
+
+    while (cache -> dirty > cache -> failing) {
+        /* The caller writes back the blocks itself rather than waiting for the flusher's timer,
+           and only waits for the blocks that are already being written */
+        if (cache -> dirty > cache -> writing + cache -> failing) write_back_blocks(cache, true);
+        else pthread_cond_wait(&cache -> changed, &cache -> lock);
+    }
+    bool failed = cache -> failed;
+    cache -> failed = false;
+    pthread_mutex_unlock(&cache -> lock);
+
+    pthread_mutex_lock(&cache -> io_lock);
+    int result = cache -> lower -> flush(cache -> lower);
+    pthread_mutex_unlock(&cache -> io_lock);
+    return failed ? -1 : result;
+}
+
+/**
+ * discard_writeback -- Drops the dirty blocks of a series of blocks and discards them on the device.
+ * 
+ * cache: write-back cache
+ * start_address: index of the first block
+ * nblocks: number of blocks
+ * 
+ * returns the number of blocks discarded or -1 if the action failed
+*/
+int discard_writeback(writeback_t *cache, int64_t start_address, int nblocks) {
+    pthread_mutex_lock(&cache -> lock);
+    /* A block being written back would land after the discard */
+    while (cache -> writing > 0)
+        pthread_cond_wait(&cache -> changed, &cache -> lock);
+
+    for (int i = 0; i < nblocks && cache -> dirty > 0; i++) {
+        writeback_entry_t *entry = find_dirty_block(cache, start_address + i);
+        if (entry != NULL) remove_dirty_block(cache, entry);
+    }
+    pthread_cond_broadcast(&cache -> changed);
+
+    pthread_mutex_lock(&cache -> io_lock);
+    int result = cache -> lower -> discard(cache -> lower, start_address, nblocks);
+    pthread_mutex_unlock(&cache -> io_lock);
+    pthread_mutex_unlock(&cache -> lock);
+    return result;
+}
+
+/**
+ * get_dirty_count -- Gets the number of blocks of the cache that have not been written back.
+ * 
+ * cache: write-back cache
+ * 
+ * returns the number of dirty blocks
+*/
+int get_dirty_count(writeback_t *cache) {
+    pthread_mutex_lock(&cache -> lock);
+    int dirty = cache -> dirty;
+    pthread_mutex_unlock(&cache -> lock);
+    return dirty;
+}
+
+/**
+ * close_writeback -- Stops the flusher, writes back every dirty block and closes the device.
+ * 
+ * cache: write-back cache
+*/
+void close_writeback(writeback_t *cache) {
+    pthread_mutex_lock(&cache -> lock);
+    cache -> stop = true;
+    pthread_cond_signal(&cache -> wake);
+    pthread_mutex_unlock(&cache -> lock);
+    pthread_join(cache -> thread, NULL);
+
+    flush_writeback(cache);
+    cache -> lower -> close(cache -> lower);
+    free(cache -> lower);
+
+    /* The blocks that still cannot be written back are lost with the cache */
+    while (cache -> oldest != NULL) remove_dirty_block(cache, cache -> oldest);
+    free(cache -> table);
+    pthread_cond_destroy(&cache -> wake);
+    pthread_cond_destroy(&cache -> changed);
+    pthread_mutex_destroy(&cache -> lock);
+    pthread_mutex_destroy(&cache -> io_lock);
+    free(cache);
+}
+
+/**
+ * writeback_worker -- Flusher of the cache. It writes back the dirty blocks once they are
+ *                     older than the expiry or once the background threshold is reached,
+ *                     and otherwise sleeps until a writer wakes it or a block expires.
+ * 
+ * arg: write-back cache
+*/
+void* writeback_worker(void *arg) {
+    writeback_t *cache = (writeback_t *) arg;
+
+    pthread_mutex_lock(&cache -> lock);
+    while (!cache -> stop) {
+        int written = 0;
+        if (cache -> dirty > cache -> writing + cache -> failing)
+            written = write_back_blocks(cache, cache -> dirty - cache -> failing >= cache -> background);
+        if (written > 0 || cache -> stop) continue;
+
+        if (cache -> dirty == 0) {
+            pthread_cond_wait(&cache -> wake, &cache -> lock);
+        } else {
+            /* Wakes up often enough that a block is written back soon after it expires */
+            int64_t wait_ms = cache -> expire_ms / 4 + 1;
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += wait_ms / 1000;
+            deadline.tv_nsec += (wait_ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&cache -> wake, &cache -> lock, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&cache -> lock);
+    return NULL;
+}
+
+/**
+ * write_back_blocks -- Writes back a batch of dirty blocks in the order of the block numbers,
+ *                      starting where the last pass stopped, so that the device is swept in
+ *                      one direction. Consecutive blocks are written with a single request.
+ *                      The blocks whose write back has failed are left to the next flush.
+ *                      Called with the lock held, which is released during the writes.
+ * 
+ * cache: write-back cache
+ * all: write back every dirty block (true) or only the expired ones (false)
+ * 
+ * returns the number of blocks written back
+*/
+int write_back_blocks(writeback_t *cache, bool all) {
+    block_device_t *lower = cache -> lower;
+    int64_t expired = get_writeback_time() - cache -> expire_ms;
+
+    /* Gathers the blocks that qualify and are not already being written, where the expired
+       blocks are the oldest ones */
+    int count = 0;
+    int64_t *blocks = (int64_t *) malloc(sizeof(int64_t) * cache -> dirty);
+    for (writeback_entry_t *entry = cache -> oldest; entry != NULL && (all || entry -> dirtied <= expired); entry = entry -> newer) {
+        if (!entry -> writing && !entry -> failing) blocks[count++] = entry -> block;
+    }
+    if (count == 0) {
+        free(blocks);
+        return 0;
+    }
+    qsort(blocks, count, sizeof(int64_t), compare_block_addrs);
+
+    /* The batch starts at the cursor and wraps around to the lowest block */
+    int first = 0;
+    while (first < count && blocks[first] < cache -> cursor) first++;
+    if (first == count) first = 0;
+    int batch = count - first < WRITEBACK_BATCH ? count - first : WRITEBACK_BATCH;
+    int64_t *selected = blocks + first;
+    cache -> cursor = selected[batch - 1] + 1;
+
+    /* The data is copied since the writers may change a block while it is written back */
+    char *data = (char *) malloc((size_t) batch * lower -> block_size);
+    int64_t *generations = (int64_t *) malloc(sizeof(int64_t) * batch);
+    bool *failures = (bool *) calloc(batch, sizeof(bool));
+    for (int i = 0; i < batch; i++) {
+        writeback_entry_t *entry = find_dirty_block(cache, selected[i]);
+        entry -> writing = true;
+        generations[i] = entry -> generation;
+        memcpy(data + (size_t) i * lower -> block_size, entry -> data, lower -> block_size);
+    }
+    cache -> writing += batch;
+    pthread_mutex_unlock(&cache -> lock);
+
+    pthread_mutex_lock(&cache -> io_lock);
+    for (int i = 0, run; i < batch; i += run) {
+        for (run = 1; i + run < batch && selected[i + run] == selected[i] + run; run++);
+        if (lower -> write(lower, selected[i], run, data + (size_t) i * lower -> block_size) != run)
+            memset(failures + i, true, run);
+    }
+    pthread_mutex_unlock(&cache -> io_lock);
+
+    /* A block written again during its write back stays dirty with its new data. A block whose
+       write back has failed stays dirty as well, and the failure is reported by the next flush */
+    pthread_mutex_lock(&cache -> lock);
+    for (int i = 0; i < batch; i++) {
+        writeback_entry_t *entry = find_dirty_block(cache, selected[i]);
+        if (entry == NULL || !entry -> writing) continue;
+        entry -> writing = false;
+        cache -> writing--;
+        if (failures[i]) cache -> failed = true;
+        if (entry -> generation != generations[i]) continue;
+
+        if (failures[i]) {
+            entry -> failing = true;
+            cache -> failing++;
+        } else {
+            remove_dirty_block(cache, entry);
+            cache -> cleaned++;
+        }
+    }
+    pthread_cond_broadcast(&cache -> changed);
+
+    free(failures);
+    free(generations);
+    free(data);
+    free(blocks);
+    return batch;
+}
+
+/**
+ * find_dirty_block -- Finds the entry of a dirty block. Called with the lock held.
+ * 
+ * cache: write-back cache
+ * block: index of the block
+ * 
+ * returns the entry or NULL if the block is not dirty
+*/
+writeback_entry_t* find_dirty_block(writeback_t *cache, int64_t block) {
+    writeback_entry_t *entry = cache -> table[block & cache -> mask];
+    while (entry != NULL && entry -> block != block) entry = entry -> next;
+    return entry;
+}
+
+/**
+ * remove_dirty_block -- Removes the entry of a dirty block and frees it. Called with the lock held.
+ * 
+ * cache: write-back cache
+ * entry: entry of the block
+*/
+void remove_dirty_block(writeback_t *cache, writeback_entry_t *entry) {
+    writeback_entry_t **link = &cache -> table[entry -> block & cache -> mask];
+    while (*link != entry) link = &(*link) -> next;
+    *link = entry -> next;
+
+    if (entry -> older != NULL) entry -> older -> newer = entry -> newer;
+    else cache -> oldest = entry -> newer;
+    if (entry -> newer != NULL) entry -> newer -> older = entry -> older;
+    else cache -> newest = entry -> older;
+
+    if (entry -> writing) cache -> writing--;
+    if (entry -> failing) cache -> failing--;
+    cache -> dirty--;
+    free(entry);
+}
+
+/**
+ * compare_block_addrs -- Orders two block numbers for qsort.
+*/
+int compare_block_addrs(const void *a, const void *b) {
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/**
+ * get_writeback_time -- Gets the time of the monotonic clock in milliseconds.
+*/
+int64_t get_writeback_time() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
@@ -0,0 +1,23 @@
+#ifndef WRITEBACK_H
+#define WRITEBACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block_device.h"
+
+/* Largest number of dirty blocks written back by one pass of the flusher */
+#define WRITEBACK_BATCH 256
+
+/* State of a write-back cache, which belongs to the block device that uses it */
+typedef struct _writeback_t writeback_t;
+
+writeback_t* open_writeback(block_device_t *lower, int dirty_limit, int background, int expire_ms);
+int read_writeback(writeback_t *cache, int64_t start_address, int nblocks, void *buffer);
+int write_writeback(writeback_t *cache, int64_t start_address, int nblocks, void *buffer);
+int flush_writeback(writeback_t *cache);
+int discard_writeback(writeback_t *cache, int64_t start_address, int nblocks);
+int get_dirty_count(writeback_t *cache);
+void close_writeback(writeback_t *cache);
+
+#endif